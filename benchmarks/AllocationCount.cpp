@@ -0,0 +1,40 @@
+#include "AllocationCount.hpp"
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+namespace
+{
+    std::atomic<std::size_t> numAllocations{0};
+} // namespace
+
+namespace counting
+{
+    std::size_t getNumAllocations()
+    {
+        return numAllocations;
+    }
+} // namespace counting
+
+// The aligned forms are left alone: they don't go through these in any of
+// the standard libraries and nothing in the scenes uses them.
+void* operator new(std::size_t size)
+{
+    ++numAllocations;
+    if (void* p{std::malloc(size == 0 ? 1 : size)})
+    {
+        return p;
+    }
+    throw std::bad_alloc{};
+}
+
+void operator delete(void* p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void* p, [[maybe_unused]] std::size_t size) noexcept
+{
+    std::free(p);
+}
@@ -0,0 +1,13 @@
+#pragma once
+
+// Linking AllocationCount.cpp into a benchmark replaces the global operator
+// new with one that counts every call, so that it can report how many heap
+// allocations a piece of code makes.
+
+#include <cstddef>
+
+namespace counting
+{
+    // number of calls to operator new since the program started
+    std::size_t getNumAllocations();
+} // namespace counting
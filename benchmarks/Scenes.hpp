@@ -0,0 +1,123 @@
+#pragma once
+
+// Scenes shared by the benchmarks, built from the lab04 classes.
+
+#include <lab04/lab.hpp>
+
+#include <memory>
+
+namespace scenes
+{
+    constexpr std::size_t imageSize{400};
+
+    inline void addSphere(World& world,
+                          atlas::math::Point const& centre,
+                          float radius,
+                          Colour const& colour)
+    {
+        auto sphere{makeSceneObject<Sphere>(world, centre, radius)};
+        sphere->setMaterial(
+            makeSceneObject<Matte>(world, 0.50f, 0.05f, colour));
+        sphere->setColour(colour);
+        world.scene.push_back(sphere);
+    }
+
+    inline void
+    addLight(World& world, atlas::math::Vector const& d, float radiance)
+    {
+        world.lights.push_back(makeSceneObject<Directional>(world, d));
+        world.lights.back()->setColour({1, 1, 1});
+        world.lights.back()->scaleRadiance(radiance);
+    }
+
+    inline std::shared_ptr<World> makeWorld()
+    {
+        std::shared_ptr<World> world{std::make_shared<World>()};
+
+        world->width      = imageSize;
+        world->height     = imageSize;
+        world->background = {0, 0, 0};
+
+        world->ambient = makeSceneObject<Ambient>(*world);
+        world->ambient->setColour({1, 1, 1});
+        world->ambient->scaleRadiance(0.05f);
+
+        return world;
+    }
+
+    // the scene from the lab04 driver
+    inline std::shared_ptr<World> makeFewSpheres()
+    {
+        auto world{makeWorld()};
+        addSphere(*world, {0, 0, -600}, 128.0f, {1, 0, 0});
+        addSphere(*world, {128, 32, -700}, 64.0f, {0, 0, 1});
+        addSphere(*world, {-128, 32, -700}, 64.0f, {0, 1, 0});
+        addLight(*world, {0, 0, 1024}, 4.0f);
+        return world;
+    }
+
+    inline std::shared_ptr<World> makeManySpheres(std::size_t count)
+    {
+        auto world{makeWorld()};
+        common::Pcg32 rng{305, 1};
+
+        const float extent{0.5f * imageSize};
+        for (std::size_t i{0}; i < count; ++i)
+        {
+            const atlas::math::Point centre{
+                (2.0f * rng.nextFloat() - 1.0f) * extent,
+                (2.0f * rng.nextFloat() - 1.0f) * extent,
+                -300.0f - 700.0f * rng.nextFloat()};
+            const Colour colour{
+                rng.nextFloat(), rng.nextFloat(), rng.nextFloat()};
+            addSphere(*world, centre, 2.0f + 6.0f * rng.nextFloat(), colour);
+        }
+
+        addLight(*world, {0, 0, 1024}, 4.0f);
+        return world;
+    }
+
+    inline std::shared_ptr<World> makeManyLights(std::size_t count)
+    {
+        auto world{makeFewSpheres()};
+        world->lights.clear();
+        common::Pcg32 rng{305, 2};
+
+        for (std::size_t i{0}; i < count; ++i)
+        {
+            const atlas::math::Vector d{2.0f * rng.nextFloat() - 1.0f,
+                                        2.0f * rng.nextFloat() - 1.0f,
+                                        1.0f};
+            addLight(*world, d, 4.0f / count);
+        }
+        return world;
+    }
+
+    // Like makeManyLights, but a handful of the lights carry most of the
+    // power, as they would in a real scene, so picking lights by power pays
+    // off over picking them uniformly.
+    inline std::shared_ptr<World> makeUnevenLights(std::size_t count)
+    {
+        auto world{makeFewSpheres()};
+        world->lights.clear();
+        common::Pcg32 rng{305, 3};
+
+        std::vector<float> powers(count);
+        float total{0.0f};
+        for (auto& power : powers)
+        {
+            const float u{rng.nextFloat()};
+            power = u * u * u * u;
+            total += power;
+        }
+
+        for (float power : powers)
+        {
+            const atlas::math::Vector d{2.0f * rng.nextFloat() - 1.0f,
+                                        2.0f * rng.nextFloat() - 1.0f,
+                                        1.0f};
+            addLight(*world, d, 4.0f * power / total);
+        }
+        return world;
+    }
+} // namespace scenes
@@ -0,0 +1,178 @@
+// Sampler convergence benchmark.
+//
+// Renders the lab04 scene with every sampler at a range of sample counts and
+// reports the RMS error against a high sample count reference, along with
+// the render time. The results are also written as JSON:
+//
+//     convergence [output.json]
+//
+// The error of a single render depends on how its sample sets happened to
+// fall, so every entry is averaged over a few seeds. The reference is
+// rendered with a seed none of them use.
+#define main lab04Main
+#include <lab04/solution.cpp>
+#undef main
+
+#include "Scenes.hpp"
+
+#include <fstream>
+#include <functional>
+#include <string>
+
+namespace
+{
+    constexpr int numSets{83};
+    constexpr int samplesPerPixel[]{1, 4, 16, 64};
+    constexpr std::uint64_t seeds[]{0, 1, 2, 3};
+
+    // 16 samples x 64 passes
+    constexpr int referenceSamples{16};
+    constexpr std::uint32_t referencePasses{64};
+    constexpr std::uint64_t referenceSeed{305};
+
+    using MakeSampler = std::function<std::shared_ptr<Sampler>(int)>;
+
+    struct Result
+    {
+        std::string sampler;
+        int spp;
+        float rmsError;
+        double seconds;
+    };
+
+    template<typename T>
+    std::pair<std::string, MakeSampler> entry(std::string const& name)
+    {
+        return {name, [](int spp) {
+                    return std::make_shared<T>(spp, numSets);
+                }};
+    }
+
+    std::vector<Colour> renderReference(World& world)
+    {
+        world.sampler = std::make_shared<Random>(referenceSamples, numSets);
+        world.sampler->setSeed(referenceSeed);
+
+        world.film.reset(world.width * world.height);
+        for (std::uint32_t pass{0}; pass < referencePasses; ++pass)
+        {
+            renderPass(world, pass);
+        }
+
+        std::vector<Colour> reference;
+        world.film.resolve(reference);
+        return reference;
+    }
+
+    Result run(std::string const& name,
+               MakeSampler const& makeSampler,
+               World& world,
+               std::vector<Colour> const& reference,
+               int spp)
+    {
+        Result result{};
+        result.sampler = name;
+        result.spp     = spp;
+
+        world.sampler = makeSampler(spp);
+        for (std::uint64_t seed : seeds)
+        {
+            world.sampler->setSeed(seed);
+
+            common::Timer timer;
+            render(world);
+            result.seconds += timer.elapsedSeconds();
+            result.rmsError += common::getRmsError(world.image, reference);
+        }
+
+        constexpr auto numSeeds{sizeof(seeds) / sizeof(seeds[0])};
+        result.seconds /= numSeeds;
+        result.rmsError /= numSeeds;
+        return result;
+    }
+
+    std::string toJson(std::vector<Result> const& results)
+    {
+        std::string json{"{\n"};
+        json += fmt::format("  \"width\": {},\n", scenes::imageSize);
+        json += fmt::format("  \"height\": {},\n", scenes::imageSize);
+        json += fmt::format("  \"reference_spp\": {},\n",
+                            referenceSamples * referencePasses);
+        json += "  \"results\": [\n";
+
+        for (std::size_t i{0}; i < results.size(); ++i)
+        {
+            auto const& r{results[i]};
+            json += fmt::format("    {{\"sampler\": \"{}\", \"spp\": {}, "
+                                "\"rms_error\": {:.6f}, \"seconds\": {:.6f}}}"
+                                "{}\n",
+                                r.sampler,
+                                r.spp,
+                                r.rmsError,
+                                r.seconds,
+                                i + 1 < results.size() ? "," : "");
+        }
+
+        json += "  ]\n}\n";
+        return json;
+    }
+} // namespace
+
+int main(int argc, char** argv)
+{
+    const std::string output{argc > 1 ? argv[1] : "convergence.json"};
+
+    const std::pair<std::string, MakeSampler> samplers[]{
+        entry<Random>("random"),
+        entry<Regular>("regular"),
+        entry<Jittered>("jittered"),
+        entry<MultiJittered>("multi-jittered"),
+        entry<Hammersley>("hammersley"),
+        entry<Sobol>("sobol"),
+        entry<R2>("r2")};
+
+    auto world{scenes::makeFewSpheres()};
+    compileScene(*world);
+
+    common::Timer timer;
+    const std::vector<Colour> reference{renderReference(*world)};
+    fmt::print("reference: {} spp in {:.3f} s\n",
+               referenceSamples * referencePasses,
+               timer.elapsedSeconds());
+
+    std::vector<Result> results;
+    fmt::print("{:<16} {:>4} {:>10} {:>9} {:>10}\n",
+               "sampler",
+               "spp",
+               "rms error",
+               "time (s)",
+               "vs random");
+
+    for (int spp : samplesPerPixel)
+    {
+        float randomError{0.0f};
+        for (auto const& [name, makeSampler] : samplers)
+        {
+            results.push_back(run(name, makeSampler, *world, reference, spp));
+
+            auto const& r{results.back()};
+            if (r.sampler == "random")
+            {
+                randomError = r.rmsError;
+            }
+
+            fmt::print("{:<16} {:>4} {:>10.5f} {:>9.3f} {:>9.1f}%\n",
+                       r.sampler,
+                       r.spp,
+                       r.rmsError,
+                       r.seconds,
+                       100.0f * r.rmsError / randomError);
+        }
+    }
+
+    std::ofstream file{output};
+    file << toJson(results);
+    fmt::print("results written to {}\n", output);
+
+    return 0;
+}
@@ -0,0 +1,431 @@
+// Image output benchmark.
+//
+// Times the conversion of rendered frames from floating point colours to
+// 8-bit pixels at 1080p, 4K and 8K: first with the per-channel loop every
+// lab's saveToFile used to have, then with common::quantize on each of its
+// kernels, on one thread and on all of them. The results are also written as
+// JSON:
+//
+//     image_output [output.json]
+//
+// Each time is the best of a few runs. The frames are a smooth gradient with
+// a few pixels out of range, and every kernel is checked to give the same
+// bytes as the scalar one.
+//
+// It then renders and saves a sequence of 1080p frames, once calling
+// saveToFile between frames and once through a common::ImageWriter, and
+// reports how much of the output time overlapped with rendering.
+//
+// Last, it saves the 1080p and 4K frames in every format saveToFile
+// supports, on one thread and on all of them, and reports the time each
+// takes and the size of the file.
+#include <common/Cpu.hpp>
+#include <common/Image.hpp>
+#include <common/ImageWriter.hpp>
+#include <common/Pcg32.hpp>
+#include <common/ThreadPool.hpp>
+#include <common/Timer.hpp>
+
+#include <fmt/printf.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <limits>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace
+{
+    using Colour = atlas::math::Vector;
+
+    struct Resolution
+    {
+        char const* name;
+        std::size_t width;
+        std::size_t height;
+    };
+
+    constexpr Resolution resolutions[]{
+        {"1080p", 1920, 1080}, {"4K", 3840, 2160}, {"8K", 7680, 4320}};
+
+    constexpr int numRuns{5};
+
+    struct Result
+    {
+        std::string resolution;
+        std::string method;
+        double seconds;
+        double megapixelsPerSecond;
+    };
+
+    constexpr std::size_t numSequenceFrames{24};
+
+    struct SequenceResult
+    {
+        std::string method;
+        double seconds;
+        double writeSeconds;
+        double waitSeconds;
+    };
+
+    struct FormatResult
+    {
+        std::string resolution;
+        std::string format;
+        std::size_t threads;
+        double seconds;
+        long bytes;
+    };
+
+    constexpr char const* formats[]{"bmp", "ppm", "png", "qoi", "pfm", "exr"};
+
+    long getFileSize(std::string const& filename)
+    {
+        std::FILE* file{std::fopen(filename.c_str(), "rb")};
+        if (file == nullptr)
+        {
+            return 0;
+        }
+
+        std::fseek(file, 0, SEEK_END);
+        const long size{std::ftell(file)};
+        std::fclose(file);
+        return size;
+    }
+
+    void makeFrame(std::size_t width,
+                   std::size_t height,
+                   std::vector<Colour>& image)
+    {
+        common::Pcg32 rng{305, 1};
+        image.resize(width * height);
+        for (std::size_t y{0}; y < height; ++y)
+        {
+            for (std::size_t x{0}; x < width; ++x)
+            {
+                const float u{static_cast<float>(x) / width};
+                const float v{static_cast<float>(y) / height};
+                image[x + y * width] = {u, v, 0.5f * rng.nextFloat()};
+            }
+        }
+
+        // the highlights and the odd bad sample a renderer can produce
+        for (std::size_t i{0}; i < image.size(); i += 997)
+        {
+            image[i] = {1.5f, -0.25f, std::numeric_limits<float>::infinity()};
+        }
+    }
+
+    std::vector<Colour> makeFrame(std::size_t width, std::size_t height)
+    {
+        std::vector<Colour> image;
+        makeFrame(width, height, image);
+        return image;
+    }
+
+    // Stands in for a renderer producing a sequence of frames, saving each
+    // one either with saveToFile or through an ImageWriter.
+    SequenceResult renderSequence(Resolution const& res, bool background)
+    {
+        const std::string filename{"image_output_frame.bmp"};
+
+        common::Timer timer;
+        if (!background)
+        {
+            double writeSeconds{0.0};
+            std::vector<Colour> image;
+            for (std::size_t i{0}; i < numSequenceFrames; ++i)
+            {
+                makeFrame(res.width, res.height, image);
+
+                common::Timer writeTimer;
+                common::saveToFile(filename, res.width, res.height, image);
+                writeSeconds += writeTimer.elapsedSeconds();
+            }
+
+            std::remove(filename.c_str());
+            return {"saveToFile", timer.elapsedSeconds(), writeSeconds,
+                    writeSeconds};
+        }
+
+        common::ImageWriter writer;
+        for (std::size_t i{0}; i < numSequenceFrames; ++i)
+        {
+            auto image{writer.acquireBuffer(res.width * res.height)};
+            makeFrame(res.width, res.height, image);
+            writer.write(filename, res.width, res.height, std::move(image));
+        }
+        writer.flush();
+
+        const auto stats{writer.getStats()};
+        std::remove(filename.c_str());
+        return {"ImageWriter", timer.elapsedSeconds(), stats.writeSeconds,
+                stats.waitSeconds};
+    }
+
+    // what every saveToFile did before common/Image.hpp
+    void quantizeLoop(std::vector<Colour> const& image,
+                      std::vector<unsigned char>& data)
+    {
+        for (std::size_t i{0}, k{0}; i < image.size(); ++i, k += 3)
+        {
+            Colour pixel = image[i];
+            data[k + 0]  = static_cast<unsigned char>(pixel.r * 255);
+            data[k + 1]  = static_cast<unsigned char>(pixel.g * 255);
+            data[k + 2]  = static_cast<unsigned char>(pixel.b * 255);
+        }
+    }
+
+    template<typename Fn>
+    double bestOf(Fn const& fn)
+    {
+        double best{std::numeric_limits<double>::infinity()};
+        for (int run{0}; run < numRuns; ++run)
+        {
+            common::Timer timer;
+            fn();
+            best = std::min(best, timer.elapsedSeconds());
+        }
+        return best;
+    }
+
+    std::string toJson(std::vector<Result> const& results,
+                       std::vector<SequenceResult> const& sequence,
+                       std::vector<FormatResult> const& formatResults)
+    {
+        std::string json{fmt::format(
+            "{{\n  \"simd\": \"{}\",\n  \"threads\": {},\n  \"results\": [\n",
+            common::getSimdName(common::getSimdLevel()),
+            std::thread::hardware_concurrency())};
+
+        for (std::size_t i{0}; i < results.size(); ++i)
+        {
+            auto const& r{results[i]};
+            json += fmt::format("    {{\"resolution\": \"{}\", \"method\": "
+                                "\"{}\", \"seconds\": {:.6f}, "
+                                "\"megapixels_per_second\": {:.1f}}}{}\n",
+                                r.resolution,
+                                r.method,
+                                r.seconds,
+                                r.megapixelsPerSecond,
+                                i + 1 < results.size() ? "," : "");
+        }
+
+        json += fmt::format("  ],\n  \"sequence_frames\": {},\n"
+                            "  \"sequence\": [\n",
+                            numSequenceFrames);
+        for (std::size_t i{0}; i < sequence.size(); ++i)
+        {
+            auto const& r{sequence[i]};
+            json += fmt::format("    {{\"method\": \"{}\", \"seconds\": "
+                                "{:.6f}, \"write_seconds\": {:.6f}, "
+                                "\"wait_seconds\": {:.6f}}}{}\n",
+                                r.method,
+                                r.seconds,
+                                r.writeSeconds,
+                                r.waitSeconds,
+                                i + 1 < sequence.size() ? "," : "");
+        }
+
+        json += "  ],\n  \"formats\": [\n";
+        for (std::size_t i{0}; i < formatResults.size(); ++i)
+        {
+            auto const& r{formatResults[i]};
+            json += fmt::format("    {{\"resolution\": \"{}\", \"format\": "
+                                "\"{}\", \"threads\": {}, \"seconds\": "
+                                "{:.6f}, \"bytes\": {}}}{}\n",
+                                r.resolution,
+                                r.format,
+                                r.threads,
+                                r.seconds,
+                                r.bytes,
+                                i + 1 < formatResults.size() ? "," : "");
+        }
+
+        json += "  ]\n}\n";
+        return json;
+    }
+} // namespace
+
+int main(int argc, char** argv)
+{
+    const std::string output{argc > 1 ? argv[1] : "image_output.json"};
+
+    common::ThreadPool pool;
+    fmt::print("simd: {}, threads: {}\n\n",
+               common::getSimdName(common::getSimdLevel()),
+               pool.size());
+
+    struct Method
+    {
+        std::string name;
+        common::ImageSettings settings;
+    };
+
+    std::vector<Method> methods;
+    for (auto level : {common::SimdLevel::Scalar,
+                       common::SimdLevel::Sse2,
+                       common::SimdLevel::Avx2})
+    {
+        if (level > common::getSimdLevel())
+        {
+            continue;
+        }
+
+        common::ImageSettings settings;
+        settings.level = level;
+        methods.push_back({common::getSimdName(level), settings});
+
+        settings.encoding = common::Encoding::Srgb;
+        settings.dither   = true;
+        methods.push_back(
+            {fmt::format("{} srgb dither", common::getSimdName(level)),
+             settings});
+    }
+
+    common::ImageSettings threaded;
+    threaded.pool = &pool;
+    methods.push_back({"threaded", threaded});
+    threaded.encoding = common::Encoding::Srgb;
+    threaded.dither   = true;
+    methods.push_back({"threaded srgb dither", threaded});
+
+    std::vector<Result> results;
+    fmt::print("{:>6} {:>22} {:>10} {:>8} {:>8}\n",
+               "frame",
+               "method",
+               "ms",
+               "Mpix/s",
+               "speedup");
+
+    for (auto const& res : resolutions)
+    {
+        const auto image{makeFrame(res.width, res.height)};
+        const double megapixels{image.size() * 1.0e-6};
+        std::vector<unsigned char> data(image.size() * 3);
+        std::vector<std::uint8_t> reference(image.size() * 3);
+
+        const double loopSeconds{
+            bestOf([&]() { quantizeLoop(image, data); })};
+
+        auto report{[&](std::string const& method, double seconds) {
+            results.push_back(
+                {res.name, method, seconds, megapixels / seconds});
+            fmt::print("{:>6} {:>22} {:>10.2f} {:>8.1f} {:>7.1f}x\n",
+                       res.name,
+                       method,
+                       seconds * 1000.0,
+                       megapixels / seconds,
+                       loopSeconds / seconds);
+        }};
+
+        report("loop", loopSeconds);
+
+        for (auto const& method : methods)
+        {
+            std::vector<std::uint8_t> out(image.size() * 3);
+            report(method.name, bestOf([&]() {
+                       common::quantize(image.data(),
+                                        res.width,
+                                        res.height,
+                                        out.data(),
+                                        method.settings);
+                   }));
+
+            // every kernel has to match the scalar one
+            common::ImageSettings scalar{method.settings};
+            scalar.level = common::SimdLevel::Scalar;
+            scalar.pool  = nullptr;
+            common::quantize(image.data(),
+                             res.width,
+                             res.height,
+                             reference.data(),
+                             scalar);
+            if (out != reference)
+            {
+                fmt::print(stderr, "{}: differs from scalar\n", method.name);
+            }
+        }
+
+        fmt::print("\n");
+    }
+
+    fmt::print("{} frames at {}, rendered and saved:\n",
+               numSequenceFrames,
+               resolutions[0].name);
+    fmt::print("{:>12} {:>10} {:>10} {:>10} {:>12}\n",
+               "method",
+               "total ms",
+               "write ms",
+               "waited ms",
+               "overlap ms");
+
+    std::vector<SequenceResult> sequence;
+    for (bool background : {false, true})
+    {
+        sequence.push_back(renderSequence(resolutions[0], background));
+        auto const& r{sequence.back()};
+        fmt::print("{:>12} {:>10.1f} {:>10.1f} {:>10.1f} {:>12.1f}\n",
+                   r.method,
+                   r.seconds * 1000.0,
+                   r.writeSeconds * 1000.0,
+                   r.waitSeconds * 1000.0,
+                   (r.writeSeconds - r.waitSeconds) * 1000.0);
+    }
+    fmt::print("\n");
+
+    fmt::print("{:>6} {:>6} {:>8} {:>10} {:>10} {:>8}\n",
+               "frame",
+               "format",
+               "threads",
+               "ms",
+               "MB",
+               "of bmp");
+
+    std::vector<FormatResult> formatResults;
+    for (auto const& res : {resolutions[0], resolutions[1]})
+    {
+        const auto image{makeFrame(res.width, res.height)};
+        long bmpBytes{0};
+        for (auto format : formats)
+        {
+            const std::string filename{
+                fmt::format("image_output_frame.{}", format)};
+            for (common::ThreadPool* threads :
+                 {static_cast<common::ThreadPool*>(nullptr), &pool})
+            {
+                common::ImageSettings settings;
+                settings.pool = threads;
+                const double seconds{bestOf([&]() {
+                    common::saveToFile(
+                        filename, res.width, res.height, image, settings);
+                })};
+
+                const long bytes{getFileSize(filename)};
+                bmpBytes = bmpBytes == 0 ? bytes : bmpBytes;
+                formatResults.push_back({res.name,
+                                         format,
+                                         threads ? threads->size() : 1,
+                                         seconds,
+                                         bytes});
+                fmt::print("{:>6} {:>6} {:>8} {:>10.1f} {:>10.2f} {:>7.1f}%\n",
+                           res.name,
+                           format,
+                           formatResults.back().threads,
+                           seconds * 1000.0,
+                           bytes * 1.0e-6,
+                           100.0 * bytes / bmpBytes);
+            }
+            std::remove(filename.c_str());
+        }
+        fmt::print("\n");
+    }
+
+    std::ofstream file{output};
+    file << toJson(results, sequence, formatResults);
+    fmt::print("results written to {}\n", output);
+    return 0;
+}
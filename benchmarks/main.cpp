@@ -0,0 +1,510 @@
+// Render throughput benchmarks.
+//
+// Renders a fixed set of scenes built from the lab04 classes and reports
+// rays/s, samples/s, ns per ray-sphere test and peak RSS, then compares
+// rendering with and without shadows and times the shadow rays on their own
+// with the any-hit occlusion query against a closest-hit search. Finally it
+// renders scenes with more and more lights, once shading every light and
+// once shading a few picked by power, to show the cost of the latter stays
+// flat. The results are also written as JSON so runs can be diffed between
+// commits:
+//
+//     benchmarks [output.json]
+//
+// The lab04 solution is compiled in directly, with its driver renamed so it
+// doesn't clash with the one below. CMake copies it into the build tree next
+// to its header, see CMakeLists.txt.
+#define main lab04Main
+#include <lab04/solution.cpp>
+#undef main
+
+#include "Scenes.hpp"
+
+#include <common/Memory.hpp>
+
+#include <fstream>
+#include <string>
+
+namespace
+{
+    using scenes::imageSize;
+
+    constexpr int numSets{83};
+    constexpr int samplesPerPixel[]{1, 4, 16, 64};
+    constexpr int shadowSamplesPerPixel{4};
+    constexpr std::size_t lightCounts[]{1, 16, 256, 4096};
+    constexpr std::uint32_t lightSamples[]{0, 1, 4};
+
+    struct Result
+    {
+        std::string scene;
+        std::size_t numObjects;
+        std::size_t numLights;
+        int spp;
+        double seconds;
+        std::uint64_t numShadowRays;
+        double raysPerSecond;
+        double samplesPerSecond;
+        std::uint64_t numTests;
+        double nsPerTest;
+        std::size_t peakRss;
+    };
+
+    struct ShadowResult
+    {
+        std::string scene;
+        std::size_t numObjects;
+        std::size_t numLights;
+        int spp;
+        double unshadowedSeconds;
+        double shadowedSeconds;
+        std::uint64_t numShadowRays;
+        double occludedFraction;
+        double anyHitRaysPerSecond;
+        double closestHitRaysPerSecond;
+    };
+
+    struct LightResult
+    {
+        std::size_t numLights;
+        std::uint32_t lightSamples;
+        double seconds;
+        float rmsError;
+    };
+
+    // Traces the same primary rays as render, but only finds the closest
+    // hit. Returns the number of ray-sphere tests the kernels ran. The time
+    // per test reported from this includes ray generation and traversal, so
+    // it is only comparable between runs of the same scene.
+    std::uint64_t traceOnly(World const& world)
+    {
+        using atlas::math::Ray;
+        using atlas::math::Vector;
+
+        Ray<Vector> ray{{0, 0, 0}, {0, 0, -1}};
+        SampleCursor cursor{};
+        std::uint64_t numTests{0};
+
+        for (std::size_t r{0}; r < world.height; ++r)
+        {
+            for (std::size_t c{0}; c < world.width; ++c)
+            {
+                world.sampler->startPixel(cursor, r * world.width + c);
+
+                for (auto const& sample : world.sampler->samplePixel(cursor))
+                {
+                    ray.o = Vector{c - 0.5f * world.width + sample.x,
+                                   r - 0.5f * world.height + sample.y,
+                                   0};
+
+                    float tMax{std::numeric_limits<float>::max()};
+                    world.bvh.traverse(
+                        ray,
+                        tMax,
+                        [&](std::uint32_t first, std::uint32_t count) {
+                            numTests += count;
+                            float t{};
+                            if (world.spheres.closestHit(
+                                    ray, first, count, tMax, t) < 0)
+                            {
+                                return false;
+                            }
+                            tMax = t;
+                            return true;
+                        });
+                }
+            }
+        }
+
+        return numTests;
+    }
+
+    // Calls fn(ray) for every shadow ray render traces: one per sample
+    // that hits something, for each light that faces the hit point and
+    // casts shadows.
+    template<typename ShadowRayFn>
+    void forEachShadowRay(World const& world, ShadowRayFn&& fn)
+    {
+        using atlas::math::Ray;
+        using atlas::math::Vector;
+
+        Ray<Vector> ray{{0, 0, 0}, {0, 0, -1}};
+        SampleCursor cursor{};
+
+        for (std::size_t r{0}; r < world.height; ++r)
+        {
+            for (std::size_t c{0}; c < world.width; ++c)
+            {
+                world.sampler->startPixel(cursor, r * world.width + c);
+
+                for (auto const& sample : world.sampler->samplePixel(cursor))
+                {
+                    ray.o = Vector{c - 0.5f * world.width + sample.x,
+                                   r - 0.5f * world.height + sample.y,
+                                   0};
+
+                    ShadeRec sr{};
+                    sr.world = &world;
+                    sr.t     = std::numeric_limits<float>::max();
+                    if (!hitScene(world, ray, sr))
+                    {
+                        continue;
+                    }
+
+                    const atlas::math::Point hitPoint{ray.o + sr.t * ray.d};
+                    for (auto const& light : world.lights)
+                    {
+                        const Vector wi{light->getDirection(sr)};
+                        if (light->castsShadows() &&
+                            glm::dot(sr.normal, wi) > 0.0f)
+                        {
+                            fn(Ray<Vector>{hitPoint, wi});
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    void setShadows(World& world, bool shadows)
+    {
+        for (auto const& light : world.lights)
+        {
+            light->setShadows(shadows);
+        }
+        compileScene(world);
+    }
+
+    Result run(std::string const& name, World& world, int spp)
+    {
+        world.sampler = std::make_shared<Random>(spp, numSets);
+
+        common::Timer timer;
+        render(world);
+        const double seconds{timer.elapsedSeconds()};
+
+        timer.reset();
+        const std::uint64_t numTests{traceOnly(world)};
+        const double traceSeconds{timer.elapsedSeconds()};
+
+        std::uint64_t numShadowRays{0};
+        forEachShadowRay(world, [&](auto const&) { ++numShadowRays; });
+
+        // every sample is one primary ray plus its shadow rays
+        const double numSamples{
+            static_cast<double>(world.width * world.height * spp)};
+        const double numRays{numSamples + numShadowRays};
+
+        Result result{};
+        result.scene            = name;
+        result.numObjects       = world.scene.size();
+        result.numLights        = world.lights.size();
+        result.spp              = spp;
+        result.seconds          = seconds;
+        result.numShadowRays    = numShadowRays;
+        result.raysPerSecond    = numRays / seconds;
+        result.samplesPerSecond = numSamples / seconds;
+        result.numTests         = numTests;
+        result.nsPerTest        = numTests == 0
+                               ? 0.0
+                               : traceSeconds * 1.0e9 / numTests;
+        result.peakRss = common::getPeakRss();
+        return result;
+    }
+
+    ShadowResult runShadows(std::string const& name, World& world)
+    {
+        using atlas::math::Ray;
+        using atlas::math::Vector;
+
+        world.sampler =
+            std::make_shared<Random>(shadowSamplesPerPixel, numSets);
+
+        ShadowResult result{};
+        result.scene      = name;
+        result.numObjects = world.scene.size();
+        result.numLights  = world.lights.size();
+        result.spp        = shadowSamplesPerPixel;
+
+        setShadows(world, false);
+        common::Timer timer;
+        render(world);
+        result.unshadowedSeconds = timer.elapsedSeconds();
+
+        setShadows(world, true);
+        timer.reset();
+        render(world);
+        result.shadowedSeconds = timer.elapsedSeconds();
+
+        std::vector<Ray<Vector>> rays;
+        forEachShadowRay(
+            world, [&](Ray<Vector> const& ray) { rays.push_back(ray); });
+        result.numShadowRays = rays.size();
+
+        std::size_t numOccluded{0};
+        timer.reset();
+        for (auto const& ray : rays)
+        {
+            numOccluded += occludedScene(
+                world, ray, std::numeric_limits<float>::max());
+        }
+        const double anyHitSeconds{timer.elapsedSeconds()};
+
+        // what the shadow rays would cost if they went through the closest
+        // hit search primary rays use
+        std::size_t numHit{0};
+        timer.reset();
+        for (auto const& ray : rays)
+        {
+            ShadeRec sr{};
+            sr.world = &world;
+            sr.t     = std::numeric_limits<float>::max();
+            numHit += hitScene(world, ray, sr);
+        }
+        const double closestHitSeconds{timer.elapsedSeconds()};
+
+        if (numHit != numOccluded)
+        {
+            fmt::print(stderr,
+                       "{}: {} shadow rays occluded but {} hit\n",
+                       name,
+                       numOccluded,
+                       numHit);
+        }
+
+        const double numRays{static_cast<double>(rays.size())};
+        result.occludedFraction =
+            rays.empty() ? 0.0 : numOccluded / numRays;
+        result.anyHitRaysPerSecond     = numRays / anyHitSeconds;
+        result.closestHitRaysPerSecond = numRays / closestHitSeconds;
+        return result;
+    }
+
+    // Renders the same scene at 1 spp with every value of lightSamples. The
+    // error is measured against the render that shades every light, so it
+    // is only the noise added by sampling the lights.
+    std::vector<LightResult> runLights(std::size_t numLights)
+    {
+        auto world{scenes::makeUnevenLights(numLights)};
+        world->sampler = std::make_shared<Random>(1, numSets);
+        compileScene(*world);
+
+        std::vector<Colour> reference;
+        std::vector<LightResult> results;
+        for (std::uint32_t samples : lightSamples)
+        {
+            world->lightSamples = samples;
+
+            common::Timer timer;
+            render(*world);
+
+            LightResult result{};
+            result.numLights    = numLights;
+            result.lightSamples = samples;
+            result.seconds      = timer.elapsedSeconds();
+
+            if (samples == 0)
+            {
+                reference = world->image;
+            }
+            result.rmsError = common::getRmsError(world->image, reference);
+            results.push_back(result);
+        }
+        return results;
+    }
+
+    std::string toJson(std::vector<Result> const& results,
+                       std::vector<ShadowResult> const& shadows,
+                       std::vector<LightResult> const& lights)
+    {
+        std::string json{"{\n"};
+        json += fmt::format("  \"simd\": \"{}\",\n",
+                            common::getSimdName(common::getSimdLevel()));
+        json += fmt::format("  \"width\": {},\n", imageSize);
+        json += fmt::format("  \"height\": {},\n", imageSize);
+        json += "  \"results\": [\n";
+
+        for (std::size_t i{0}; i < results.size(); ++i)
+        {
+            auto const& r{results[i]};
+            json += fmt::format(
+                "    {{\"scene\": \"{}\", \"objects\": {}, \"lights\": {}, "
+                "\"spp\": {}, \"seconds\": {:.6f}, \"shadow_rays\": {}, "
+                "\"rays_per_second\": {:.0f}, \"samples_per_second\": {:.0f}, "
+                "\"intersection_tests\": {}, "
+                "\"ns_per_intersection_test\": {:.3f}, "
+                "\"peak_rss_bytes\": {}}}{}\n",
+                r.scene,
+                r.numObjects,
+                r.numLights,
+                r.spp,
+                r.seconds,
+                r.numShadowRays,
+                r.raysPerSecond,
+                r.samplesPerSecond,
+                r.numTests,
+                r.nsPerTest,
+                r.peakRss,
+                i + 1 < results.size() ? "," : "");
+        }
+
+        json += "  ],\n  \"shadows\": [\n";
+
+        for (std::size_t i{0}; i < shadows.size(); ++i)
+        {
+            auto const& s{shadows[i]};
+            json += fmt::format(
+                "    {{\"scene\": \"{}\", \"objects\": {}, \"lights\": {}, "
+                "\"spp\": {}, \"unshadowed_seconds\": {:.6f}, "
+                "\"shadowed_seconds\": {:.6f}, \"shadow_rays\": {}, "
+                "\"occluded_fraction\": {:.4f}, "
+                "\"any_hit_rays_per_second\": {:.0f}, "
+                "\"closest_hit_rays_per_second\": {:.0f}}}{}\n",
+                s.scene,
+                s.numObjects,
+                s.numLights,
+                s.spp,
+                s.unshadowedSeconds,
+                s.shadowedSeconds,
+                s.numShadowRays,
+                s.occludedFraction,
+                s.anyHitRaysPerSecond,
+                s.closestHitRaysPerSecond,
+                i + 1 < shadows.size() ? "," : "");
+        }
+
+        json += "  ],\n  \"light_sampling\": [\n";
+
+        for (std::size_t i{0}; i < lights.size(); ++i)
+        {
+            auto const& l{lights[i]};
+            json += fmt::format(
+                "    {{\"lights\": {}, \"light_samples\": {}, "
+                "\"seconds\": {:.6f}, \"rms_error\": {:.6f}}}{}\n",
+                l.numLights,
+                l.lightSamples,
+                l.seconds,
+                l.rmsError,
+                i + 1 < lights.size() ? "," : "");
+        }
+
+        json += "  ]\n}\n";
+        return json;
+    }
+} // namespace
+
+int main(int argc, char** argv)
+{
+    const std::string output{argc > 1 ? argv[1] : "benchmarks.json"};
+
+    // smallest scenes first, peak RSS only ever grows
+    const std::pair<std::string, std::shared_ptr<World>> scenes[]{
+        {"few_spheres", scenes::makeFewSpheres()},
+        {"many_lights_64", scenes::makeManyLights(64)},
+        {"spheres_10k", scenes::makeManySpheres(10000)}};
+
+    std::vector<Result> results;
+    fmt::print("{:<16} {:>7} {:>6} {:>4} {:>9} {:>10} {:>10} {:>8} {:>9}\n",
+               "scene",
+               "objects",
+               "lights",
+               "spp",
+               "time (s)",
+               "Mrays/s",
+               "Msamples/s",
+               "ns/test",
+               "RSS (MB)");
+
+    for (auto const& [name, world] : scenes)
+    {
+        compileScene(*world);
+
+        for (int spp : samplesPerPixel)
+        {
+            results.push_back(run(name, *world, spp));
+
+            auto const& r{results.back()};
+            fmt::print(
+                "{:<16} {:>7} {:>6} {:>4} {:>9.3f} {:>10.2f} {:>10.2f} "
+                "{:>8.2f} {:>9.1f}\n",
+                r.scene,
+                r.numObjects,
+                r.numLights,
+                r.spp,
+                r.seconds,
+                r.raysPerSecond * 1.0e-6,
+                r.samplesPerSecond * 1.0e-6,
+                r.nsPerTest,
+                r.peakRss / (1024.0 * 1024.0));
+        }
+    }
+
+    // the spheres_10k light shines straight down the view direction, so
+    // every visible point is lit and no shadow ray can stop early; the
+    // oblique light casts long shadows over the field instead
+    auto oblique{scenes::makeManySpheres(10000)};
+    oblique->lights.clear();
+    scenes::addLight(*oblique, {1, 1, 1}, 4.0f);
+
+    const std::pair<std::string, std::shared_ptr<World>> shadowScenes[]{
+        {"many_lights_64", scenes[1].second},
+        {"spheres_10k", scenes[2].second},
+        {"spheres_10k_oblique", oblique}};
+
+    std::vector<ShadowResult> shadows;
+    fmt::print("\n{:<20} {:>4} {:>9} {:>9} {:>8} {:>9} {:>9} {:>12}\n",
+               "scene",
+               "spp",
+               "off (s)",
+               "on (s)",
+               "Mshadow",
+               "occluded",
+               "any-hit",
+               "closest-hit");
+
+    for (auto const& [name, world] : shadowScenes)
+    {
+        shadows.push_back(runShadows(name, *world));
+
+        auto const& s{shadows.back()};
+        fmt::print("{:<20} {:>4} {:>9.3f} {:>9.3f} {:>8.2f} {:>8.1f}% "
+                   "{:>9.2f} {:>12.2f}\n",
+                   s.scene,
+                   s.spp,
+                   s.unshadowedSeconds,
+                   s.shadowedSeconds,
+                   s.numShadowRays * 1.0e-6,
+                   100.0 * s.occludedFraction,
+                   s.anyHitRaysPerSecond * 1.0e-6,
+                   s.closestHitRaysPerSecond * 1.0e-6);
+    }
+    fmt::print("(any-hit and closest-hit in Mrays/s over the shadow rays)\n");
+
+    std::vector<LightResult> lights;
+    fmt::print("\n{:>6} {:>13} {:>9} {:>10}\n",
+               "lights",
+               "light samples",
+               "time (s)",
+               "rms error");
+
+    for (std::size_t numLights : lightCounts)
+    {
+        for (auto const& l : runLights(numLights))
+        {
+            lights.push_back(l);
+            fmt::print("{:>6} {:>13} {:>9.3f} {:>10.6f}\n",
+                       l.numLights,
+                       l.lightSamples == 0 ? std::string{"all"}
+                                           : std::to_string(l.lightSamples),
+                       l.seconds,
+                       l.rmsError);
+        }
+    }
+    fmt::print("(1 spp, error against shading every light)\n");
+
+    std::ofstream file{output};
+    file << toJson(results, shadows, lights);
+    fmt::print("results written to {}\n", output);
+
+    return 0;
+}
@@ -0,0 +1,367 @@
+// Scene loading benchmark.
+//
+// Writes scene files with more and more spheres, then times loadScene on
+// each of them along with compileScene, which builds the BVH the render
+// needs. Each compiled scene is then saved as a scene cache, which is timed
+// loading back both as is and with its checksum verified. Last, the same
+// spheres are built in memory with every object on the heap and then with
+// the objects in the world's arenas (see makeSceneObject), counting the
+// allocations each makes and timing the build, the compile and the teardown.
+// The results are also written as JSON:
+//
+//     scene_load [output.json]
+//
+// The files go to the system temporary directory and are removed afterwards.
+// They are read once before timing so that the numbers measure the parser
+// rather than the disk.
+#define main lab04Main
+#include <lab04/solution.cpp>
+#undef main
+
+#include "AllocationCount.hpp"
+#include "Scenes.hpp"
+
+#include <common/Memory.hpp>
+
+#include <filesystem>
+#include <fstream>
+#include <string>
+
+namespace
+{
+    constexpr std::size_t sphereCounts[]{1000, 10000, 100000, 1000000};
+    constexpr std::size_t numMaterials{16};
+
+    struct Result
+    {
+        std::size_t numSpheres;
+        std::uintmax_t fileSize;
+        double loadSeconds;
+        double compileSeconds;
+        std::uintmax_t cacheSize;
+        double cacheSeconds;
+        double verifiedSeconds;
+        std::size_t peakRss;
+    };
+
+    struct BuildResult
+    {
+        std::size_t numSpheres;
+        bool arena;
+        std::size_t allocations;
+        double buildSeconds;
+        double compileSeconds;
+        double teardownSeconds;
+    };
+
+    // the same layout as scenes::makeManySpheres, with the colours drawn
+    // from a few shared materials
+    void writeScene(std::string const& filename, std::size_t count)
+    {
+        common::Pcg32 rng{305, 1};
+        std::string text;
+        text += fmt::format(
+            "image {} {}\n", scenes::imageSize, scenes::imageSize);
+        text += "ambient 1 1 1 0.05\ndirectional 0 0 1024 1 1 1 4\n";
+
+        for (std::size_t i{0}; i < numMaterials; ++i)
+        {
+            text += fmt::format("material m{} matte 0.5 0.05 {:.3f} {:.3f} "
+                                "{:.3f}\n",
+                                i,
+                                rng.nextFloat(),
+                                rng.nextFloat(),
+                                rng.nextFloat());
+        }
+
+        const float extent{0.5f * scenes::imageSize};
+        for (std::size_t i{0}; i < count; ++i)
+        {
+            const float x{(2.0f * rng.nextFloat() - 1.0f) * extent};
+            const float y{(2.0f * rng.nextFloat() - 1.0f) * extent};
+            const float z{-300.0f - 700.0f * rng.nextFloat()};
+            const float radius{2.0f + 6.0f * rng.nextFloat()};
+            text += fmt::format("sphere {:.3f} {:.3f} {:.3f} {:.3f} m{}\n",
+                                x,
+                                y,
+                                z,
+                                radius,
+                                rng.nextBounded(numMaterials));
+        }
+
+        std::ofstream file{filename, std::ios::binary};
+        file << text;
+    }
+
+    // pulls the file into the page cache
+    void readFile(std::string const& filename)
+    {
+        std::ifstream file{filename, std::ios::binary};
+        std::vector<char> buffer(1 << 20);
+        while (file.read(buffer.data(), buffer.size()))
+        {}
+    }
+
+    Result run(std::string const& filename,
+               std::string const& cacheFile,
+               std::size_t count)
+    {
+        writeScene(filename, count);
+        readFile(filename);
+
+        Result result{};
+        result.numSpheres = count;
+        result.fileSize   = std::filesystem::file_size(filename);
+
+        common::Timer timer;
+        auto world{loadScene(filename)};
+        result.loadSeconds = timer.elapsedSeconds();
+
+        timer.reset();
+        compileScene(*world);
+        result.compileSeconds = timer.elapsedSeconds();
+        result.peakRss        = common::getPeakRss();
+
+        if (world->scene.size() != count)
+        {
+            fmt::print(stderr,
+                       "{}: loaded {} spheres instead of {}\n",
+                       filename,
+                       world->scene.size(),
+                       count);
+        }
+
+        saveSceneCache(*world, cacheFile);
+        readFile(cacheFile);
+        result.cacheSize = std::filesystem::file_size(cacheFile);
+
+        timer.reset();
+        auto cached{loadSceneCache(cacheFile)};
+        result.cacheSeconds = timer.elapsedSeconds();
+
+        timer.reset();
+        loadSceneCache(cacheFile, true);
+        result.verifiedSeconds = timer.elapsedSeconds();
+
+        // the cache has to render exactly what it was saved from
+        render(*world);
+        render(*cached);
+        if (world->image != cached->image)
+        {
+            fmt::print(stderr, "{}: cache renders differently\n", cacheFile);
+        }
+
+        std::filesystem::remove(filename);
+        std::filesystem::remove(cacheFile);
+        return result;
+    }
+
+    template<bool useArena, typename T, typename... Args>
+    std::shared_ptr<T> makeObject(World& world, Args&&... args)
+    {
+        if constexpr (useArena)
+        {
+            return makeSceneObject<T>(world, std::forward<Args>(args)...);
+        }
+        else
+        {
+            return std::make_shared<T>(std::forward<Args>(args)...);
+        }
+    }
+
+    // the scene writeScene describes, built directly the way loadScene
+    // would, with the objects either on the heap or in the world's arenas
+    template<bool useArena>
+    std::shared_ptr<World> buildScene(std::size_t count)
+    {
+        common::Pcg32 rng{305, 1};
+        auto world{std::make_shared<World>()};
+        world->width        = scenes::imageSize;
+        world->height       = scenes::imageSize;
+        world->background   = {0, 0, 0};
+        world->sampler      = std::make_shared<Random>(1, 83);
+        world->lightSamples = 0;
+
+        world->ambient = makeObject<useArena, Ambient>(*world);
+        world->ambient->setColour({1, 1, 1});
+        world->ambient->scaleRadiance(0.05f);
+        world->lights.push_back(makeObject<useArena, Directional>(
+            *world, atlas::math::Vector{0, 0, 1024}));
+        world->lights[0]->setColour({1, 1, 1});
+        world->lights[0]->scaleRadiance(4.0f);
+
+        std::vector<std::shared_ptr<Material>> materials;
+        std::vector<Colour> colours;
+        for (std::size_t i{0}; i < numMaterials; ++i)
+        {
+            const Colour colour{
+                rng.nextFloat(), rng.nextFloat(), rng.nextFloat()};
+            materials.push_back(
+                makeObject<useArena, Matte>(*world, 0.5f, 0.05f, colour));
+            colours.push_back(colour);
+        }
+
+        const float extent{0.5f * scenes::imageSize};
+        for (std::size_t i{0}; i < count; ++i)
+        {
+            const float x{(2.0f * rng.nextFloat() - 1.0f) * extent};
+            const float y{(2.0f * rng.nextFloat() - 1.0f) * extent};
+            const float z{-300.0f - 700.0f * rng.nextFloat()};
+            const float radius{2.0f + 6.0f * rng.nextFloat()};
+            const std::uint32_t m{rng.nextBounded(numMaterials)};
+
+            auto sphere{makeObject<useArena, Sphere>(
+                *world, atlas::math::Point{x, y, z}, radius)};
+            sphere->setMaterial(materials[m]);
+            sphere->setColour(colours[m]);
+            world->scene.push_back(std::move(sphere));
+        }
+
+        return world;
+    }
+
+    template<bool useArena>
+    BuildResult runBuild(std::size_t count)
+    {
+        BuildResult result{};
+        result.numSpheres = count;
+        result.arena      = useArena;
+
+        const std::size_t before{counting::getNumAllocations()};
+        common::Timer timer;
+        auto world{buildScene<useArena>(count)};
+        result.buildSeconds = timer.elapsedSeconds();
+        result.allocations  = counting::getNumAllocations() - before;
+
+        timer.reset();
+        compileScene(*world);
+        result.compileSeconds = timer.elapsedSeconds();
+
+        timer.reset();
+        world.reset();
+        result.teardownSeconds = timer.elapsedSeconds();
+
+        return result;
+    }
+
+    std::string toJson(std::vector<Result> const& results,
+                       std::vector<BuildResult> const& builds)
+    {
+        std::string json{"{\n  \"results\": [\n"};
+
+        for (std::size_t i{0}; i < results.size(); ++i)
+        {
+            auto const& r{results[i]};
+            json += fmt::format(
+                "    {{\"spheres\": {}, \"file_bytes\": {}, "
+                "\"load_seconds\": {:.6f}, \"compile_seconds\": {:.6f}, "
+                "\"cache_bytes\": {}, \"cache_seconds\": {:.6f}, "
+                "\"verified_cache_seconds\": {:.6f}, "
+                "\"peak_rss_bytes\": {}}}{}\n",
+                r.numSpheres,
+                r.fileSize,
+                r.loadSeconds,
+                r.compileSeconds,
+                r.cacheSize,
+                r.cacheSeconds,
+                r.verifiedSeconds,
+                r.peakRss,
+                i + 1 < results.size() ? "," : "");
+        }
+
+        json += "  ],\n  \"scene_build\": [\n";
+        for (std::size_t i{0}; i < builds.size(); ++i)
+        {
+            auto const& r{builds[i]};
+            json += fmt::format(
+                "    {{\"spheres\": {}, \"objects\": \"{}\", "
+                "\"allocations\": {}, \"build_seconds\": {:.6f}, "
+                "\"compile_seconds\": {:.6f}, "
+                "\"teardown_seconds\": {:.6f}}}{}\n",
+                r.numSpheres,
+                r.arena ? "arena" : "heap",
+                r.allocations,
+                r.buildSeconds,
+                r.compileSeconds,
+                r.teardownSeconds,
+                i + 1 < builds.size() ? "," : "");
+        }
+
+        json += "  ]\n}\n";
+        return json;
+    }
+} // namespace
+
+int main(int argc, char** argv)
+{
+    const std::string output{argc > 1 ? argv[1] : "scene_load.json"};
+    const auto directory{std::filesystem::temp_directory_path()};
+    const std::string filename{(directory / "scene_load.txt").string()};
+    const std::string cacheFile{(directory / "scene_load.cache").string()};
+
+    std::vector<Result> results;
+    fmt::print("{:>8} {:>10} {:>9} {:>8} {:>10} {:>12} {:>11} {:>10} "
+               "{:>11} {:>9}\n",
+               "spheres",
+               "size (MB)",
+               "load (s)",
+               "MB/s",
+               "Mspheres/s",
+               "compile (s)",
+               "cache (MB)",
+               "cache (ms)",
+               "verify (ms)",
+               "RSS (MB)");
+
+    for (std::size_t count : sphereCounts)
+    {
+        results.push_back(run(filename, cacheFile, count));
+
+        auto const& r{results.back()};
+        const double megabytes{r.fileSize / (1024.0 * 1024.0)};
+        fmt::print("{:>8} {:>10.1f} {:>9.3f} {:>8.1f} {:>10.2f} {:>12.3f} "
+                   "{:>11.1f} {:>10.3f} {:>11.3f} {:>9.1f}\n",
+                   r.numSpheres,
+                   megabytes,
+                   r.loadSeconds,
+                   megabytes / r.loadSeconds,
+                   r.numSpheres / r.loadSeconds * 1.0e-6,
+                   r.compileSeconds,
+                   r.cacheSize / (1024.0 * 1024.0),
+                   r.cacheSeconds * 1000.0,
+                   r.verifiedSeconds * 1000.0,
+                   r.peakRss / (1024.0 * 1024.0));
+    }
+
+    std::vector<BuildResult> builds;
+    fmt::print("\n{:>8} {:>8} {:>12} {:>10} {:>12} {:>13}\n",
+               "spheres",
+               "objects",
+               "allocations",
+               "build (s)",
+               "compile (s)",
+               "teardown (s)");
+
+    for (std::size_t count : sphereCounts)
+    {
+        builds.push_back(runBuild<false>(count));
+        builds.push_back(runBuild<true>(count));
+
+        for (auto const& r : {builds[builds.size() - 2], builds.back()})
+        {
+            fmt::print("{:>8} {:>8} {:>12} {:>10.3f} {:>12.3f} {:>13.3f}\n",
+                       r.numSpheres,
+                       r.arena ? "arena" : "heap",
+                       r.allocations,
+                       r.buildSeconds,
+                       r.compileSeconds,
+                       r.teardownSeconds);
+        }
+    }
+
+    std::ofstream file{output};
+    file << toJson(results, builds);
+    fmt::print("results written to {}\n", output);
+
+    return 0;
+}
@@ -0,0 +1,98 @@
+#include "AliasTable.hpp"
+
+#include <algorithm>
+
+namespace common
+{
+    void AliasTable::build(std::vector<float> const& weights)
+    {
+        const std::size_t n{weights.size()};
+        mBins.assign(n, Bin{1.0f, 0});
+        mPdfs.assign(n, 0.0f);
+        if (n == 0)
+        {
+            return;
+        }
+
+        double total{0.0};
+        for (float w : weights)
+        {
+            total += std::max(w, 0.0f);
+        }
+
+        // scaled so that the average bin is exactly full
+        std::vector<double> scaled(n);
+        for (std::size_t i{0}; i < n; ++i)
+        {
+            const double p{total > 0.0 ? std::max(weights[i], 0.0f) / total
+                                       : 1.0 / n};
+            mPdfs[i]  = static_cast<float>(p);
+            scaled[i] = p * n;
+        }
+
+        std::vector<std::uint32_t> small, large;
+        for (std::size_t i{0}; i < n; ++i)
+        {
+            (scaled[i] < 1.0 ? small : large)
+                .push_back(static_cast<std::uint32_t>(i));
+        }
+
+        // top up each underfull bin from an overfull entry, which then
+        // becomes underfull itself if it has given away too much
+        while (!small.empty() && !large.empty())
+        {
+            const std::uint32_t s{small.back()};
+            const std::uint32_t l{large.back()};
+            small.pop_back();
+
+            mBins[s].probability = static_cast<float>(scaled[s]);
+            mBins[s].alias       = l;
+
+            scaled[l] -= 1.0 - scaled[s];
+            if (scaled[l] < 1.0)
+            {
+                large.pop_back();
+                small.push_back(l);
+            }
+        }
+
+        // whatever is left is full up to rounding error
+        for (std::uint32_t i : small)
+        {
+            mBins[i] = Bin{1.0f, i};
+        }
+        for (std::uint32_t i : large)
+        {
+            mBins[i] = Bin{1.0f, i};
+        }
+    }
+
+    std::size_t AliasTable::size() const
+    {
+        return mBins.size();
+    }
+
+    bool AliasTable::isEmpty() const
+    {
+        return mBins.empty();
+    }
+
+    std::uint32_t AliasTable::sample(std::uint32_t u, float& pdf) const
+    {
+        const std::uint64_t scaled{static_cast<std::uint64_t>(u) *
+                                   static_cast<std::uint64_t>(mBins.size())};
+        const auto bin{static_cast<std::uint32_t>(scaled >> 32u)};
+        const float remainder{
+            static_cast<float>((scaled & 0xffffffffull) >> 8u) * 0x1.0p-24f};
+
+        Bin const& b{mBins[bin]};
+        const std::uint32_t i{remainder < b.probability ? bin : b.alias};
+        pdf = mPdfs[i];
+        return i;
+    }
+
+    float AliasTable::getPdf(std::uint32_t i) const
+    {
+        return mPdfs[i];
+    }
+} // namespace common
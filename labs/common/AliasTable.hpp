@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace common
+{
+    // Picks entries with probability proportional to a weight in constant
+    // time, whatever the number of entries (Walker's alias method, built
+    // with Vose's algorithm). Every bin holds its own entry with some
+    // probability and a second "alias" entry otherwise, so a sample is one
+    // bin lookup and one comparison.
+    class AliasTable
+    {
+    public:
+        // Negative weights count as 0. If every weight is 0 the entries are
+        // picked uniformly.
+        void build(std::vector<float> const& weights);
+
+        std::size_t size() const;
+
+        bool isEmpty() const;
+
+        // Picks an entry from a uniform 32-bit random number, e.g. from
+        // counterRandom, and writes the probability of picking it to pdf.
+        // The high bits choose the bin and the rest decide between the bin's
+        // entry and its alias.
+        std::uint32_t sample(std::uint32_t u, float& pdf) const;
+
+        float getPdf(std::uint32_t i) const;
+
+    private:
+        struct Bin
+        {
+            // probability of keeping the bin's own entry
+            float probability;
+            std::uint32_t alias;
+        };
+
+        std::vector<Bin> mBins;
+        std::vector<float> mPdfs;
+    };
+} // namespace common
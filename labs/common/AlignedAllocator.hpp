@@ -0,0 +1,55 @@
+#pragma once
+
+#include <cstddef>
+#include <new>
+#include <vector>
+
+namespace common
+{
+    // Allocator for std::vector that aligns the storage to Alignment bytes,
+    // used for arrays read with SIMD loads or shared between threads.
+    template<typename T, std::size_t Alignment = 64>
+    class AlignedAllocator
+    {
+    public:
+        using value_type = T;
+
+        template<typename U>
+        struct rebind
+        {
+            using other = AlignedAllocator<U, Alignment>;
+        };
+
+        AlignedAllocator() = default;
+
+        template<typename U>
+        AlignedAllocator(AlignedAllocator<U, Alignment> const&)
+        {}
+
+        T* allocate(std::size_t n)
+        {
+            return static_cast<T*>(::operator new(
+                n * sizeof(T), std::align_val_t{Alignment}));
+        }
+
+        void deallocate(T* p, std::size_t)
+        {
+            ::operator delete(p, std::align_val_t{Alignment});
+        }
+
+        template<typename U>
+        bool operator==(AlignedAllocator<U, Alignment> const&) const
+        {
+            return true;
+        }
+
+        template<typename U>
+        bool operator!=(AlignedAllocator<U, Alignment> const&) const
+        {
+            return false;
+        }
+    };
+
+    template<typename T, std::size_t Alignment = 64>
+    using AlignedVector = std::vector<T, AlignedAllocator<T, Alignment>>;
+} // namespace common
@@ -0,0 +1,56 @@
+#include "Arena.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <new>
+
+namespace common
+{
+    Arena::Arena(std::size_t blockSize) :
+        mBlockSize{blockSize},
+        mNext{nullptr},
+        mRemaining{0},
+        mNumAllocations{0}
+    {}
+
+    void* Arena::allocate(std::size_t size, std::size_t alignment)
+    {
+        const std::size_t padding{
+            (alignment - reinterpret_cast<std::uintptr_t>(mNext) % alignment) %
+            alignment};
+
+        if (mNext == nullptr || padding + size > mRemaining)
+        {
+            // anything bigger than a block gets a block of its own, with
+            // enough slack to align it
+            const std::size_t blockSize{
+                std::max(mBlockSize, size + alignment - 1)};
+            mBlocks.emplace_back(
+                static_cast<unsigned char*>(::operator new(blockSize)));
+            mNext      = mBlocks.back().get();
+            mRemaining = blockSize;
+            return allocate(size, alignment);
+        }
+
+        void* result{mNext + padding};
+        mNext += padding + size;
+        mRemaining -= padding + size;
+        ++mNumAllocations;
+        return result;
+    }
+
+    std::size_t Arena::getNumBlocks() const
+    {
+        return mBlocks.size();
+    }
+
+    std::size_t Arena::getNumAllocations() const
+    {
+        return mNumAllocations;
+    }
+
+    void Arena::BlockDeleter::operator()(unsigned char* block) const
+    {
+        ::operator delete(block);
+    }
+} // namespace common
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+namespace common
+{
+    // Monotonic allocator: hands out memory from large blocks one after the
+    // other and only frees it, all at once, when the arena is destroyed.
+    // Objects allocated together end up next to each other in memory, and
+    // each one costs a pointer bump instead of a trip through the heap.
+    class Arena
+    {
+    public:
+        Arena(std::size_t blockSize = 1 << 16);
+
+        Arena(Arena const&) = delete;
+        Arena& operator=(Arena const&) = delete;
+
+        void* allocate(std::size_t size, std::size_t alignment);
+
+        std::size_t getNumBlocks() const;
+
+        std::size_t getNumAllocations() const;
+
+    private:
+        struct BlockDeleter
+        {
+            void operator()(unsigned char* block) const;
+        };
+
+        std::size_t mBlockSize;
+        std::vector<std::unique_ptr<unsigned char, BlockDeleter>> mBlocks;
+        unsigned char* mNext;
+        std::size_t mRemaining;
+        std::size_t mNumAllocations;
+    };
+
+    // Allocator for std::allocate_shared (or containers) that takes its
+    // memory from an Arena. Every copy holds on to the arena, so a
+    // shared_ptr allocated from it keeps it alive as long as it needs to.
+    template<typename T>
+    class ArenaAllocator
+    {
+    public:
+        using value_type = T;
+
+        template<typename U>
+        struct rebind
+        {
+            using other = ArenaAllocator<U>;
+        };
+
+        ArenaAllocator(std::shared_ptr<Arena> arena) :
+            mArena{std::move(arena)}
+        {}
+
+        template<typename U>
+        ArenaAllocator(ArenaAllocator<U> const& other) :
+            mArena{other.getArena()}
+        {}
+
+        T* allocate(std::size_t n)
+        {
+            return static_cast<T*>(
+                mArena->allocate(n * sizeof(T), alignof(T)));
+        }
+
+        // the memory goes back when the arena does
+        void deallocate(T*, std::size_t)
+        {}
+
+        std::shared_ptr<Arena> const& getArena() const
+        {
+            return mArena;
+        }
+
+        template<typename U>
+        bool operator==(ArenaAllocator<U> const& other) const
+        {
+            return mArena == other.getArena();
+        }
+
+        template<typename U>
+        bool operator!=(ArenaAllocator<U> const& other) const
+        {
+            return mArena != other.getArena();
+        }
+
+    private:
+        std::shared_ptr<Arena> mArena;
+    };
+} // namespace common
@@ -0,0 +1,110 @@
+#pragma once
+
+#include <atlas/math/Math.hpp>
+#include <atlas/math/Ray.hpp>
+
+#include <algorithm>
+#include <limits>
+
+namespace common
+{
+    // Axis-aligned bounding box. A default constructed box is empty (lower
+    // above upper) so that expanding it by anything yields that thing.
+    struct BBox
+    {
+        atlas::math::Point lower{std::numeric_limits<float>::max()};
+        atlas::math::Point upper{std::numeric_limits<float>::lowest()};
+
+        void expand(atlas::math::Point const& p)
+        {
+            lower = {std::min(lower.x, p.x),
+                     std::min(lower.y, p.y),
+                     std::min(lower.z, p.z)};
+            upper = {std::max(upper.x, p.x),
+                     std::max(upper.y, p.y),
+                     std::max(upper.z, p.z)};
+        }
+
+        void expand(BBox const& b)
+        {
+            if (b.isEmpty())
+            {
+                return;
+            }
+
+            expand(b.lower);
+            expand(b.upper);
+        }
+
+        bool isEmpty() const
+        {
+            return lower.x > upper.x || lower.y > upper.y || lower.z > upper.z;
+        }
+
+        atlas::math::Point centroid() const
+        {
+            return 0.5f * (lower + upper);
+        }
+
+        float surfaceArea() const
+        {
+            if (isEmpty())
+            {
+                return 0.0f;
+            }
+
+            const auto d{upper - lower};
+            return 2.0f * (d.x * d.y + d.y * d.z + d.z * d.x);
+        }
+
+        int maxExtent() const
+        {
+            const auto d{upper - lower};
+            if (d.x > d.y && d.x > d.z)
+            {
+                return 0;
+            }
+
+            return (d.y > d.z) ? 1 : 2;
+        }
+
+        // Slab test against the ray segment [0, tMax]. invDir is 1 / ray.d
+        // and dirIsNeg[i] is 1 when ray.d[i] < 0, both computed once per ray.
+        // Comparisons involving a NaN (origin on a slab of an axis the ray is
+        // parallel to) are false, and every test is written so that false
+        // keeps the box: a NaN never rejects it, so such boxes are
+        // conservatively kept.
+        bool intersect(atlas::math::Ray<atlas::math::Vector> const& ray,
+                       atlas::math::Vector const& invDir,
+                       int const dirIsNeg[3],
+                       float tMax) const
+        {
+            atlas::math::Point const* bounds[2]{&lower, &upper};
+
+            float t0{(bounds[dirIsNeg[0]]->x - ray.o.x) * invDir.x};
+            float t1{(bounds[1 - dirIsNeg[0]]->x - ray.o.x) * invDir.x};
+            const float ty0{(bounds[dirIsNeg[1]]->y - ray.o.y) * invDir.y};
+            const float ty1{(bounds[1 - dirIsNeg[1]]->y - ray.o.y) * invDir.y};
+
+            if (t0 > ty1 || ty0 > t1)
+            {
+                return false;
+            }
+            t0 = (ty0 > t0) ? ty0 : t0;
+            t1 = (ty1 < t1) ? ty1 : t1;
+
+            const float tz0{(bounds[dirIsNeg[2]]->z - ray.o.z) * invDir.z};
+            const float tz1{(bounds[1 - dirIsNeg[2]]->z - ray.o.z) * invDir.z};
+
+            if (t0 > tz1 || tz0 > t1)
+            {
+                return false;
+            }
+            t0 = (tz0 > t0) ? tz0 : t0;
+            t1 = (tz1 < t1) ? tz1 : t1;
+
+            // negated so that a NaN t0 or t1 keeps the box
+            return !(t0 >= tMax) && !(t1 <= 0.0f);
+        }
+    };
+} // namespace common
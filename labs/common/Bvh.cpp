@@ -0,0 +1,322 @@
+#include "Bvh.hpp"
+#include "Timer.hpp"
+
+#include <algorithm>
+#include <array>
+
+namespace common
+{
+    namespace
+    {
+        constexpr int numBins{16};
+
+        // Leaves never hold more primitives than this, so a leaf is at most
+        // a few cache lines of indices.
+        constexpr std::size_t maxLeafSize{8};
+
+        // Past this depth splits fall back to the median, which keeps the
+        // tree depth (and the traversal stack) bounded on degenerate input.
+        constexpr std::size_t maxSahDepth{64};
+
+        // Cost of visiting a node relative to one primitive test.
+        constexpr float traversalCost{0.125f};
+
+        struct Bin
+        {
+            BBox bounds;
+            std::size_t count{0};
+        };
+
+        float groupCount(std::size_t count, std::size_t width)
+        {
+            return static_cast<float>((count + width - 1) / width);
+        }
+
+        int binIndex(float centroid, float lower, float scale)
+        {
+            const int b{static_cast<int>((centroid - lower) * scale)};
+            return std::min(std::max(b, 0), numBins - 1);
+        }
+    } // namespace
+
+    Bvh::Bvh() :
+        mLeafWidth{1},
+        mAssignedNodes{nullptr},
+        mAssignedIndices{nullptr},
+        mStats{}
+    {}
+
+    void Bvh::build(std::vector<BBox> const& bounds, std::size_t leafWidth)
+    {
+        Timer timer;
+
+        mLeafWidth = std::max<std::size_t>(leafWidth, 1);
+        mNodes.clear();
+        mIndices.clear();
+        mAssignedNodes   = nullptr;
+        mAssignedIndices = nullptr;
+        mStats           = {};
+
+        if (bounds.empty())
+        {
+            return;
+        }
+
+        std::vector<BuildEntry> entries(bounds.size());
+        for (std::size_t i{0}; i < bounds.size(); ++i)
+        {
+            entries[i] = {bounds[i],
+                          bounds[i].centroid(),
+                          static_cast<std::uint32_t>(i)};
+        }
+
+        // a binary tree with n leaves has 2n - 1 nodes
+        mNodes.reserve(2 * bounds.size() - 1);
+        mIndices.reserve(bounds.size());
+        buildNode(entries, 0, entries.size(), 1);
+
+        mNodes.shrink_to_fit();
+        mStats.numPrimitives = bounds.size();
+        mStats.numNodes      = mNodes.size();
+        mStats.buildSeconds  = timer.elapsedSeconds();
+    }
+
+    void Bvh::assign(BvhNode const* nodes,
+                     std::uint32_t const* indices,
+                     BvhStats const& stats)
+    {
+        mNodes           = {};
+        mIndices         = {};
+        mAssignedNodes   = nodes;
+        mAssignedIndices = indices;
+        mStats           = stats;
+    }
+
+    bool Bvh::isValid(BvhNode const* nodes,
+                      std::uint32_t const* indices,
+                      BvhStats const& stats)
+    {
+        // children always come after their parent, so one pass in order
+        // sees every node's depth before its children's
+        std::vector<std::size_t> depths(stats.numNodes, 1);
+        for (std::size_t i{0}; i < stats.numNodes; ++i)
+        {
+            BvhNode const& node{nodes[i]};
+            if (node.count > 0)
+            {
+                if (node.offset + std::size_t{node.count} > stats.numPrimitives)
+                {
+                    return false;
+                }
+                continue;
+            }
+
+            // the first child is the next node, the second one is after the
+            // first one's subtree
+            const std::size_t second{node.offset};
+            if (node.axis > 2 || i + 1 >= stats.numNodes || second <= i + 1 ||
+                second >= stats.numNodes || depths[i] >= stackSize)
+            {
+                return false;
+            }
+            depths[i + 1]  = std::max(depths[i + 1], depths[i] + 1);
+            depths[second] = std::max(depths[second], depths[i] + 1);
+        }
+
+        return std::all_of(
+            indices, indices + stats.numPrimitives, [&](std::uint32_t index) {
+                return index < stats.numPrimitives;
+            });
+    }
+
+    bool Bvh::isEmpty() const
+    {
+        return mStats.numNodes == 0;
+    }
+
+    BvhStats const& Bvh::getStats() const
+    {
+        return mStats;
+    }
+
+    Span<BvhNode> Bvh::getNodes() const
+    {
+        return {getNodeData(), mStats.numNodes};
+    }
+
+    Span<std::uint32_t> Bvh::getIndices() const
+    {
+        return {getIndexData(), mStats.numPrimitives};
+    }
+
+    BvhNode const* Bvh::getNodeData() const
+    {
+        return mAssignedNodes != nullptr ? mAssignedNodes : mNodes.data();
+    }
+
+    std::uint32_t const* Bvh::getIndexData() const
+    {
+        return mAssignedIndices != nullptr ? mAssignedIndices
+                                           : mIndices.data();
+    }
+
+    std::uint32_t Bvh::buildNode(std::vector<BuildEntry>& entries,
+                                 std::size_t begin,
+                                 std::size_t end,
+                                 std::size_t depth)
+    {
+        const auto nodeIndex{static_cast<std::uint32_t>(mNodes.size())};
+        mNodes.push_back({});
+        mStats.maxDepth = std::max(mStats.maxDepth, depth);
+
+        BBox bounds, centroidBounds;
+        for (std::size_t i{begin}; i < end; ++i)
+        {
+            bounds.expand(entries[i].bounds);
+            centroidBounds.expand(entries[i].centroid);
+        }
+        mNodes[nodeIndex].bounds = bounds;
+
+        int axis{0};
+        const std::size_t mid{findSplit(
+            entries, begin, end, bounds, centroidBounds, depth, axis)};
+
+        if (mid == begin || mid == end)
+        {
+            // children are appended after this node, so only touch it
+            // through its index once recursion may have grown mNodes
+            mNodes[nodeIndex].offset =
+                static_cast<std::uint32_t>(mIndices.size());
+            mNodes[nodeIndex].count = static_cast<std::uint16_t>(end - begin);
+            for (std::size_t i{begin}; i < end; ++i)
+            {
+                mIndices.push_back(entries[i].index);
+            }
+
+            ++mStats.numLeaves;
+            return nodeIndex;
+        }
+
+        buildNode(entries, begin, mid, depth + 1);
+        const std::uint32_t second{buildNode(entries, mid, end, depth + 1)};
+
+        mNodes[nodeIndex].offset = second;
+        mNodes[nodeIndex].count  = 0;
+        mNodes[nodeIndex].axis   = static_cast<std::uint16_t>(axis);
+        return nodeIndex;
+    }
+
+    // Returns the index that splits [begin, end) into the two children, or
+    // begin when the range should become a leaf.
+    std::size_t Bvh::findSplit(std::vector<BuildEntry>& entries,
+                               std::size_t begin,
+                               std::size_t end,
+                               BBox const& bounds,
+                               BBox const& centroidBounds,
+                               std::size_t depth,
+                               int& axis) const
+    {
+        const std::size_t count{end - begin};
+        if (count == 1)
+        {
+            return begin;
+        }
+
+        float bestCost{std::numeric_limits<float>::max()};
+        int bestBin{-1};
+        const float parentArea{bounds.surfaceArea()};
+
+        for (int a{0}; a < 3 && depth <= maxSahDepth; ++a)
+        {
+            const float lower{centroidBounds.lower[a]};
+            const float extent{centroidBounds.upper[a] - lower};
+            if (extent <= 0.0f)
+            {
+                continue;
+            }
+
+            const float scale{numBins / extent};
+            std::array<Bin, numBins> bins{};
+            for (std::size_t i{begin}; i < end; ++i)
+            {
+                auto& bin{bins[binIndex(entries[i].centroid[a], lower, scale)]};
+                bin.bounds.expand(entries[i].bounds);
+                ++bin.count;
+            }
+
+            // sweep from the right to get the cost of every right side, then
+            // from the left to evaluate each of the numBins - 1 planes
+            std::array<float, numBins - 1> rightCost{};
+            BBox side;
+            std::size_t sideCount{0};
+            for (int b{numBins - 1}; b > 0; --b)
+            {
+                side.expand(bins[b].bounds);
+                sideCount += bins[b].count;
+                rightCost[b - 1] =
+                    groupCount(sideCount, mLeafWidth) * side.surfaceArea();
+            }
+
+            side      = {};
+            sideCount = 0;
+            for (int b{0}; b < numBins - 1; ++b)
+            {
+                side.expand(bins[b].bounds);
+                sideCount += bins[b].count;
+
+                const float cost{
+                    traversalCost +
+                    (groupCount(sideCount, mLeafWidth) * side.surfaceArea() +
+                     rightCost[b]) /
+                        parentArea};
+                if (cost < bestCost)
+                {
+                    bestCost = cost;
+                    bestBin  = b;
+                    axis     = a;
+                }
+            }
+        }
+
+        if (bestBin >= 0)
+        {
+            if (count <= maxLeafSize &&
+                bestCost >= groupCount(count, mLeafWidth))
+            {
+                return begin;
+            }
+
+            const float lower{centroidBounds.lower[axis]};
+            const float scale{
+                numBins / (centroidBounds.upper[axis] - lower)};
+            const auto mid{std::partition(
+                entries.begin() + begin,
+                entries.begin() + end,
+                [&](BuildEntry const& e) {
+                    return binIndex(e.centroid[axis], lower, scale) <= bestBin;
+                })};
+
+            const auto split{static_cast<std::size_t>(mid - entries.begin())};
+            if (split != begin && split != end)
+            {
+                return split;
+            }
+        }
+        else if (count <= maxLeafSize)
+        {
+            return begin;
+        }
+
+        // No usable SAH split (coincident centroids or too deep): split at
+        // the median of the widest axis so the leaves stay small.
+        axis = bounds.maxExtent();
+        const std::size_t split{begin + count / 2};
+        std::nth_element(entries.begin() + begin,
+                         entries.begin() + split,
+                         entries.begin() + end,
+                         [&](BuildEntry const& l, BuildEntry const& r) {
+                             return l.centroid[axis] < r.centroid[axis];
+                         });
+        return split;
+    }
+} // namespace common
@@ -0,0 +1,317 @@
+#pragma once
+
+#include "BBox.hpp"
+#include "RayPacket.hpp"
+#include "Span.hpp"
+
+#include <atlas/math/Ray.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+namespace common
+{
+    // Nodes are stored depth first: the first child of an interior node is
+    // the node right after it, so only the second child needs an index.
+    struct BvhNode
+    {
+        BBox bounds;
+
+        // interior: index of the second child
+        // leaf: index of the first primitive in the index list
+        std::uint32_t offset;
+
+        // number of primitives, 0 for interior nodes
+        std::uint16_t count;
+
+        // split axis, used to visit the nearer child first
+        std::uint16_t axis;
+    };
+
+    struct BvhStats
+    {
+        std::size_t numPrimitives;
+        std::size_t numNodes;
+        std::size_t numLeaves;
+        std::size_t maxDepth;
+        double buildSeconds;
+    };
+
+    // Bounding volume hierarchy over an indexed list of primitives, built
+    // with binned surface area heuristic splits. The hierarchy only knows
+    // the primitive bounds; intersection is delegated back to the caller,
+    // which receives the primitive's index in the original list.
+    class Bvh
+    {
+    public:
+        Bvh();
+
+        // leafWidth is the number of primitives that can be tested for the
+        // price of one, e.g. 8 when leaves are intersected with an 8-wide
+        // SIMD kernel. The SAH then charges ceil(count / leafWidth) tests per
+        // leaf, which favours fuller leaves.
+        void build(std::vector<BBox> const& bounds, std::size_t leafWidth = 1);
+
+        // Uses a hierarchy that was built earlier and stored elsewhere, e.g.
+        // in a memory-mapped file, instead of building one. Nothing is
+        // copied, so the arrays have to outlive the Bvh or the next build.
+        // stats.numNodes and stats.numPrimitives give their sizes. The
+        // arrays are trusted, see isValid.
+        void assign(BvhNode const* nodes,
+                    std::uint32_t const* indices,
+                    BvhStats const& stats);
+
+        // Checks that arrays from outside can be traversed without going out
+        // of bounds: children come after their parents and within the
+        // nodes, leaves and indices stay within the primitives, and the tree
+        // is no deeper than the traversal stack. Linear in the size of the
+        // arrays.
+        static bool isValid(BvhNode const* nodes,
+                            std::uint32_t const* indices,
+                            BvhStats const& stats);
+
+        bool isEmpty() const;
+
+        BvhStats const& getStats() const;
+
+        // Nodes in depth-first order, stats.numNodes of them.
+        Span<BvhNode> getNodes() const;
+
+        // Primitive indices in leaf order. Leaf n covers the entries
+        // [node.offset, node.offset + node.count).
+        Span<std::uint32_t> getIndices() const;
+
+        // Visits every primitive whose node the ray reaches before tMax and
+        // returns true if any call to hitPrimitive(index) returned true.
+        // tMax is re-read at every node, so when hitPrimitive shortens it
+        // (i.e. it points at ShadeRec::t) the rest of the tree is culled
+        // against the closest hit so far.
+        template<typename HitFn>
+        bool closestHit(atlas::math::Ray<atlas::math::Vector> const& ray,
+                        float const& tMax,
+                        HitFn&& hitPrimitive) const;
+
+        // Same traversal as closestHit, but hands whole leaves to
+        // hitLeaf(first, count) as ranges of getIndices(). Used when the
+        // primitives are stored in leaf order and tested in batches.
+        template<typename LeafFn>
+        bool traverse(atlas::math::Ray<atlas::math::Vector> const& ray,
+                      float const& tMax,
+                      LeafFn&& hitLeaf) const;
+
+        // Occlusion version of traverse: returns true as soon as one call
+        // to hitLeaf(first, count) returns true, without visiting the rest
+        // of the tree. hitLeaf only has to report whether anything in the
+        // leaf is hit before tMax, not which primitive is closest.
+        template<typename LeafFn>
+        bool anyHit(atlas::math::Ray<atlas::math::Vector> const& ray,
+                    float tMax,
+                    LeafFn&& hitLeaf) const;
+
+        // Traverses the tree once for a whole packet: a node is entered when
+        // any of its rays reaches it, and hitLeaf(first, count) is expected
+        // to update the packet's tMax and hit for every ray.
+        template<typename LeafFn>
+        void traversePacket(RayPacket& packet, LeafFn&& hitLeaf) const;
+
+    private:
+        struct BuildEntry
+        {
+            BBox bounds;
+            atlas::math::Point centroid;
+            std::uint32_t index;
+        };
+
+        std::uint32_t buildNode(std::vector<BuildEntry>& entries,
+                                std::size_t begin,
+                                std::size_t end,
+                                std::size_t depth);
+
+        std::size_t findSplit(std::vector<BuildEntry>& entries,
+                              std::size_t begin,
+                              std::size_t end,
+                              BBox const& bounds,
+                              BBox const& centroidBounds,
+                              std::size_t depth,
+                              int& axis) const;
+
+        // either the built arrays or the assigned ones
+        BvhNode const* getNodeData() const;
+        std::uint32_t const* getIndexData() const;
+
+        template<bool StopAtFirstHit, typename LeafFn>
+        bool visitLeaves(atlas::math::Ray<atlas::math::Vector> const& ray,
+                         float const& tMax,
+                         LeafFn&& hitLeaf) const;
+
+        static constexpr std::size_t stackSize{128};
+
+        std::size_t mLeafWidth;
+        std::vector<BvhNode> mNodes;
+        std::vector<std::uint32_t> mIndices;
+        BvhNode const* mAssignedNodes;
+        std::uint32_t const* mAssignedIndices;
+        BvhStats mStats;
+    };
+
+    template<typename HitFn>
+    bool Bvh::closestHit(atlas::math::Ray<atlas::math::Vector> const& ray,
+                         float const& tMax,
+                         HitFn&& hitPrimitive) const
+    {
+        std::uint32_t const* indices{getIndexData()};
+        return traverse(
+            ray, tMax, [&](std::uint32_t first, std::uint32_t count) {
+                bool hit{false};
+                for (std::uint32_t i{first}; i < first + count; ++i)
+                {
+                    hit = hitPrimitive(indices[i]) || hit;
+                }
+                return hit;
+            });
+    }
+
+    template<typename LeafFn>
+    bool Bvh::traverse(atlas::math::Ray<atlas::math::Vector> const& ray,
+                       float const& tMax,
+                       LeafFn&& hitLeaf) const
+    {
+        return visitLeaves<false>(ray, tMax, std::forward<LeafFn>(hitLeaf));
+    }
+
+    template<typename LeafFn>
+    bool Bvh::anyHit(atlas::math::Ray<atlas::math::Vector> const& ray,
+                     float tMax,
+                     LeafFn&& hitLeaf) const
+    {
+        return visitLeaves<true>(ray, tMax, std::forward<LeafFn>(hitLeaf));
+    }
+
+    template<bool StopAtFirstHit, typename LeafFn>
+    bool Bvh::visitLeaves(atlas::math::Ray<atlas::math::Vector> const& ray,
+                          float const& tMax,
+                          LeafFn&& hitLeaf) const
+    {
+        if (isEmpty())
+        {
+            return false;
+        }
+
+        BvhNode const* nodes{getNodeData()};
+
+        const atlas::math::Vector invDir{
+            1.0f / ray.d.x, 1.0f / ray.d.y, 1.0f / ray.d.z};
+        const int dirIsNeg[3]{
+            invDir.x < 0.0f, invDir.y < 0.0f, invDir.z < 0.0f};
+
+        std::uint32_t stack[stackSize];
+        std::size_t top{0};
+        std::uint32_t current{0};
+        bool hit{false};
+
+        for (;;)
+        {
+            BvhNode const& node{nodes[current]};
+
+            if (node.bounds.intersect(ray, invDir, dirIsNeg, tMax))
+            {
+                if (node.count > 0)
+                {
+                    hit = hitLeaf(node.offset,
+                                  static_cast<std::uint32_t>(node.count)) ||
+                          hit;
+
+                    if constexpr (StopAtFirstHit)
+                    {
+                        if (hit)
+                        {
+                            return true;
+                        }
+                    }
+                }
+                else
+                {
+                    // descend into the child on the near side of the split
+                    // and come back to the far one later
+                    if (dirIsNeg[node.axis])
+                    {
+                        stack[top++] = current + 1;
+                        current      = node.offset;
+                    }
+                    else
+                    {
+                        stack[top++] = node.offset;
+                        current      = current + 1;
+                    }
+                    continue;
+                }
+            }
+
+            if (top == 0)
+            {
+                break;
+            }
+            current = stack[--top];
+        }
+
+        return hit;
+    }
+
+    template<typename LeafFn>
+    void Bvh::traversePacket(RayPacket& packet, LeafFn&& hitLeaf) const
+    {
+        if (isEmpty() || packet.size == 0)
+        {
+            return;
+        }
+
+        BvhNode const* nodes{getNodeData()};
+
+        packet.padLanes();
+
+        // the rays of a coherent packet mostly agree on direction signs, so
+        // the first ray decides the order in which children are visited
+        const int dirIsNeg[3]{
+            packet.dx[0] < 0.0f, packet.dy[0] < 0.0f, packet.dz[0] < 0.0f};
+
+        std::uint32_t stack[stackSize];
+        std::size_t top{0};
+        std::uint32_t current{0};
+
+        for (;;)
+        {
+            BvhNode const& node{nodes[current]};
+
+            if (intersectsPacket(node.bounds, packet))
+            {
+                if (node.count > 0)
+                {
+                    hitLeaf(node.offset,
+                            static_cast<std::uint32_t>(node.count));
+                }
+                else
+                {
+                    if (dirIsNeg[node.axis])
+                    {
+                        stack[top++] = current + 1;
+                        current      = node.offset;
+                    }
+                    else
+                    {
+                        stack[top++] = node.offset;
+                        current      = current + 1;
+                    }
+                    continue;
+                }
+            }
+
+            if (top == 0)
+            {
+                break;
+            }
+            current = stack[--top];
+        }
+    }
+} // namespace common
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <cstdint>
+
+namespace common
+{
+    // Counter-based random numbers. Every value is a hash of its key
+    // (seed, pixel, sample, dimension) and nothing is carried over from one
+    // call to the next, so the number drawn for a sample depends only on
+    // which sample it is: not on the thread, the tile or the order in which
+    // samples are taken. Renders that draw all their randomness this way
+    // come out bit-identical however the work is split up.
+    //
+    // The key is folded in one 64-bit word at a time through the SplitMix64
+    // finaliser (Steele et al., "Fast Splittable Pseudorandom Number
+    // Generators", 2014), which is a bijection with full avalanche, so keys
+    // that differ in a single bit give unrelated outputs.
+    namespace counter
+    {
+        constexpr std::uint64_t mix(std::uint64_t x)
+        {
+            x ^= x >> 30u;
+            x *= 0xbf58476d1ce4e5b9ull;
+            x ^= x >> 27u;
+            x *= 0x94d049bb133111ebull;
+            x ^= x >> 31u;
+            return x;
+        }
+    } // namespace counter
+
+    // Uniform 32-bit integer. pixel and sample name the usual use, but any
+    // pair of counters works (e.g. a sample set and a position within it).
+    constexpr std::uint32_t counterRandom(std::uint64_t seed,
+                                          std::uint64_t pixel,
+                                          std::uint32_t sample,
+                                          std::uint32_t dimension)
+    {
+        std::uint64_t h{counter::mix(seed + 0x9e3779b97f4a7c15ull)};
+        h = counter::mix(h ^ pixel);
+        h = counter::mix(
+            h ^ ((static_cast<std::uint64_t>(sample) << 32u) | dimension));
+        return static_cast<std::uint32_t>(h >> 32u);
+    }
+
+    // Uniform integer in [0, bound), reduced the same way as
+    // Pcg32::nextBounded.
+    constexpr std::uint32_t counterRandomBounded(std::uint64_t seed,
+                                                 std::uint64_t pixel,
+                                                 std::uint32_t sample,
+                                                 std::uint32_t dimension,
+                                                 std::uint32_t bound)
+    {
+        return static_cast<std::uint32_t>(
+            (static_cast<std::uint64_t>(
+                 counterRandom(seed, pixel, sample, dimension)) *
+             bound) >>
+            32u);
+    }
+
+    // Uniform float in [0, 1).
+    constexpr float counterRandomFloat(std::uint64_t seed,
+                                       std::uint64_t pixel,
+                                       std::uint32_t sample,
+                                       std::uint32_t dimension)
+    {
+        return static_cast<float>(
+                   counterRandom(seed, pixel, sample, dimension) >> 8u) *
+               0x1.0p-24f;
+    }
+} // namespace common
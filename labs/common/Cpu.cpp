@@ -0,0 +1,61 @@
+#include "Cpu.hpp"
+
+#if COMMON_X86 && defined(_MSC_VER)
+#    include <immintrin.h>
+#    include <intrin.h>
+#endif
+
+namespace common
+{
+    namespace
+    {
+        SimdLevel detectSimdLevel()
+        {
+#if COMMON_X86 && defined(_MSC_VER)
+            int info[4];
+            __cpuid(info, 0);
+            if (info[0] < 7)
+            {
+                return SimdLevel::Sse2;
+            }
+
+            __cpuid(info, 1);
+            const bool osxsave{(info[2] & (1 << 27)) != 0};
+            const bool avx{(info[2] & (1 << 28)) != 0};
+            if (!osxsave || !avx || (_xgetbv(0) & 0x6) != 0x6)
+            {
+                return SimdLevel::Sse2;
+            }
+
+            __cpuidex(info, 7, 0);
+            return (info[1] & (1 << 5)) ? SimdLevel::Avx2 : SimdLevel::Sse2;
+#elif COMMON_X86
+            // also checks that the OS saves the ymm registers
+            __builtin_cpu_init();
+            return __builtin_cpu_supports("avx2") ? SimdLevel::Avx2
+                                                  : SimdLevel::Sse2;
+#else
+            return SimdLevel::Scalar;
+#endif
+        }
+    } // namespace
+
+    SimdLevel getSimdLevel()
+    {
+        static const SimdLevel level{detectSimdLevel()};
+        return level;
+    }
+
+    char const* getSimdName(SimdLevel level)
+    {
+        switch (level)
+        {
+        case SimdLevel::Avx2:
+            return "avx2";
+        case SimdLevel::Sse2:
+            return "sse2";
+        default:
+            return "scalar";
+        }
+    }
+} // namespace common
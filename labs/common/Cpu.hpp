@@ -0,0 +1,32 @@
+#pragma once
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || \
+    defined(_M_IX86)
+#    define COMMON_X86 1
+#else
+#    define COMMON_X86 0
+#endif
+
+// GCC and Clang only emit AVX2 instructions in functions that ask for them,
+// MSVC emits any intrinsic it is given.
+#if COMMON_X86 && (defined(__GNUC__) || defined(__clang__))
+#    define COMMON_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#    define COMMON_TARGET_AVX2
+#endif
+
+namespace common
+{
+    enum class SimdLevel
+    {
+        Scalar,
+        Sse2,
+        Avx2
+    };
+
+    // Widest instruction set that both the CPU and the OS support. Checked
+    // once, the result is cached.
+    SimdLevel getSimdLevel();
+
+    char const* getSimdName(SimdLevel level);
+} // namespace common
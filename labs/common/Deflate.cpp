@@ -0,0 +1,643 @@
+#include "Deflate.hpp"
+
+#include <algorithm>
+#include <array>
+#include <functional>
+#include <queue>
+#include <utility>
+
+namespace common
+{
+    namespace
+    {
+        constexpr std::size_t windowSize{32768};
+        constexpr std::size_t minMatch{3};
+        constexpr std::size_t maxMatch{258};
+
+        // how many earlier positions are tried for each match; more finds
+        // longer matches, more slowly
+        constexpr int maxChain{32};
+
+        constexpr int hashBits{15};
+
+        // the codes are rebuilt for every block of this many symbols
+        constexpr std::size_t maxBlockTokens{1 << 15};
+
+        // literals, the end of block and the lengths share one alphabet
+        constexpr std::size_t numLitLen{286};
+        constexpr std::size_t numDist{30};
+        constexpr std::size_t numCodeLen{19};
+        constexpr std::uint16_t endOfBlock{256};
+
+        constexpr int maxCodeBits{15};
+        constexpr int maxCodeLenBits{7};
+
+        constexpr std::uint16_t lengthBase[29]{
+            3,  4,  5,  6,  7,  8,  9,  10, 11,  13,  15,  17,  19,  23, 27,
+            31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+        constexpr std::uint8_t lengthExtra[29]{0, 0, 0, 0, 0, 0, 0, 0, 1, 1,
+                                               1, 1, 2, 2, 2, 2, 3, 3, 3, 3,
+                                               4, 4, 4, 4, 5, 5, 5, 5, 0};
+
+        constexpr std::uint16_t distBase[30]{
+            1,    2,    3,    4,    5,    7,     9,     13,    17,  25,
+            33,   49,   65,   97,   129,  193,   257,   385,   513, 769,
+            1025, 1537, 2049, 3073, 4097, 6145,  8193,  12289, 16385, 24577};
+        constexpr std::uint8_t distExtra[30]{0, 0, 0,  0,  1,  1,  2,  2,
+                                             3, 3, 4,  4,  5,  5,  6,  6,
+                                             7, 7, 8,  8,  9,  9,  10, 10,
+                                             11, 11, 12, 12, 13, 13};
+
+        // the order the code length code's lengths are written in
+        constexpr std::uint8_t codeLenOrder[numCodeLen]{
+            16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15};
+
+        // extra bits of the code length repeat symbols 16, 17 and 18
+        constexpr int repeatExtra[3]{2, 3, 7};
+
+        // a literal byte if distance is 0, a match otherwise
+        struct Token
+        {
+            std::uint16_t value;
+            std::uint16_t distance;
+        };
+
+        // one symbol of the run-length coded code lengths
+        struct CodeLen
+        {
+            std::uint8_t symbol;
+            std::uint8_t extra;
+        };
+
+        using Lengths = std::vector<std::uint8_t>;
+        using Codes   = std::vector<std::uint16_t>;
+
+        class BitWriter
+        {
+        public:
+            explicit BitWriter(std::vector<std::uint8_t>& out) :
+                mOut{out},
+                mBits{0},
+                mNumBits{0}
+            {}
+
+            // least significant bit first, the way deflate packs
+            // everything (Huffman codes are stored reversed to match)
+            void put(std::uint32_t value, int numBits)
+            {
+                mBits |= static_cast<std::uint64_t>(value) << mNumBits;
+                mNumBits += numBits;
+                while (mNumBits >= 8)
+                {
+                    mOut.push_back(static_cast<std::uint8_t>(mBits));
+                    mBits >>= 8;
+                    mNumBits -= 8;
+                }
+            }
+
+            void align()
+            {
+                if (mNumBits > 0)
+                {
+                    put(0, 8 - mNumBits);
+                }
+            }
+
+            // must be aligned
+            void putBytes(std::uint8_t const* data, std::size_t size)
+            {
+                mOut.insert(mOut.end(), data, data + size);
+            }
+
+        private:
+            std::vector<std::uint8_t>& mOut;
+            std::uint64_t mBits;
+            int mNumBits;
+        };
+
+        std::uint32_t hash(std::uint8_t const* p)
+        {
+            const std::uint32_t bytes{(std::uint32_t{p[0]} << 16u) |
+                                      (std::uint32_t{p[1]} << 8u) | p[2]};
+            return (bytes * 2654435761u) >> (32 - hashBits);
+        }
+
+        // index into lengthBase of the code for a match length
+        std::size_t getLengthCode(std::size_t length)
+        {
+            static const std::array<std::uint8_t, maxMatch + 1> codes{[]() {
+                std::array<std::uint8_t, maxMatch + 1> c{};
+                for (std::size_t code{0}; code < 29; ++code)
+                {
+                    for (std::size_t l{lengthBase[code]}; l <= maxMatch; ++l)
+                    {
+                        c[l] = static_cast<std::uint8_t>(code);
+                    }
+                }
+                return c;
+            }()};
+            return codes[length];
+        }
+
+        // index into distBase of the code for a distance; the first 256
+        // entries are for distances up to 256, the rest for the longer ones
+        // in steps of 128, which is as fine as the codes get past there
+        std::size_t getDistCode(std::size_t distance)
+        {
+            static const std::array<std::uint8_t, 512> codes{[]() {
+                std::array<std::uint8_t, 512> c{};
+                for (std::size_t code{0}; code < numDist; ++code)
+                {
+                    for (std::size_t d{distBase[code]}; d <= windowSize; ++d)
+                    {
+                        c[d <= 256 ? d - 1 : 256 + ((d - 1) >> 7u)] =
+                            static_cast<std::uint8_t>(code);
+                    }
+                }
+                return c;
+            }()};
+            return codes[distance <= 256 ? distance - 1
+                                         : 256 + ((distance - 1) >> 7u)];
+        }
+
+        // Huffman code lengths for the symbols with the given frequencies,
+        // none longer than maxBits.
+        Lengths makeLengths(std::vector<std::uint64_t> freqs, int maxBits)
+        {
+            // a code needs two symbols to be complete, so borrow unused ones
+            std::size_t numUsed{0};
+            for (auto f : freqs)
+            {
+                numUsed += (f > 0);
+            }
+            for (std::size_t i{0}; numUsed < 2 && i < freqs.size(); ++i)
+            {
+                if (freqs[i] == 0)
+                {
+                    freqs[i] = 1;
+                    ++numUsed;
+                }
+            }
+
+            using Entry = std::pair<std::uint64_t, std::size_t>;
+            Lengths lengths(freqs.size());
+            for (;;)
+            {
+                // leaves first, then the internal nodes in the order they
+                // are made, so every node comes after its children
+                std::vector<std::size_t> symbols;
+                std::vector<std::pair<std::size_t, std::size_t>> children;
+                std::priority_queue<Entry,
+                                    std::vector<Entry>,
+                                    std::greater<Entry>>
+                    queue;
+                for (std::size_t i{0}; i < freqs.size(); ++i)
+                {
+                    if (freqs[i] > 0)
+                    {
+                        queue.push({freqs[i], symbols.size()});
+                        symbols.push_back(i);
+                        children.push_back({0, 0});
+                    }
+                }
+
+                while (queue.size() > 1)
+                {
+                    const Entry a{queue.top()};
+                    queue.pop();
+                    const Entry b{queue.top()};
+                    queue.pop();
+                    queue.push({a.first + b.first, children.size()});
+                    children.push_back({a.second, b.second});
+                }
+
+                std::vector<int> depths(children.size(), 0);
+                for (std::size_t i{children.size()}; i-- > symbols.size();)
+                {
+                    depths[children[i].first]  = depths[i] + 1;
+                    depths[children[i].second] = depths[i] + 1;
+                }
+
+                int longest{0};
+                for (std::size_t i{0}; i < symbols.size(); ++i)
+                {
+                    lengths[symbols[i]] = static_cast<std::uint8_t>(depths[i]);
+                    longest             = std::max(longest, depths[i]);
+                }
+
+                if (longest <= maxBits)
+                {
+                    return lengths;
+                }
+
+                // flatten the frequencies until the tree is shallow enough
+                for (auto& f : freqs)
+                {
+                    f = (f > 0) ? (f >> 1u) | 1u : 0;
+                }
+            }
+        }
+
+        // canonical codes for the lengths, bit reversed for BitWriter
+        Codes makeCodes(Lengths const& lengths)
+        {
+            std::array<std::uint16_t, maxCodeBits + 1> counts{};
+            for (auto length : lengths)
+            {
+                ++counts[length];
+            }
+            counts[0] = 0;
+
+            std::array<std::uint16_t, maxCodeBits + 1> next{};
+            std::uint16_t code{0};
+            for (int bits{1}; bits <= maxCodeBits; ++bits)
+            {
+                code       = static_cast<std::uint16_t>(
+                    (code + counts[bits - 1]) << 1u);
+                next[bits] = code;
+            }
+
+            Codes codes(lengths.size(), 0);
+            for (std::size_t i{0}; i < lengths.size(); ++i)
+            {
+                const int length{lengths[i]};
+                if (length == 0)
+                {
+                    continue;
+                }
+
+                std::uint16_t c{next[length]++};
+                std::uint16_t reversed{0};
+                for (int bit{0}; bit < length; ++bit, c >>= 1u)
+                {
+                    reversed = static_cast<std::uint16_t>((reversed << 1u) |
+                                                          (c & 1u));
+                }
+                codes[i] = reversed;
+            }
+
+            return codes;
+        }
+
+        Lengths const& getFixedLitLengths()
+        {
+            static const Lengths lengths{[]() {
+                Lengths l(288, 8);
+                std::fill(l.begin() + 144, l.begin() + 256, 9);
+                std::fill(l.begin() + 256, l.begin() + 280, 7);
+                return l;
+            }()};
+            return lengths;
+        }
+
+        Lengths const& getFixedDistLengths()
+        {
+            static const Lengths lengths(numDist, 5);
+            return lengths;
+        }
+
+        // Run-length codes a list of code lengths: 16 repeats the previous
+        // length 3-6 times, 17 and 18 write 3-10 and 11-138 zeros.
+        std::vector<CodeLen> runLengths(Lengths const& lengths)
+        {
+            std::vector<CodeLen> out;
+            for (std::size_t i{0}; i < lengths.size();)
+            {
+                const std::uint8_t length{lengths[i]};
+                std::size_t run{1};
+                while (i + run < lengths.size() && lengths[i + run] == length)
+                {
+                    ++run;
+                }
+                i += run;
+
+                if (length == 0)
+                {
+                    for (; run >= 11; run -= std::min<std::size_t>(run, 138))
+                    {
+                        out.push_back(
+                            {18,
+                             static_cast<std::uint8_t>(
+                                 std::min<std::size_t>(run, 138) - 11)});
+                    }
+                    if (run >= 3)
+                    {
+                        out.push_back({17, static_cast<std::uint8_t>(run - 3)});
+                        run = 0;
+                    }
+                }
+                else
+                {
+                    out.push_back({length, 0});
+                    for (--run; run >= 3; run -= std::min<std::size_t>(run, 6))
+                    {
+                        out.push_back(
+                            {16,
+                             static_cast<std::uint8_t>(
+                                 std::min<std::size_t>(run, 6) - 3)});
+                    }
+                }
+
+                for (; run > 0; --run)
+                {
+                    out.push_back({length, 0});
+                }
+            }
+
+            return out;
+        }
+
+        struct Frequencies
+        {
+            std::vector<std::uint64_t> litLen;
+            std::vector<std::uint64_t> dist;
+        };
+
+        // bits taken by the tokens with the given code lengths
+        std::uint64_t getDataBits(Frequencies const& freqs,
+                                  Lengths const& litLengths,
+                                  Lengths const& distLengths)
+        {
+            std::uint64_t bits{0};
+            for (std::size_t i{0}; i < numLitLen; ++i)
+            {
+                bits += freqs.litLen[i] * litLengths[i];
+                if (i > endOfBlock)
+                {
+                    bits += freqs.litLen[i] * lengthExtra[i - endOfBlock - 1];
+                }
+            }
+            for (std::size_t i{0}; i < numDist; ++i)
+            {
+                bits += freqs.dist[i] * (distLengths[i] + distExtra[i]);
+            }
+
+            return bits;
+        }
+
+        void writeTokens(BitWriter& bits,
+                         std::vector<Token> const& tokens,
+                         Lengths const& litLengths,
+                         Lengths const& distLengths)
+        {
+            const Codes litCodes{makeCodes(litLengths)};
+            const Codes distCodes{makeCodes(distLengths)};
+
+            for (auto const& token : tokens)
+            {
+                if (token.distance == 0)
+                {
+                    bits.put(litCodes[token.value], litLengths[token.value]);
+                    continue;
+                }
+
+                const std::size_t l{getLengthCode(token.value)};
+                const std::size_t symbol{endOfBlock + 1 + l};
+                bits.put(litCodes[symbol], litLengths[symbol]);
+                bits.put(token.value - lengthBase[l], lengthExtra[l]);
+
+                const std::size_t d{getDistCode(token.distance)};
+                bits.put(distCodes[d], distLengths[d]);
+                bits.put(token.distance - distBase[d], distExtra[d]);
+            }
+
+            bits.put(litCodes[endOfBlock], litLengths[endOfBlock]);
+        }
+
+        void writeStored(BitWriter& bits,
+                         std::uint8_t const* data,
+                         std::size_t size)
+        {
+            do
+            {
+                const auto length{static_cast<std::uint32_t>(
+                    std::min<std::size_t>(size, 65535))};
+                bits.put(0, 3);
+                bits.align();
+                bits.put(length, 16);
+                bits.put(~length & 0xffffu, 16);
+                bits.putBytes(data, length);
+                data += length;
+                size -= length;
+            } while (size > 0);
+        }
+
+        // Writes the tokens, which encode size bytes of data, as one block
+        // or as stored blocks, whichever is smallest.
+        void writeBlock(BitWriter& bits,
+                        std::vector<Token> const& tokens,
+                        std::uint8_t const* data,
+                        std::size_t size)
+        {
+            Frequencies freqs{std::vector<std::uint64_t>(numLitLen, 0),
+                              std::vector<std::uint64_t>(numDist, 0)};
+            for (auto const& token : tokens)
+            {
+                if (token.distance == 0)
+                {
+                    ++freqs.litLen[token.value];
+                }
+                else
+                {
+                    ++freqs.litLen[endOfBlock + 1 +
+                                   getLengthCode(token.value)];
+                    ++freqs.dist[getDistCode(token.distance)];
+                }
+            }
+            freqs.litLen[endOfBlock] = 1;
+
+            Lengths litLengths{makeLengths(freqs.litLen, maxCodeBits)};
+            Lengths distLengths{makeLengths(freqs.dist, maxCodeBits)};
+
+            std::size_t numLit{numLitLen};
+            while (numLit > 257 && litLengths[numLit - 1] == 0)
+            {
+                --numLit;
+            }
+            std::size_t numDistUsed{numDist};
+            while (numDistUsed > 1 && distLengths[numDistUsed - 1] == 0)
+            {
+                --numDistUsed;
+            }
+
+            // both sets of lengths go out as one run-length coded list
+            Lengths allLengths{litLengths.begin(),
+                               litLengths.begin() + numLit};
+            allLengths.insert(allLengths.end(),
+                              distLengths.begin(),
+                              distLengths.begin() + numDistUsed);
+            const std::vector<CodeLen> codeLens{runLengths(allLengths)};
+
+            std::vector<std::uint64_t> codeLenFreqs(numCodeLen, 0);
+            for (auto const& c : codeLens)
+            {
+                ++codeLenFreqs[c.symbol];
+            }
+            const Lengths codeLenLengths{
+                makeLengths(codeLenFreqs, maxCodeLenBits)};
+
+            std::size_t numCodeLenUsed{numCodeLen};
+            while (numCodeLenUsed > 4 &&
+                   codeLenLengths[codeLenOrder[numCodeLenUsed - 1]] == 0)
+            {
+                --numCodeLenUsed;
+            }
+
+            std::uint64_t dynamicBits{3 + 5 + 5 + 4 + 3 * numCodeLenUsed};
+            for (auto const& c : codeLens)
+            {
+                dynamicBits += codeLenLengths[c.symbol];
+                if (c.symbol >= 16)
+                {
+                    dynamicBits += repeatExtra[c.symbol - 16];
+                }
+            }
+            dynamicBits += getDataBits(freqs, litLengths, distLengths);
+
+            const std::uint64_t fixedBits{
+                3 + getDataBits(
+                        freqs, getFixedLitLengths(), getFixedDistLengths())};
+
+            // header, up to 7 bits of padding and the lengths per block
+            const std::uint64_t storedBits{
+                ((size + 65534) / 65535) * (3 + 7 + 32) + 8 * size};
+
+            if (storedBits <= std::min(dynamicBits, fixedBits))
+            {
+                writeStored(bits, data, size);
+            }
+            else if (fixedBits <= dynamicBits)
+            {
+                bits.put(1 << 1u, 3); // not final, type 1
+                writeTokens(
+                    bits, tokens, getFixedLitLengths(), getFixedDistLengths());
+            }
+            else
+            {
+                bits.put(2 << 1u, 3); // not final, type 2
+                bits.put(static_cast<std::uint32_t>(numLit - 257), 5);
+                bits.put(static_cast<std::uint32_t>(numDistUsed - 1), 5);
+                bits.put(static_cast<std::uint32_t>(numCodeLenUsed - 4), 4);
+                for (std::size_t i{0}; i < numCodeLenUsed; ++i)
+                {
+                    bits.put(codeLenLengths[codeLenOrder[i]], 3);
+                }
+
+                const Codes codeLenCodes{makeCodes(codeLenLengths)};
+                for (auto const& c : codeLens)
+                {
+                    bits.put(codeLenCodes[c.symbol], codeLenLengths[c.symbol]);
+                    if (c.symbol >= 16)
+                    {
+                        bits.put(c.extra, repeatExtra[c.symbol - 16]);
+                    }
+                }
+
+                writeTokens(bits, tokens, litLengths, distLengths);
+            }
+        }
+    } // namespace
+
+    void deflate(std::uint8_t const* data,
+                 std::size_t size,
+                 std::vector<std::uint8_t>& out)
+    {
+        BitWriter bits{out};
+
+        // the most recent position with each hash, and for every position
+        // in the window the one before it with the same hash; a slot is
+        // only reused once its position has fallen out of the window
+        std::vector<std::int32_t> head(std::size_t{1} << hashBits, -1);
+        std::vector<std::int32_t> previous(windowSize);
+        auto insert{[&](std::size_t pos) {
+            if (pos + minMatch <= size)
+            {
+                const std::uint32_t h{hash(data + pos)};
+                previous[pos & (windowSize - 1)] = head[h];
+                head[h]       = static_cast<std::int32_t>(pos);
+            }
+        }};
+
+        std::vector<Token> tokens;
+        tokens.reserve(std::min(size, maxBlockTokens));
+        std::size_t blockStart{0};
+
+        for (std::size_t pos{0}; pos < size;)
+        {
+            std::size_t bestLength{0};
+            std::size_t bestDistance{0};
+            if (pos + minMatch <= size)
+            {
+                const std::size_t limit{std::min(maxMatch, size - pos)};
+                std::int32_t candidate{head[hash(data + pos)]};
+                for (int chain{0}; candidate >= 0 && chain < maxChain;
+                     ++chain,
+                         candidate = previous[static_cast<std::size_t>(
+                                                  candidate) &
+                                              (windowSize - 1)])
+                {
+                    const std::size_t distance{pos - candidate};
+                    if (distance > windowSize)
+                    {
+                        break;
+                    }
+
+                    // a match can only be longer if it gets past the end of
+                    // the best one so far
+                    std::uint8_t const* match{data + candidate};
+                    if (match[bestLength] != data[pos + bestLength])
+                    {
+                        continue;
+                    }
+
+                    std::size_t length{0};
+                    while (length < limit &&
+                           match[length] == data[pos + length])
+                    {
+                        ++length;
+                    }
+
+                    if (length > bestLength)
+                    {
+                        bestLength   = length;
+                        bestDistance = distance;
+                        if (length == limit)
+                        {
+                            break;
+                        }
+                    }
+                }
+            }
+
+            if (bestLength >= minMatch)
+            {
+                tokens.push_back({static_cast<std::uint16_t>(bestLength),
+                                  static_cast<std::uint16_t>(bestDistance)});
+                for (std::size_t i{0}; i < bestLength; ++i)
+                {
+                    insert(pos + i);
+                }
+                pos += bestLength;
+            }
+            else
+            {
+                tokens.push_back({data[pos], 0});
+                insert(pos);
+                ++pos;
+            }
+
+            if (tokens.size() == maxBlockTokens || pos == size)
+            {
+                writeBlock(bits, tokens, data + blockStart, pos - blockStart);
+                tokens.clear();
+                blockStart = pos;
+            }
+        }
+
+        // an empty stored block leaves the output byte aligned
+        bits.put(0, 3);
+        bits.align();
+        bits.put(0, 16);
+        bits.put(0xffff, 16);
+    }
+} // namespace common
@@ -0,0 +1,22 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace common
+{
+    // Compresses size bytes of data and appends them to out as deflate
+    // blocks (RFC 1951). Matches are found with hash chains over a 32K
+    // window, and each block is written with whichever of dynamic Huffman
+    // codes, the fixed codes or no compression comes out smallest.
+    //
+    // None of the blocks is marked final, and the output ends with an empty
+    // stored block so that it is byte aligned. The output of separate calls
+    // can then be joined into one stream, which is how large images are
+    // compressed a strip at a time on several threads; the stream must be
+    // finished with a final block (an empty stored one will do).
+    void deflate(std::uint8_t const* data,
+                 std::size_t size,
+                 std::vector<std::uint8_t>& out);
+} // namespace common
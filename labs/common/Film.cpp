@@ -0,0 +1,130 @@
+#include "Film.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace common
+{
+    void Film::reset(std::size_t numPixels, std::size_t first)
+    {
+        firstPixel = first;
+        sums.assign(numPixels, atlas::math::Vector{0, 0, 0});
+        sumSquares.assign(numPixels, 0.0f);
+        counts.assign(numPixels, 0);
+        active.assign(numPixels, 1);
+    }
+
+    void Film::resolve(std::vector<atlas::math::Vector>& image) const
+    {
+        image.resize(sums.size());
+
+        for (std::size_t i{0}; i < sums.size(); ++i)
+        {
+            const float avg{counts[i] == 0 ? 0.0f : 1.0f / counts[i]};
+            image[i] = {sums[i].r * avg, sums[i].g * avg, sums[i].b * avg};
+        }
+    }
+
+    void Film::resolveCounts(std::vector<atlas::math::Vector>& image) const
+    {
+        image.resize(counts.size());
+
+        const std::uint32_t maxCount{
+            counts.empty() ? 0
+                           : *std::max_element(counts.begin(), counts.end())};
+        const float scale{maxCount == 0 ? 0.0f : 1.0f / maxCount};
+
+        for (std::size_t i{0}; i < counts.size(); ++i)
+        {
+            image[i] = atlas::math::Vector{counts[i] * scale};
+        }
+    }
+
+    float Film::getStandardError(std::size_t pixel) const
+    {
+        const std::uint32_t n{counts[pixel]};
+        if (n < 2)
+        {
+            return std::numeric_limits<float>::infinity();
+        }
+
+        const float mean{luminance(sums[pixel]) / n};
+        const float variance{std::max(
+            (sumSquares[pixel] - n * mean * mean) / (n - 1), 0.0f)};
+        return std::sqrt(variance / n);
+    }
+
+    std::size_t Film::retire(float threshold)
+    {
+        std::size_t numActive{0};
+        for (std::size_t i{0}; i < active.size(); ++i)
+        {
+            if (active[i] && getStandardError(i) <= threshold)
+            {
+                active[i] = 0;
+            }
+            numActive += active[i];
+        }
+
+        return numActive;
+    }
+
+    std::uint64_t Film::getNumSamples() const
+    {
+        std::uint64_t numSamples{0};
+        for (auto count : counts)
+        {
+            numSamples += count;
+        }
+
+        return numSamples;
+    }
+
+    AdaptiveStats
+    renderAdaptive(Film& film,
+                   std::size_t numPixels,
+                   AdaptiveSettings const& settings,
+                   std::function<void(std::uint32_t)> const& renderPass)
+    {
+        film.reset(numPixels);
+
+        AdaptiveStats stats{0, 0, numPixels};
+        while (stats.numActive > 0)
+        {
+            renderPass(stats.numPasses);
+            ++stats.numPasses;
+            stats.numSamples = film.getNumSamples();
+
+            if (stats.numPasses >= settings.minPasses)
+            {
+                stats.numActive = film.retire(settings.threshold);
+            }
+
+            if ((settings.maxPasses > 0 &&
+                 stats.numPasses >= settings.maxPasses) ||
+                (settings.sampleBudget > 0 &&
+                 stats.numSamples >= settings.sampleBudget))
+            {
+                break;
+            }
+        }
+
+        return stats;
+    }
+
+    float getRmsError(std::vector<atlas::math::Vector> const& image,
+                      std::vector<atlas::math::Vector> const& reference)
+    {
+        double sum{0.0};
+        for (std::size_t i{0}; i < image.size(); ++i)
+        {
+            const atlas::math::Vector d{image[i] - reference[i]};
+            sum += glm::dot(d, d);
+        }
+
+        return image.empty()
+                   ? 0.0f
+                   : static_cast<float>(std::sqrt(sum / (3.0 * image.size())));
+    }
+} // namespace common
@@ -0,0 +1,116 @@
+#pragma once
+
+#include <atlas/math/Math.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+namespace common
+{
+    // Rec. 709 luma, used to estimate per-pixel noise.
+    inline float luminance(atlas::math::Vector const& colour)
+    {
+        return 0.2126f * colour.r + 0.7152f * colour.g + 0.0722f * colour.b;
+    }
+
+    // Per-pixel running sums of the samples traced so far. The sums are
+    // kept in float so that any number of passes can add to them, and the
+    // image is resolved from them whenever it is needed.
+    //
+    // A film can also hold just a band of an image, starting at firstPixel.
+    // add and isActive take pixel indices into the whole image; the vectors
+    // and everything else are indexed from the start of the band.
+    struct Film
+    {
+        std::vector<atlas::math::Vector> sums;
+
+        // sum of the squared luminance of every sample, for the variance
+        std::vector<float> sumSquares;
+
+        std::vector<std::uint32_t> counts;
+
+        // Pixels that still take samples. Renderers skip the others, which
+        // is how adaptive sampling stops spending time on them.
+        std::vector<std::uint8_t> active;
+
+        std::size_t firstPixel{0};
+
+        // clears every pixel and marks them all active
+        void reset(std::size_t numPixels, std::size_t first = 0);
+
+        // true if the film holds image pixels [first, last)
+        bool covers(std::size_t first, std::size_t last) const
+        {
+            return first >= firstPixel && last <= firstPixel + sums.size();
+        }
+
+        bool isActive(std::size_t pixel) const
+        {
+            return active[pixel - firstPixel] != 0;
+        }
+
+        void add(std::size_t pixel,
+                 atlas::math::Vector const& sum,
+                 float sumSquare,
+                 std::uint32_t count)
+        {
+            pixel -= firstPixel;
+            sums[pixel] += sum;
+            sumSquares[pixel] += sumSquare;
+            counts[pixel] += count;
+        }
+
+        // averages every pixel into image, pixels without samples are black
+        void resolve(std::vector<atlas::math::Vector>& image) const;
+
+        // grey image of the sample counts, scaled so the largest is white
+        void resolveCounts(std::vector<atlas::math::Vector>& image) const;
+
+        // Standard error of the pixel's mean luminance, or infinity if the
+        // pixel has fewer than 2 samples.
+        float getStandardError(std::size_t pixel) const;
+
+        // Marks the active pixels whose standard error is at most threshold
+        // as inactive. Returns the number that remain active.
+        std::size_t retire(float threshold);
+
+        std::uint64_t getNumSamples() const;
+    };
+
+    struct AdaptiveSettings
+    {
+        // Every pixel gets at least minPasses passes before its error is
+        // looked at, so that a few lucky samples can't retire it.
+        std::uint32_t minPasses;
+
+        // Sampling stops once every pixel is under threshold (standard error
+        // of the mean luminance, in [0, 1] colour units), after maxPasses
+        // passes, or once the film holds sampleBudget samples, whichever
+        // comes first. 0 disables the pass or sample limit.
+        float threshold;
+        std::uint32_t maxPasses;
+        std::uint64_t sampleBudget;
+    };
+
+    struct AdaptiveStats
+    {
+        std::uint32_t numPasses;
+        std::uint64_t numSamples;
+        std::size_t numActive;
+    };
+
+    // Resets film and calls renderPass(pass) until a stopping condition in
+    // settings is met, retiring converged pixels after every pass. The
+    // renderer must add samples only to the pixels marked active.
+    AdaptiveStats
+    renderAdaptive(Film& film,
+                   std::size_t numPixels,
+                   AdaptiveSettings const& settings,
+                   std::function<void(std::uint32_t)> const& renderPass);
+
+    // root mean square difference over all channels, images must match
+    float getRmsError(std::vector<atlas::math::Vector> const& image,
+                      std::vector<atlas::math::Vector> const& reference);
+} // namespace common
@@ -0,0 +1,401 @@
+#include "Image.hpp"
+
+#include "ImageSink.hpp"
+#include "Profile.hpp"
+#include "ThreadPool.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+#if COMMON_X86
+#    include <immintrin.h>
+#endif
+
+namespace common
+{
+    namespace
+    {
+        // the kernels read an image as one flat array of floats
+        static_assert(sizeof(atlas::math::Vector) == 3 * sizeof(float));
+
+        // Dither offsets repeat every 8 pixels, which is 24 floats. A row of
+        // them is stored for 96 floats so that the 16 and 32 float steps of
+        // the kernels always start at the same place in it.
+        constexpr std::size_t offsetPeriod{96};
+
+        constexpr int bayerSize{8};
+
+        // The sRGB curve is interpolated from this many equal steps over
+        // [0, 1], which is well within a hundredth of a level everywhere.
+        constexpr int srgbSteps{4096};
+
+        // Images are converted in bands of this many rows when threaded.
+        constexpr std::size_t bandRows{32};
+
+        // and saveToFile writes them in bands of this many
+        constexpr std::size_t saveBandRows{64};
+
+        struct Tables
+        {
+            float offsets[bayerSize][offsetPeriod];
+            float zeros[offsetPeriod];
+
+            // 255 * the sRGB encoding of i / srgbSteps
+            float srgb[srgbSteps + 1];
+        };
+
+        Tables makeTables()
+        {
+            Tables tables{};
+
+            // Bayer matrix built up from the 2x2 one, giving each of the 64
+            // pixels in a tile a different threshold
+            int bayer[bayerSize][bayerSize]{{0}};
+            for (int size{1}; size < bayerSize; size *= 2)
+            {
+                for (int y{0}; y < size; ++y)
+                {
+                    for (int x{0}; x < size; ++x)
+                    {
+                        const int v{4 * bayer[y][x]};
+                        bayer[y][x]               = v;
+                        bayer[y][x + size]        = v + 2;
+                        bayer[y + size][x]        = v + 3;
+                        bayer[y + size][x + size] = v + 1;
+                    }
+                }
+            }
+
+            for (int y{0}; y < bayerSize; ++y)
+            {
+                for (std::size_t i{0}; i < offsetPeriod; ++i)
+                {
+                    const int x{static_cast<int>(i / 3) % bayerSize};
+                    tables.offsets[y][i] =
+                        (bayer[y][x] + 0.5f) / (bayerSize * bayerSize);
+                }
+            }
+
+            for (int i{0}; i <= srgbSteps; ++i)
+            {
+                const double x{static_cast<double>(i) / srgbSteps};
+                const double s{x <= 0.0031308
+                                   ? 12.92 * x
+                                   : 1.055 * std::pow(x, 1.0 / 2.4) - 0.055};
+                tables.srgb[i] = static_cast<float>(255.0 * s);
+            }
+
+            return tables;
+        }
+
+        Tables const& getTables()
+        {
+            static const Tables tables{makeTables()};
+            return tables;
+        }
+
+        // The kernels below all do exactly these operations in this order,
+        // so that they give the same bytes.
+        template<Encoding encoding>
+        std::uint8_t convertScalar(float x, float offset, float const* srgb)
+        {
+            // written so that a NaN becomes 0, like max_ps does
+            x = x > 0.0f ? x : 0.0f;
+            x = x < 1.0f ? x : 1.0f;
+
+            float v;
+            if constexpr (encoding == Encoding::Srgb)
+            {
+                const float s{x * srgbSteps};
+                const int i{std::min(static_cast<int>(s), srgbSteps - 1)};
+                const float f{s - static_cast<float>(i)};
+                v = srgb[i] + f * (srgb[i + 1] - srgb[i]);
+            }
+            else
+            {
+                v = x * 255.0f;
+            }
+
+            v += offset;
+            v = v < 255.0f ? v : 255.0f;
+            return static_cast<std::uint8_t>(v);
+        }
+
+        template<Encoding encoding>
+        void convertRowScalar(float const* in,
+                              std::uint8_t* out,
+                              std::size_t first,
+                              std::size_t count,
+                              float const* offsets,
+                              float const* srgb)
+        {
+            std::size_t j{first % offsetPeriod};
+            for (std::size_t i{first}; i < count; ++i)
+            {
+                out[i] = convertScalar<encoding>(in[i], offsets[j], srgb);
+                j      = j + 1 < offsetPeriod ? j + 1 : 0;
+            }
+        }
+
+#if COMMON_X86
+        // The same as convertScalar on 4 floats. SSE2 has no gather, so the
+        // sRGB table is read one value at a time.
+        template<Encoding encoding>
+        __m128i convertSse2(float const* in,
+                            float const* offset,
+                            float const* srgb)
+        {
+            const __m128 scale{_mm_set1_ps(255.0f)};
+
+            __m128 x{_mm_loadu_ps(in)};
+            x = _mm_min_ps(_mm_max_ps(x, _mm_setzero_ps()), _mm_set1_ps(1.0f));
+
+            __m128 v;
+            if constexpr (encoding == Encoding::Srgb)
+            {
+                const __m128 s{_mm_mul_ps(x, _mm_set1_ps(float{srgbSteps}))};
+
+                // 1 lands one past the last step and is moved back the way
+                // convertScalar does it, SSE2 has no 32-bit integer min
+                alignas(16) std::int32_t i[4];
+                _mm_store_si128(reinterpret_cast<__m128i*>(i),
+                                _mm_cvttps_epi32(s));
+                for (auto& step : i)
+                {
+                    step = std::min(step, srgbSteps - 1);
+                }
+
+                const __m128 f{_mm_sub_ps(
+                    s,
+                    _mm_cvtepi32_ps(_mm_load_si128(
+                        reinterpret_cast<__m128i const*>(i))))};
+                const __m128 lo{_mm_setr_ps(
+                    srgb[i[0]], srgb[i[1]], srgb[i[2]], srgb[i[3]])};
+                const __m128 hi{_mm_setr_ps(srgb[i[0] + 1],
+                                            srgb[i[1] + 1],
+                                            srgb[i[2] + 1],
+                                            srgb[i[3] + 1])};
+                v = _mm_add_ps(lo, _mm_mul_ps(f, _mm_sub_ps(hi, lo)));
+            }
+            else
+            {
+                v = _mm_mul_ps(x, scale);
+            }
+
+            v = _mm_add_ps(v, _mm_loadu_ps(offset));
+            v = _mm_min_ps(v, scale);
+            return _mm_cvttps_epi32(v);
+        }
+
+        // Returns how many floats it converted, the rest are left to the
+        // scalar kernel.
+        template<Encoding encoding>
+        std::size_t convertRowSse2(float const* in,
+                                   std::uint8_t* out,
+                                   std::size_t count,
+                                   float const* offsets,
+                                   float const* srgb)
+        {
+            std::size_t i{0};
+            for (; i + 16 <= count; i += 16)
+            {
+                float const* offset{offsets + i % offsetPeriod};
+                const __m128i a{_mm_packs_epi32(
+                    convertSse2<encoding>(in + i, offset, srgb),
+                    convertSse2<encoding>(in + i + 4, offset + 4, srgb))};
+                const __m128i b{_mm_packs_epi32(
+                    convertSse2<encoding>(in + i + 8, offset + 8, srgb),
+                    convertSse2<encoding>(in + i + 12, offset + 12, srgb))};
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i),
+                                 _mm_packus_epi16(a, b));
+            }
+            return i;
+        }
+
+        // The same as convertScalar on 8 floats.
+        template<Encoding encoding>
+        COMMON_TARGET_AVX2 __m256i convertAvx2(float const* in,
+                                               float const* offset,
+                                               float const* srgb)
+        {
+            const __m256 scale{_mm256_set1_ps(255.0f)};
+
+            __m256 x{_mm256_loadu_ps(in)};
+            x = _mm256_min_ps(_mm256_max_ps(x, _mm256_setzero_ps()),
+                              _mm256_set1_ps(1.0f));
+
+            __m256 v;
+            if constexpr (encoding == Encoding::Srgb)
+            {
+                const __m256 s{
+                    _mm256_mul_ps(x, _mm256_set1_ps(float{srgbSteps}))};
+                const __m256i i{_mm256_min_epi32(
+                    _mm256_cvttps_epi32(s), _mm256_set1_epi32(srgbSteps - 1))};
+                const __m256 f{_mm256_sub_ps(s, _mm256_cvtepi32_ps(i))};
+                const __m256 lo{_mm256_i32gather_ps(srgb, i, 4)};
+                const __m256 hi{_mm256_i32gather_ps(srgb + 1, i, 4)};
+                v = _mm256_add_ps(lo, _mm256_mul_ps(f, _mm256_sub_ps(hi, lo)));
+            }
+            else
+            {
+                v = _mm256_mul_ps(x, scale);
+            }
+
+            v = _mm256_add_ps(v, _mm256_loadu_ps(offset));
+            v = _mm256_min_ps(v, scale);
+            return _mm256_cvttps_epi32(v);
+        }
+
+        template<Encoding encoding>
+        COMMON_TARGET_AVX2 std::size_t convertRowAvx2(float const* in,
+                                                      std::uint8_t* out,
+                                                      std::size_t count,
+                                                      float const* offsets,
+                                                      float const* srgb)
+        {
+            // packs works within 128-bit lanes, this puts the 4 byte groups
+            // back in order
+            const __m256i order{_mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7)};
+
+            std::size_t i{0};
+            for (; i + 32 <= count; i += 32)
+            {
+                float const* offset{offsets + i % offsetPeriod};
+                const __m256i a{_mm256_packs_epi32(
+                    convertAvx2<encoding>(in + i, offset, srgb),
+                    convertAvx2<encoding>(in + i + 8, offset + 8, srgb))};
+                const __m256i b{_mm256_packs_epi32(
+                    convertAvx2<encoding>(in + i + 16, offset + 16, srgb),
+                    convertAvx2<encoding>(in + i + 24, offset + 24, srgb))};
+                _mm256_storeu_si256(
+                    reinterpret_cast<__m256i*>(out + i),
+                    _mm256_permutevar8x32_epi32(_mm256_packus_epi16(a, b),
+                                                order));
+            }
+            return i;
+        }
+#endif
+
+        template<Encoding encoding>
+        void convertRow(float const* in,
+                        std::uint8_t* out,
+                        std::size_t count,
+                        float const* offsets,
+                        float const* srgb,
+                        [[maybe_unused]] SimdLevel level)
+        {
+            std::size_t done{0};
+#if COMMON_X86
+            if (level == SimdLevel::Avx2)
+            {
+                done = convertRowAvx2<encoding>(in, out, count, offsets, srgb);
+            }
+            else if (level == SimdLevel::Sse2)
+            {
+                done = convertRowSse2<encoding>(in, out, count, offsets, srgb);
+            }
+#endif
+            convertRowScalar<encoding>(in, out, done, count, offsets, srgb);
+        }
+
+        // converts rows [first, last) of a band that starts at firstRow in
+        // the image
+        void convertRows(float const* rows,
+                         std::size_t width,
+                         std::size_t firstRow,
+                         std::size_t first,
+                         std::size_t last,
+                         std::uint8_t* out,
+                         ImageSettings const& settings,
+                         SimdLevel level)
+        {
+            Tables const& tables{getTables()};
+            const std::size_t rowSize{3 * width};
+
+            for (std::size_t y{first}; y < last; ++y)
+            {
+                float const* offsets{
+                    settings.dither ? tables.offsets[(firstRow + y) % bayerSize]
+                                    : tables.zeros};
+                float const* in{rows + y * rowSize};
+                std::uint8_t* row{out + y * rowSize};
+
+                if (settings.encoding == Encoding::Srgb)
+                {
+                    convertRow<Encoding::Srgb>(
+                        in, row, rowSize, offsets, tables.srgb, level);
+                }
+                else
+                {
+                    convertRow<Encoding::Linear>(
+                        in, row, rowSize, offsets, tables.srgb, level);
+                }
+            }
+        }
+    } // namespace
+
+    void quantize(atlas::math::Vector const* image,
+                  std::size_t width,
+                  std::size_t height,
+                  std::uint8_t* out,
+                  ImageSettings const& settings)
+    {
+        quantizeRows(image, width, 0, height, out, settings);
+    }
+
+    void quantizeRows(atlas::math::Vector const* rows,
+                      std::size_t width,
+                      std::size_t firstRow,
+                      std::size_t numRows,
+                      std::uint8_t* out,
+                      ImageSettings const& settings)
+    {
+        auto const* data{reinterpret_cast<float const*>(rows)};
+        const SimdLevel level{std::min(settings.level, getSimdLevel())};
+
+        const std::size_t numBands{(numRows + bandRows - 1) / bandRows};
+        if (settings.pool == nullptr || settings.pool->size() < 2 ||
+            numBands < 2)
+        {
+            convertRows(
+                data, width, firstRow, 0, numRows, out, settings, level);
+            return;
+        }
+
+        settings.pool->parallelFor(numBands, [&](std::size_t band) {
+            const std::size_t first{band * bandRows};
+            convertRows(data,
+                        width,
+                        firstRow,
+                        first,
+                        std::min(first + bandRows, numRows),
+                        out,
+                        settings,
+                        level);
+        });
+    }
+
+    void saveToFile(std::string const& filename,
+                    std::size_t width,
+                    std::size_t height,
+                    std::vector<atlas::math::Vector> const& image,
+                    ImageSettings const& settings)
+    {
+        COMMON_PROFILE_SCOPE(SaveToFile);
+
+        // in bands, so that the bytes never take up a second copy of the
+        // whole image, with enough rows in each for every thread to compress
+        // a strip of its own
+        const std::size_t rowsPerBand{
+            settings.pool == nullptr ? saveBandRows
+                                     : saveBandRows * settings.pool->size()};
+        ImageSink sink{filename, width, height, settings};
+        for (std::size_t y{0}; y < height; y += rowsPerBand)
+        {
+            const std::size_t numRows{std::min(rowsPerBand, height - y)};
+            sink.writeRows(image.data() + y * width, numRows);
+        }
+        sink.close();
+    }
+} // namespace common
@@ -0,0 +1,74 @@
+#pragma once
+
+#include "Cpu.hpp"
+
+#include <atlas/math/Math.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace common
+{
+    class ThreadPool;
+
+    // How colours are turned into 8-bit values. Linear writes them as they
+    // are, the way the labs always have; Srgb applies the sRGB transfer
+    // curve first, which is what image viewers expect.
+    enum class Encoding
+    {
+        Linear,
+        Srgb
+    };
+
+    struct ImageSettings
+    {
+        Encoding encoding{Encoding::Linear};
+
+        // Adds an 8x8 ordered dither before rounding down, which breaks up
+        // the banding in smooth gradients. Without it a value is rounded
+        // down, exactly like the loops this replaced.
+        bool dither{false};
+
+        // Splits the conversion of large images across the pool's threads.
+        // nullptr converts on the calling thread.
+        ThreadPool* pool{nullptr};
+
+        // Kernels are picked at runtime from what the CPU supports. A lower
+        // level can be forced (e.g. to compare against the scalar kernel);
+        // a higher level than the CPU supports is ignored.
+        SimdLevel level{getSimdLevel()};
+    };
+
+    // Converts a width x height image of colours in [0, 1] to 8-bit RGB in
+    // out, which must hold 3 * width * height bytes. Anything outside
+    // [0, 1], NaNs included, is clamped rather than wrapped around. Every
+    // kernel and any number of threads give the same bytes.
+    void quantize(atlas::math::Vector const* image,
+                  std::size_t width,
+                  std::size_t height,
+                  std::uint8_t* out,
+                  ImageSettings const& settings = {});
+
+    // The same as quantize on numRows rows taken out of a larger image.
+    // rows points at the first of them and firstRow is where that is in the
+    // image, which keeps the dither pattern lined up from one call to the
+    // next.
+    void quantizeRows(atlas::math::Vector const* rows,
+                      std::size_t width,
+                      std::size_t firstRow,
+                      std::size_t numRows,
+                      std::uint8_t* out,
+                      ImageSettings const& settings = {});
+
+    // Quantizes the image and writes it out a band at a time through an
+    // ImageSink, in the format given by the extension of filename (see
+    // getImageFormat in ImageSink.hpp). .pfm and .exr files get the colours
+    // as floats instead, unclamped and without quantizing.
+    void saveToFile(std::string const& filename,
+                    std::size_t width,
+                    std::size_t height,
+                    std::vector<atlas::math::Vector> const& image,
+                    ImageSettings const& settings = {});
+} // namespace common
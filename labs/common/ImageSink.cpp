@@ -0,0 +1,783 @@
+#include "ImageSink.hpp"
+
+#include "Deflate.hpp"
+#include "ThreadPool.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+
+namespace common
+{
+    namespace
+    {
+        constexpr std::size_t bmpHeaderSize{54};
+
+        // the float formats write the colours straight from memory, in
+        // the machine's byte order; both are little-endian
+        static_assert(sizeof(atlas::math::Vector) == 3 * sizeof(float),
+                      "colours must be 3 packed floats");
+
+        // Strips of rows are compressed on separate threads, but never fewer
+        // rows than this in one, so that they still compress well.
+        constexpr std::size_t minStripRows{16};
+
+        constexpr std::array<std::uint32_t, 256> makeCrcTable()
+        {
+            std::array<std::uint32_t, 256> table{};
+            for (std::uint32_t i{0}; i < 256; ++i)
+            {
+                std::uint32_t c{i};
+                for (int k{0}; k < 8; ++k)
+                {
+                    c = (c & 1u) ? 0xedb88320u ^ (c >> 1u) : c >> 1u;
+                }
+                table[i] = c;
+            }
+            return table;
+        }
+
+        constexpr std::array<std::uint32_t, 256> crcTable{makeCrcTable()};
+
+        // CRC-32 as used by PNG chunks, continued from crc
+        std::uint32_t updateCrc(std::uint32_t crc,
+                                std::uint8_t const* data,
+                                std::size_t size)
+        {
+            crc = ~crc;
+            for (std::size_t i{0}; i < size; ++i)
+            {
+                crc = crcTable[(crc ^ data[i]) & 0xffu] ^ (crc >> 8u);
+            }
+            return ~crc;
+        }
+
+        // Adler-32 as used by zlib streams, continued from adler
+        std::uint32_t updateAdler(std::uint32_t adler,
+                                  std::uint8_t const* data,
+                                  std::size_t size)
+        {
+            // the largest run that can't overflow the sums before the modulo
+            constexpr std::size_t maxRun{5552};
+            constexpr std::uint32_t base{65521};
+
+            std::uint32_t a{adler & 0xffffu};
+            std::uint32_t b{adler >> 16u};
+            while (size > 0)
+            {
+                const std::size_t run{std::min(size, maxRun)};
+                for (std::size_t i{0}; i < run; ++i)
+                {
+                    a += data[i];
+                    b += a;
+                }
+                a %= base;
+                b %= base;
+                data += run;
+                size -= run;
+            }
+            return (b << 16u) | a;
+        }
+
+        void putLittle(std::uint8_t* out, std::uint32_t value, int numBytes)
+        {
+            for (int i{0}; i < numBytes; ++i)
+            {
+                out[i] = static_cast<std::uint8_t>(value >> (8 * i));
+            }
+        }
+
+        void putBig(std::uint8_t* out, std::uint32_t value)
+        {
+            for (int i{0}; i < 4; ++i)
+            {
+                out[i] = static_cast<std::uint8_t>(value >> (8 * (3 - i)));
+            }
+        }
+
+        void putBig(std::vector<std::uint8_t>& out, std::uint32_t value)
+        {
+            out.resize(out.size() + 4);
+            putBig(out.data() + out.size() - 4, value);
+        }
+
+        // BMP rows are padded to a multiple of 4 bytes
+        std::size_t getBmpRowSize(std::size_t width)
+        {
+            return (3 * width + 3) & ~std::size_t{3};
+        }
+
+        // Filters a row of RGB pixels into out, predicting each byte from
+        // the ones to its left (a), above (b) and above left (c). Returns
+        // the sum of the filtered bytes as signed values, the usual guess at
+        // how well the row will compress.
+        template<typename Predictor>
+        std::uint64_t filterPngRow(std::uint8_t const* row,
+                                   std::uint8_t const* above,
+                                   std::size_t rowSize,
+                                   std::uint8_t* out,
+                                   Predictor const& predict)
+        {
+            std::uint64_t cost{0};
+            for (std::size_t i{0}; i < rowSize; ++i)
+            {
+                const int a{i >= 3 ? row[i - 3] : 0};
+                const int c{i >= 3 ? above[i - 3] : 0};
+                out[i] =
+                    static_cast<std::uint8_t>(row[i] - predict(a, above[i], c));
+                cost += static_cast<std::uint64_t>(
+                    std::abs(static_cast<std::int8_t>(out[i])));
+            }
+            return cost;
+        }
+
+        // Writes the filter type and the filtered row to out, trying every
+        // filter and keeping the one that compresses best by the guess
+        // above. scratch holds the filter being tried.
+        void filterPngRow(std::uint8_t const* row,
+                          std::uint8_t const* above,
+                          std::size_t rowSize,
+                          std::uint8_t* out,
+                          std::vector<std::uint8_t>& scratch)
+        {
+            scratch.resize(rowSize);
+            std::uint8_t* best{out + 1};
+            std::uint8_t* candidate{scratch.data()};
+            std::uint64_t bestCost{std::numeric_limits<std::uint64_t>::max()};
+
+            auto tryFilter{[&](std::uint8_t type, auto const& predict) {
+                const std::uint64_t cost{
+                    filterPngRow(row, above, rowSize, candidate, predict)};
+                if (cost < bestCost)
+                {
+                    std::swap(best, candidate);
+                    bestCost = cost;
+                    out[0]   = type;
+                }
+            }};
+
+            tryFilter(0, [](int, int, int) { return 0; });
+            tryFilter(1, [](int a, int, int) { return a; });
+            tryFilter(2, [](int, int b, int) { return b; });
+            tryFilter(3, [](int a, int b, int) { return (a + b) / 2; });
+            tryFilter(4, [](int a, int b, int c) {
+                const int p{a + b - c};
+                const int pa{std::abs(p - a)};
+                const int pb{std::abs(p - b)};
+                const int pc{std::abs(p - c)};
+                return (pa <= pb && pa <= pc) ? a : (pb <= pc ? b : c);
+            });
+
+            if (best != out + 1)
+            {
+                std::copy(best, best + rowSize, out + 1);
+            }
+        }
+
+        // Encodes RGB pixels as QOI chunks. The encoder starts from previous,
+        // the pixel before the first one, and an empty index: every chunk
+        // still decodes correctly after the ones before it in the image,
+        // which lets strips of the image be encoded independently.
+        void encodeQoi(std::uint8_t const* pixels,
+                       std::size_t numPixels,
+                       std::uint8_t const* previous,
+                       std::vector<std::uint8_t>& out)
+        {
+            constexpr std::uint8_t opIndex{0x00};
+            constexpr std::uint8_t opDiff{0x40};
+            constexpr std::uint8_t opLuma{0x80};
+            constexpr std::uint8_t opRun{0xc0};
+            constexpr std::uint8_t opRgb{0xfe};
+            constexpr int maxRun{62};
+
+            // slots holding 0 can't match, pixels are always opaque here
+            std::array<std::uint32_t, 64> index{};
+
+            auto pack{[](std::uint8_t const* p) {
+                return (std::uint32_t{p[0]} << 24u) |
+                       (std::uint32_t{p[1]} << 16u) |
+                       (std::uint32_t{p[2]} << 8u) | 0xffu;
+            }};
+
+            int run{0};
+            for (std::size_t i{0}; i < numPixels; ++i)
+            {
+                std::uint8_t const* p{pixels + 3 * i};
+                std::uint8_t const* q{i == 0 ? previous : p - 3};
+                const std::uint32_t pixel{pack(p)};
+                if (pixel == pack(q))
+                {
+                    if (++run == maxRun)
+                    {
+                        out.push_back(
+                            static_cast<std::uint8_t>(opRun | (maxRun - 1)));
+                        run = 0;
+                    }
+                    continue;
+                }
+
+                if (run > 0)
+                {
+                    out.push_back(static_cast<std::uint8_t>(opRun | (run - 1)));
+                    run = 0;
+                }
+
+                const std::uint8_t slot{static_cast<std::uint8_t>(
+                    (p[0] * 3 + p[1] * 5 + p[2] * 7 + 255 * 11) % 64)};
+                if (index[slot] == pixel)
+                {
+                    out.push_back(static_cast<std::uint8_t>(opIndex | slot));
+                    continue;
+                }
+                index[slot] = pixel;
+
+                // the differences wrap around
+                const int dr{static_cast<std::int8_t>(p[0] - q[0])};
+                const int dg{static_cast<std::int8_t>(p[1] - q[1])};
+                const int db{static_cast<std::int8_t>(p[2] - q[2])};
+                const int drg{dr - dg};
+                const int dbg{db - dg};
+
+                if (dr >= -2 && dr <= 1 && dg >= -2 && dg <= 1 && db >= -2 &&
+                    db <= 1)
+                {
+                    out.push_back(static_cast<std::uint8_t>(
+                        opDiff | (dr + 2) << 4u | (dg + 2) << 2u | (db + 2)));
+                }
+                else if (dg >= -32 && dg <= 31 && drg >= -8 && drg <= 7 &&
+                         dbg >= -8 && dbg <= 7)
+                {
+                    out.push_back(
+                        static_cast<std::uint8_t>(opLuma | (dg + 32)));
+                    out.push_back(
+                        static_cast<std::uint8_t>((drg + 8) << 4u | (dbg + 8)));
+                }
+                else
+                {
+                    out.insert(out.end(), {opRgb, p[0], p[1], p[2]});
+                }
+            }
+
+            if (run > 0)
+            {
+                out.push_back(static_cast<std::uint8_t>(opRun | (run - 1)));
+            }
+        }
+
+        // an EXR chunk is its line number and size, then the line
+        std::size_t getExrChunkSize(std::size_t width)
+        {
+            return 8 + 3 * sizeof(float) * width;
+        }
+
+        // EXR header attributes are a name, a type, a size and a value
+        void putExrAttribute(std::vector<std::uint8_t>& out,
+                             std::string const& name,
+                             std::string const& type,
+                             std::vector<std::uint8_t> const& value)
+        {
+            out.insert(out.end(), name.begin(), name.end());
+            out.push_back(0);
+            out.insert(out.end(), type.begin(), type.end());
+            out.push_back(0);
+            out.resize(out.size() + 4);
+            putLittle(out.data() + out.size() - 4,
+                      static_cast<std::uint32_t>(value.size()),
+                      4);
+            out.insert(out.end(), value.begin(), value.end());
+        }
+    } // namespace
+
+    ImageFormat getImageFormat(std::string const& filename)
+    {
+        auto hasExtension{[&](std::string const& extension) {
+            return filename.size() > extension.size() &&
+                   filename.compare(filename.size() - extension.size(),
+                                    extension.size(),
+                                    extension) == 0;
+        }};
+
+        if (hasExtension(".ppm"))
+        {
+            return ImageFormat::Ppm;
+        }
+        if (hasExtension(".png"))
+        {
+            return ImageFormat::Png;
+        }
+        if (hasExtension(".qoi"))
+        {
+            return ImageFormat::Qoi;
+        }
+        if (hasExtension(".pfm"))
+        {
+            return ImageFormat::Pfm;
+        }
+        if (hasExtension(".exr"))
+        {
+            return ImageFormat::Exr;
+        }
+        return ImageFormat::Bmp;
+    }
+
+    ImageSink::ImageSink(std::string const& filename,
+                         std::size_t width,
+                         std::size_t height,
+                         ImageSettings const& settings) :
+        ImageSink{filename, getImageFormat(filename), width, height, settings}
+    {}
+
+    ImageSink::ImageSink(std::string const& filename,
+                         ImageFormat format,
+                         std::size_t width,
+                         std::size_t height,
+                         ImageSettings const& settings) :
+        mFilename{filename},
+        mFormat{format},
+        mWidth{width},
+        mHeight{height},
+        mSettings{settings},
+        mFile{std::fopen(filename.c_str(), "wb")},
+        mNumRows{0},
+        mDataOffset{0},
+        mAdler{1}
+    {
+        if (mFile == nullptr)
+        {
+            throw std::runtime_error{filename +
+                                     ": cannot open file for writing"};
+        }
+
+        try
+        {
+            writeHeader();
+        }
+        catch (...)
+        {
+            std::fclose(mFile);
+            throw;
+        }
+    }
+
+    ImageSink::~ImageSink()
+    {
+        if (mFile != nullptr)
+        {
+            std::fclose(mFile);
+        }
+    }
+
+    void ImageSink::writeRows(atlas::math::Vector const* rows,
+                              std::size_t numRows)
+    {
+        if (mNumRows + numRows > mHeight)
+        {
+            throw std::runtime_error{mFilename + ": more rows than the image"};
+        }
+
+        if (mFormat == ImageFormat::Pfm || mFormat == ImageFormat::Exr)
+        {
+            writeFloatRows(rows, numRows);
+            mNumRows += numRows;
+            return;
+        }
+
+        const std::size_t rowSize{3 * mWidth};
+        mPixels.resize(numRows * rowSize);
+        quantizeRows(
+            rows, mWidth, mNumRows, numRows, mPixels.data(), mSettings);
+        mNumRows += numRows;
+
+        switch (mFormat)
+        {
+        case ImageFormat::Bmp:
+        {
+            const std::size_t bmpRowSize{getBmpRowSize(mWidth)};
+            mEncoded.assign(numRows * bmpRowSize, 0);
+            for (std::size_t y{0}; y < numRows; ++y)
+            {
+                std::uint8_t const* in{mPixels.data() + y * rowSize};
+                std::uint8_t* out{mEncoded.data() + y * bmpRowSize};
+                for (std::size_t x{0}; x < 3 * mWidth; x += 3)
+                {
+                    out[x + 0] = in[x + 2];
+                    out[x + 1] = in[x + 1];
+                    out[x + 2] = in[x + 0];
+                }
+            }
+            writeBytes(mEncoded.data(), mEncoded.size());
+            break;
+        }
+
+        case ImageFormat::Ppm:
+            writeBytes(mPixels.data(), mPixels.size());
+            break;
+
+        case ImageFormat::Png:
+        {
+            // every row starts with its filter type, and each strip is
+            // filtered and compressed on its own
+            const std::size_t filteredSize{rowSize + 1};
+            mFiltered.resize(numRows * filteredSize);
+            forEachStrip(numRows,
+                         [&](std::size_t strip,
+                             std::size_t first,
+                             std::size_t last) {
+                             std::vector<std::uint8_t> scratch;
+                             for (std::size_t y{first}; y < last; ++y)
+                             {
+                                 std::uint8_t const* row{mPixels.data() +
+                                                         y * rowSize};
+                                 filterPngRow(row,
+                                              y == 0 ? mPreviousRow.data()
+                                                     : row - rowSize,
+                                              rowSize,
+                                              mFiltered.data() +
+                                                  y * filteredSize,
+                                              scratch);
+                             }
+
+                             mStrips[strip].clear();
+                             deflate(mFiltered.data() + first * filteredSize,
+                                     (last - first) * filteredSize,
+                                     mStrips[strip]);
+                         });
+            mAdler = updateAdler(mAdler, mFiltered.data(), mFiltered.size());
+
+            // none of the blocks are final, close adds that
+            for (auto const& strip : mStrips)
+            {
+                writeChunk("IDAT", strip);
+            }
+            break;
+        }
+
+        case ImageFormat::Qoi:
+            forEachStrip(numRows,
+                         [&](std::size_t strip,
+                             std::size_t first,
+                             std::size_t last) {
+                             std::uint8_t const* pixels{mPixels.data() +
+                                                        first * rowSize};
+                             mStrips[strip].clear();
+                             encodeQoi(pixels,
+                                       (last - first) * mWidth,
+                                       first == 0 ? mPreviousRow.data() +
+                                                        rowSize - 3
+                                                  : pixels - 3,
+                                       mStrips[strip]);
+                         });
+            for (auto const& strip : mStrips)
+            {
+                writeBytes(strip.data(), strip.size());
+            }
+            break;
+
+        default:
+            break;
+        }
+
+        // PNG filters and QOI runs carry on from the last row
+        if (!mPreviousRow.empty())
+        {
+            std::copy(
+                mPixels.end() - rowSize, mPixels.end(), mPreviousRow.begin());
+        }
+    }
+
+    void ImageSink::forEachStrip(
+        std::size_t numRows,
+        std::function<void(std::size_t, std::size_t, std::size_t)> const& fn)
+    {
+        ThreadPool* pool{mSettings.pool};
+        const std::size_t numThreads{pool == nullptr ? 1 : pool->size()};
+        const std::size_t numStrips{std::max<std::size_t>(
+            std::min(numThreads, numRows / minStripRows), 1)};
+        const std::size_t stripRows{(numRows + numStrips - 1) / numStrips};
+
+        mStrips.resize(numStrips);
+        auto runStrip{[&](std::size_t strip) {
+            const std::size_t first{std::min(strip * stripRows, numRows)};
+            fn(strip, first, std::min(first + stripRows, numRows));
+        }};
+
+        if (pool == nullptr || numStrips == 1)
+        {
+            for (std::size_t strip{0}; strip < numStrips; ++strip)
+            {
+                runStrip(strip);
+            }
+            return;
+        }
+
+        pool->parallelFor(numStrips, runStrip);
+    }
+
+    void ImageSink::writeFloatRows(atlas::math::Vector const* rows,
+                                   std::size_t numRows)
+    {
+        const std::size_t rowSize{3 * sizeof(float) * mWidth};
+
+        if (mFormat == ImageFormat::Pfm)
+        {
+            // the band's rows are contiguous in the file but upside down,
+            // so start at the last one and work back up
+            const std::size_t last{mHeight - mNumRows - numRows};
+            if (std::fseek(mFile,
+                           mDataOffset + static_cast<long>(last * rowSize),
+                           SEEK_SET) != 0)
+            {
+                throw std::runtime_error{mFilename + ": cannot write file"};
+            }
+
+            for (std::size_t y{numRows}; y-- > 0;)
+            {
+                writeBytes(rows + y * mWidth, rowSize);
+            }
+            return;
+        }
+
+        // EXR lines hold each channel in turn, in name order: B, G, R
+        mEncoded.resize(getExrChunkSize(mWidth));
+        for (std::size_t y{0}; y < numRows; ++y)
+        {
+            const auto line{static_cast<std::uint32_t>(mNumRows + y)};
+            putLittle(mEncoded.data(), line, 4);
+            putLittle(mEncoded.data() + 4,
+                      static_cast<std::uint32_t>(rowSize),
+                      4);
+
+            atlas::math::Vector const* row{rows + y * mWidth};
+            std::uint8_t* out{mEncoded.data() + 8};
+            for (std::size_t x{0}; x < mWidth; ++x)
+            {
+                std::uint8_t* pixel{out + x * sizeof(float)};
+                std::memcpy(pixel, &row[x].b, sizeof(float));
+                std::memcpy(pixel + rowSize / 3, &row[x].g, sizeof(float));
+                std::memcpy(pixel + 2 * rowSize / 3, &row[x].r, sizeof(float));
+            }
+            writeBytes(mEncoded.data(), mEncoded.size());
+        }
+    }
+
+    void ImageSink::close()
+    {
+        if (mNumRows != mHeight)
+        {
+            throw std::runtime_error{mFilename + ": " +
+                                     std::to_string(mNumRows) + " of " +
+                                     std::to_string(mHeight) +
+                                     " rows were written"};
+        }
+
+        if (mFormat == ImageFormat::Qoi)
+        {
+            constexpr std::uint8_t end[8]{0, 0, 0, 0, 0, 0, 0, 1};
+            writeBytes(end, sizeof(end));
+        }
+
+        if (mFormat == ImageFormat::Png)
+        {
+            // an empty final block, then the checksum of the zlib stream
+            mEncoded = {0x01, 0x00, 0x00, 0xff, 0xff};
+            putBig(mEncoded, mAdler);
+            writeChunk("IDAT", mEncoded);
+
+            mEncoded.clear();
+            writeChunk("IEND", mEncoded);
+        }
+
+        const bool failed{std::fclose(mFile) != 0};
+        mFile = nullptr;
+        if (failed)
+        {
+            throw std::runtime_error{mFilename + ": cannot write file"};
+        }
+    }
+
+    std::size_t ImageSink::getWidth() const
+    {
+        return mWidth;
+    }
+
+    std::size_t ImageSink::getHeight() const
+    {
+        return mHeight;
+    }
+
+    std::size_t ImageSink::getNumRowsWritten() const
+    {
+        return mNumRows;
+    }
+
+    void ImageSink::writeHeader()
+    {
+        switch (mFormat)
+        {
+        case ImageFormat::Bmp:
+        {
+            const std::size_t imageSize{getBmpRowSize(mWidth) * mHeight};
+
+            // a negative height makes the rows go from the top down, which
+            // is the order they arrive in
+            std::uint8_t header[bmpHeaderSize]{'B', 'M'};
+            putLittle(header + 2,
+                      static_cast<std::uint32_t>(bmpHeaderSize + imageSize),
+                      4);
+            putLittle(header + 10, bmpHeaderSize, 4);
+            putLittle(header + 14, 40, 4);
+            putLittle(header + 18, static_cast<std::uint32_t>(mWidth), 4);
+            putLittle(header + 22,
+                      static_cast<std::uint32_t>(
+                          -static_cast<std::int32_t>(mHeight)),
+                      4);
+            putLittle(header + 26, 1, 2);
+            putLittle(header + 28, 24, 2);
+            putLittle(header + 34, static_cast<std::uint32_t>(imageSize), 4);
+            writeBytes(header, bmpHeaderSize);
+            break;
+        }
+
+        case ImageFormat::Ppm:
+        {
+            const std::string header{"P6\n" + std::to_string(mWidth) + " " +
+                                     std::to_string(mHeight) + "\n255\n"};
+            writeBytes(header.data(), header.size());
+            break;
+        }
+
+        case ImageFormat::Png:
+        {
+            constexpr std::uint8_t signature[8]{
+                0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+            writeBytes(signature, sizeof(signature));
+
+            // 8 bits per channel RGB, no interlacing
+            mEncoded.clear();
+            putBig(mEncoded, static_cast<std::uint32_t>(mWidth));
+            putBig(mEncoded, static_cast<std::uint32_t>(mHeight));
+            mEncoded.insert(mEncoded.end(), {8, 2, 0, 0, 0});
+            writeChunk("IHDR", mEncoded);
+
+            // the zlib stream header goes on its own: deflate with a 32K
+            // window
+            mEncoded = {0x78, 0x01};
+            writeChunk("IDAT", mEncoded);
+            mPreviousRow.assign(3 * mWidth, 0);
+            break;
+        }
+
+        case ImageFormat::Qoi:
+        {
+            // 3 channels, and whether the colours are sRGB or linear
+            mEncoded = {'q', 'o', 'i', 'f'};
+            putBig(mEncoded, static_cast<std::uint32_t>(mWidth));
+            putBig(mEncoded, static_cast<std::uint32_t>(mHeight));
+            mEncoded.push_back(3);
+            mEncoded.push_back(
+                mSettings.encoding == Encoding::Srgb ? 0 : 1);
+            writeBytes(mEncoded.data(), mEncoded.size());
+
+            // QOI starts from a black pixel
+            mPreviousRow.assign(3 * mWidth, 0);
+            break;
+        }
+
+        case ImageFormat::Pfm:
+        {
+            // a negative scale means little-endian
+            const std::string header{"PF\n" + std::to_string(mWidth) + " " +
+                                     std::to_string(mHeight) + "\n-1.0\n"};
+            writeBytes(header.data(), header.size());
+            mDataOffset = static_cast<long>(header.size());
+            break;
+        }
+
+        case ImageFormat::Exr:
+        {
+            // magic number, then version 2 with no flags: a scanline file
+            mEncoded = {0x76, 0x2f, 0x31, 0x01, 0x02, 0x00, 0x00, 0x00};
+
+            // 32-bit float channels, sorted by name
+            std::vector<std::uint8_t> channels;
+            for (char name : {'B', 'G', 'R'})
+            {
+                channels.push_back(static_cast<std::uint8_t>(name));
+                channels.push_back(0);
+                channels.insert(channels.end(), {2, 0, 0, 0, 0, 0, 0, 0});
+                channels.insert(channels.end(), {1, 0, 0, 0, 1, 0, 0, 0});
+            }
+            channels.push_back(0);
+            putExrAttribute(mEncoded, "channels", "chlist", channels);
+            putExrAttribute(mEncoded, "compression", "compression", {0});
+
+            std::vector<std::uint8_t> window(16, 0);
+            putLittle(window.data() + 8,
+                      static_cast<std::uint32_t>(mWidth - 1),
+                      4);
+            putLittle(window.data() + 12,
+                      static_cast<std::uint32_t>(mHeight - 1),
+                      4);
+            putExrAttribute(mEncoded, "dataWindow", "box2i", window);
+            putExrAttribute(mEncoded, "displayWindow", "box2i", window);
+
+            // lines from the top down, square pixels, the default screen
+            std::vector<std::uint8_t> one(4);
+            const float unit{1.0f};
+            std::memcpy(one.data(), &unit, sizeof(unit));
+            putExrAttribute(mEncoded, "lineOrder", "lineOrder", {0});
+            putExrAttribute(mEncoded, "pixelAspectRatio", "float", one);
+            putExrAttribute(mEncoded,
+                            "screenWindowCenter",
+                            "v2f",
+                            std::vector<std::uint8_t>(8, 0));
+            putExrAttribute(mEncoded, "screenWindowWidth", "float", one);
+            mEncoded.push_back(0);
+
+            // the chunks are all the same size, so the table of where each
+            // line starts is known before any of them are written
+            const std::size_t chunkSize{getExrChunkSize(mWidth)};
+            std::size_t offset{mEncoded.size() + 8 * mHeight};
+            for (std::size_t y{0}; y < mHeight; ++y, offset += chunkSize)
+            {
+                for (int i{0}; i < 8; ++i)
+                {
+                    mEncoded.push_back(
+                        static_cast<std::uint8_t>(offset >> (8 * i)));
+                }
+            }
+
+            writeBytes(mEncoded.data(), mEncoded.size());
+            break;
+        }
+        }
+    }
+
+    void ImageSink::writeBytes(void const* data, std::size_t size)
+    {
+        if (std::fwrite(data, 1, size, mFile) != size)
+        {
+            throw std::runtime_error{mFilename + ": cannot write file"};
+        }
+    }
+
+    void ImageSink::writeChunk(char const* type,
+                               std::vector<std::uint8_t> const& data)
+    {
+        std::uint8_t header[8];
+        putBig(header, static_cast<std::uint32_t>(data.size()));
+        std::copy(type, type + 4, header + 4);
+
+        // the checksum covers the type and the data, not the length
+        const std::uint32_t typeCrc{updateCrc(0, header + 4, 4)};
+        std::uint8_t crc[4];
+        putBig(crc, updateCrc(typeCrc, data.data(), data.size()));
+
+        writeBytes(header, sizeof(header));
+        writeBytes(data.data(), data.size());
+        writeBytes(crc, sizeof(crc));
+    }
+} // namespace common
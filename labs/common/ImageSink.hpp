@@ -0,0 +1,124 @@
+#pragma once
+
+#include "Image.hpp"
+
+#include <atlas/math/Math.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace common
+{
+    enum class ImageFormat
+    {
+        Bmp,
+        Ppm,
+        Png,
+        Qoi,
+
+        // linear float colours, written as they are without quantizing
+        Pfm,
+        Exr
+    };
+
+    // Picks the format from the extension of filename: .ppm, .png, .qoi,
+    // .pfm and .exr, and BMP for anything else.
+    ImageFormat getImageFormat(std::string const& filename);
+
+    // Writes an image to a file as it is produced, a band of rows at a time
+    // from top to bottom. Each band is quantized (see quantize) and written
+    // out as soon as it arrives, so only the band is ever held in memory and
+    // the file is mostly written by the time the last row is rendered.
+    //
+    // BMP files are written top-down. PNG and QOI bands are split into
+    // strips that are compressed on the threads of settings.pool, one IDAT
+    // chunk per strip for PNG (see deflate); the more rows a band has, the
+    // more threads can work on it.
+    //
+    // PFM and EXR files keep the colours as 32-bit floats, out of range
+    // values included, and ignore the settings. PFM stores its rows bottom
+    // up, so each band is written to its place in the file. EXR files are
+    // uncompressed scanline images with one line per chunk.
+    //
+    // Throws std::runtime_error if the file can't be opened or written.
+    class ImageSink
+    {
+    public:
+        ImageSink(std::string const& filename,
+                  std::size_t width,
+                  std::size_t height,
+                  ImageSettings const& settings = {});
+        ImageSink(std::string const& filename,
+                  ImageFormat format,
+                  std::size_t width,
+                  std::size_t height,
+                  ImageSettings const& settings = {});
+
+        // Closes the file, which is left incomplete if close wasn't called.
+        ~ImageSink();
+
+        ImageSink(ImageSink const&) = delete;
+        ImageSink& operator=(ImageSink const&) = delete;
+
+        // Writes the next numRows rows of width colours each, which follow
+        // on from the rows written before.
+        void writeRows(atlas::math::Vector const* rows, std::size_t numRows);
+
+        // Finishes the file. Fails unless every row has been written.
+        void close();
+
+        std::size_t getWidth() const;
+
+        std::size_t getHeight() const;
+
+        std::size_t getNumRowsWritten() const;
+
+    private:
+        void writeHeader();
+
+        void writeBytes(void const* data, std::size_t size);
+
+        void writeFloatRows(atlas::math::Vector const* rows,
+                            std::size_t numRows);
+
+        // Calls fn(strip, first, last) for the strips of rows [first, last)
+        // that a band of numRows rows splits into, on the pool if there is
+        // one, with an output buffer in mStrips for each strip.
+        void forEachStrip(
+            std::size_t numRows,
+            std::function<void(std::size_t, std::size_t, std::size_t)> const&
+                fn);
+
+        // PNG only
+        void writeChunk(char const* type,
+                        std::vector<std::uint8_t> const& data);
+
+        std::string mFilename;
+        ImageFormat mFormat;
+        std::size_t mWidth;
+        std::size_t mHeight;
+        ImageSettings mSettings;
+        std::FILE* mFile;
+        std::size_t mNumRows;
+
+        // where the pixels start, for PFM
+        long mDataOffset;
+
+        // one band, as quantized and then as laid out in the file, kept
+        // from one band to the next so that their memory is reused
+        std::vector<std::uint8_t> mPixels;
+        std::vector<std::uint8_t> mFiltered;
+        std::vector<std::uint8_t> mEncoded;
+        std::vector<std::vector<std::uint8_t>> mStrips;
+
+        // last row of the band before, for PNG filters and QOI
+        std::vector<std::uint8_t> mPreviousRow;
+
+        // running checksum of the PNG image data
+        std::uint32_t mAdler;
+    };
+} // namespace common
@@ -0,0 +1,149 @@
+#include "ImageWriter.hpp"
+
+#include "Timer.hpp"
+
+#include <algorithm>
+#include <utility>
+
+namespace common
+{
+    ImageWriter::ImageWriter(std::size_t maxQueued,
+                             ImageSettings const& settings) :
+        mSettings{settings},
+        mMaxQueued{std::max<std::size_t>(maxQueued, 1)},
+        mNumPending{0},
+        mStats{0, 0.0, 0.0, 0},
+        mStop{false}
+    {
+        // the thread goes last, once everything it reads is set up
+        mThread = std::thread{[this]() { writerLoop(); }};
+    }
+
+    ImageWriter::~ImageWriter()
+    {
+        {
+            std::lock_guard<std::mutex> lock{mMutex};
+            mStop = true;
+        }
+
+        mQueued.notify_one();
+        mThread.join();
+    }
+
+    std::vector<atlas::math::Vector>
+    ImageWriter::acquireBuffer(std::size_t size)
+    {
+        std::vector<atlas::math::Vector> buffer;
+        {
+            std::lock_guard<std::mutex> lock{mMutex};
+            if (mFreeBuffers.empty())
+            {
+                ++mStats.numBuffers;
+            }
+            else
+            {
+                buffer = std::move(mFreeBuffers.back());
+                mFreeBuffers.pop_back();
+            }
+        }
+
+        buffer.resize(size);
+        return buffer;
+    }
+
+    void ImageWriter::write(std::string const& filename,
+                            std::size_t width,
+                            std::size_t height,
+                            std::vector<atlas::math::Vector>&& image)
+    {
+        Timer timer;
+        {
+            std::unique_lock<std::mutex> lock{mMutex};
+            mWritten.wait(lock, [this]() {
+                return mNumPending < mMaxQueued || mError;
+            });
+            mStats.waitSeconds += timer.elapsedSeconds();
+            rethrowError();
+
+            mQueue.push_back({filename, width, height, std::move(image)});
+            ++mNumPending;
+        }
+
+        mQueued.notify_one();
+    }
+
+    void ImageWriter::flush()
+    {
+        Timer timer;
+        std::unique_lock<std::mutex> lock{mMutex};
+        mWritten.wait(lock, [this]() { return mNumPending == 0; });
+        mStats.waitSeconds += timer.elapsedSeconds();
+        rethrowError();
+    }
+
+    ImageWriterStats ImageWriter::getStats() const
+    {
+        std::lock_guard<std::mutex> lock{mMutex};
+        return mStats;
+    }
+
+    void ImageWriter::writerLoop()
+    {
+        for (;;)
+        {
+            Frame frame;
+            {
+                std::unique_lock<std::mutex> lock{mMutex};
+                mQueued.wait(lock,
+                             [this]() { return mStop || !mQueue.empty(); });
+
+                // the queue is drained before stopping
+                if (mQueue.empty())
+                {
+                    return;
+                }
+
+                frame = std::move(mQueue.front());
+                mQueue.pop_front();
+            }
+
+            Timer timer;
+            std::exception_ptr error;
+            try
+            {
+                saveToFile(frame.filename,
+                           frame.width,
+                           frame.height,
+                           frame.image,
+                           mSettings);
+            }
+            catch (...)
+            {
+                error = std::current_exception();
+            }
+
+            {
+                std::lock_guard<std::mutex> lock{mMutex};
+                mStats.writeSeconds += timer.elapsedSeconds();
+                ++mStats.numFrames;
+                mFreeBuffers.push_back(std::move(frame.image));
+                --mNumPending;
+                if (error && !mError)
+                {
+                    mError = error;
+                }
+            }
+            mWritten.notify_all();
+        }
+    }
+
+    void ImageWriter::rethrowError()
+    {
+        if (mError)
+        {
+            std::exception_ptr error{std::move(mError)};
+            mError = nullptr;
+            std::rethrow_exception(error);
+        }
+    }
+} // namespace common
@@ -0,0 +1,111 @@
+#pragma once
+
+#include "Image.hpp"
+
+#include <atlas/math/Math.hpp>
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace common
+{
+    // Time spent on image output, split into what ran in the background and
+    // what the rendering thread had to wait for. The difference is the
+    // output time that overlapped with rendering.
+    struct ImageWriterStats
+    {
+        std::size_t numFrames;
+
+        // time the writer thread spent encoding and writing frames
+        double writeSeconds;
+
+        // time the calling thread spent blocked, waiting for room in the
+        // queue or for a flush
+        double waitSeconds;
+
+        // number of frame buffers ever allocated; the rest were recycled
+        std::size_t numBuffers;
+    };
+
+    // Saves images with saveToFile on a thread of its own, so that encoding
+    // and disk I/O overlap with rendering the next frame or pass.
+    //
+    // Frames are handed over by value: fill a buffer from acquireBuffer and
+    // move it into write. Once a frame is written its buffer goes back on a
+    // free list for acquireBuffer to hand out again, so a steady stream of
+    // frames reuses the same few buffers. At most maxQueued frames are
+    // waiting at any time; write blocks until there is room, which bounds
+    // the memory used when frames arrive faster than they can be written.
+    //
+    // An exception thrown while writing a frame is rethrown from the next
+    // call to write or flush.
+    class ImageWriter
+    {
+    public:
+        // settings.pool, if set, is used from the writer thread and so must
+        // not be one the renderer is using at the same time.
+        explicit ImageWriter(std::size_t maxQueued         = 2,
+                             ImageSettings const& settings = {});
+
+        // Writes every frame still queued, then stops the thread. Errors
+        // from those last frames are dropped; call flush to see them.
+        ~ImageWriter();
+
+        ImageWriter(ImageWriter const&) = delete;
+        ImageWriter& operator=(ImageWriter const&) = delete;
+
+        // Returns a buffer of size colours, recycled from a frame that has
+        // been written if there is one. The contents are unspecified.
+        std::vector<atlas::math::Vector> acquireBuffer(std::size_t size);
+
+        // Queues image to be saved to filename, see saveToFile.
+        void write(std::string const& filename,
+                   std::size_t width,
+                   std::size_t height,
+                   std::vector<atlas::math::Vector>&& image);
+
+        // Blocks until every queued frame has been written.
+        void flush();
+
+        ImageWriterStats getStats() const;
+
+    private:
+        struct Frame
+        {
+            std::string filename;
+            std::size_t width;
+            std::size_t height;
+            std::vector<atlas::math::Vector> image;
+        };
+
+        void writerLoop();
+
+        // throws the pending error, if any; the lock must be held
+        void rethrowError();
+
+        ImageSettings mSettings;
+        std::size_t mMaxQueued;
+
+        mutable std::mutex mMutex;
+        std::condition_variable mQueued;
+        std::condition_variable mWritten;
+
+        std::deque<Frame> mQueue;
+        std::vector<std::vector<atlas::math::Vector>> mFreeBuffers;
+
+        // the frame being written, if any, still counts as queued
+        std::size_t mNumPending;
+
+        std::exception_ptr mError;
+        ImageWriterStats mStats;
+        bool mStop;
+
+        std::thread mThread;
+    };
+} // namespace common
@@ -0,0 +1,129 @@
+#include "MappedFile.hpp"
+
+#include <stdexcept>
+
+#if defined(_WIN32)
+#    define NOMINMAX
+#    include <windows.h>
+#else
+#    include <fcntl.h>
+#    include <sys/mman.h>
+#    include <sys/stat.h>
+#    include <unistd.h>
+#endif
+
+namespace common
+{
+#if defined(_WIN32)
+    MappedFile::MappedFile(std::string const& filename) :
+        mData{nullptr}, mSize{0}, mFile{nullptr}, mMapping{nullptr}
+    {
+        HANDLE file{CreateFileA(filename.c_str(),
+                                GENERIC_READ,
+                                FILE_SHARE_READ,
+                                nullptr,
+                                OPEN_EXISTING,
+                                FILE_ATTRIBUTE_NORMAL,
+                                nullptr)};
+        if (file == INVALID_HANDLE_VALUE)
+        {
+            throw std::runtime_error{filename + ": cannot open file"};
+        }
+        mFile = file;
+
+        LARGE_INTEGER size{};
+        if (!GetFileSizeEx(file, &size))
+        {
+            CloseHandle(file);
+            throw std::runtime_error{filename + ": cannot read file size"};
+        }
+
+        mSize = static_cast<std::size_t>(size.QuadPart);
+        if (mSize == 0)
+        {
+            return;
+        }
+
+        mMapping =
+            CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (mMapping != nullptr)
+        {
+            mData = static_cast<unsigned char const*>(
+                MapViewOfFile(mMapping, FILE_MAP_READ, 0, 0, 0));
+        }
+
+        if (mData == nullptr)
+        {
+            if (mMapping != nullptr)
+            {
+                CloseHandle(mMapping);
+            }
+            CloseHandle(file);
+            throw std::runtime_error{filename + ": cannot map file"};
+        }
+    }
+
+    MappedFile::~MappedFile()
+    {
+        if (mData != nullptr)
+        {
+            UnmapViewOfFile(mData);
+        }
+        if (mMapping != nullptr)
+        {
+            CloseHandle(mMapping);
+        }
+        CloseHandle(mFile);
+    }
+#else
+    MappedFile::MappedFile(std::string const& filename) :
+        mData{nullptr}, mSize{0}
+    {
+        const int file{open(filename.c_str(), O_RDONLY)};
+        if (file < 0)
+        {
+            throw std::runtime_error{filename + ": cannot open file"};
+        }
+
+        struct stat status{};
+        if (fstat(file, &status) != 0)
+        {
+            close(file);
+            throw std::runtime_error{filename + ": cannot read file size"};
+        }
+
+        mSize = static_cast<std::size_t>(status.st_size);
+        if (mSize > 0)
+        {
+            void* data{mmap(nullptr, mSize, PROT_READ, MAP_PRIVATE, file, 0)};
+            if (data == MAP_FAILED)
+            {
+                close(file);
+                throw std::runtime_error{filename + ": cannot map file"};
+            }
+            mData = static_cast<unsigned char const*>(data);
+        }
+
+        // the mapping stays valid after the file is closed
+        close(file);
+    }
+
+    MappedFile::~MappedFile()
+    {
+        if (mData != nullptr)
+        {
+            munmap(const_cast<unsigned char*>(mData), mSize);
+        }
+    }
+#endif
+
+    unsigned char const* MappedFile::getData() const
+    {
+        return mData;
+    }
+
+    std::size_t MappedFile::getSize() const
+    {
+        return mSize;
+    }
+} // namespace common
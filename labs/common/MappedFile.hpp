@@ -0,0 +1,35 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+namespace common
+{
+    // A whole file mapped read-only into memory. The OS only reads pages
+    // from disk as they are first touched, so opening a file costs the same
+    // whatever its size and data that is never used is never read.
+    class MappedFile
+    {
+    public:
+        // Throws std::runtime_error if the file can't be opened or mapped.
+        MappedFile(std::string const& filename);
+        ~MappedFile();
+
+        MappedFile(MappedFile const&) = delete;
+        MappedFile& operator=(MappedFile const&) = delete;
+
+        // page aligned, null for an empty file
+        unsigned char const* getData() const;
+
+        std::size_t getSize() const;
+
+    private:
+        unsigned char const* mData;
+        std::size_t mSize;
+
+#if defined(_WIN32)
+        void* mFile;
+        void* mMapping;
+#endif
+    };
+} // namespace common
@@ -0,0 +1,40 @@
+#include "Memory.hpp"
+
+#if defined(_WIN32)
+#    define NOMINMAX
+#    include <windows.h>
+#    include <psapi.h>
+#elif defined(__unix__) || defined(__APPLE__)
+#    include <sys/resource.h>
+#endif
+
+namespace common
+{
+    std::size_t getPeakRss()
+    {
+#if defined(_WIN32)
+        PROCESS_MEMORY_COUNTERS counters{};
+        if (!GetProcessMemoryInfo(
+                GetCurrentProcess(), &counters, sizeof(counters)))
+        {
+            return 0;
+        }
+        return counters.PeakWorkingSetSize;
+#elif defined(__unix__) || defined(__APPLE__)
+        rusage usage{};
+        if (getrusage(RUSAGE_SELF, &usage) != 0)
+        {
+            return 0;
+        }
+
+#    if defined(__APPLE__)
+        return static_cast<std::size_t>(usage.ru_maxrss);
+#    else
+        // Linux and the BSDs report kilobytes
+        return static_cast<std::size_t>(usage.ru_maxrss) * 1024;
+#    endif
+#else
+        return 0;
+#endif
+    }
+} // namespace common
@@ -0,0 +1,10 @@
+#pragma once
+
+#include <cstddef>
+
+namespace common
+{
+    // Largest resident set size the process has reached so far, in bytes.
+    // Returns 0 where the OS doesn't report it.
+    std::size_t getPeakRss();
+} // namespace common
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <cstdint>
+
+namespace common
+{
+    // Minimal PCG32 generator (O'Neill, pcg-random.org). The whole state is
+    // two 64-bit integers, so it is cheap to embed in per-thread or
+    // per-pixel structures and to re-seed often. Different streams with the
+    // same seed give independent sequences.
+    class Pcg32
+    {
+    public:
+        constexpr Pcg32() :
+            mState{0x853c49e6748fea9bull}, mInc{0xda3e39cb94b95bdbull}
+        {}
+
+        Pcg32(std::uint64_t seed, std::uint64_t stream)
+        {
+            setSeed(seed, stream);
+        }
+
+        void setSeed(std::uint64_t seed, std::uint64_t stream)
+        {
+            mState = 0;
+            mInc   = (stream << 1u) | 1u;
+            next();
+            mState += seed;
+            next();
+        }
+
+        std::uint32_t next()
+        {
+            const std::uint64_t old{mState};
+            mState = old * 6364136223846793005ull + mInc;
+
+            const auto xorShifted{
+                static_cast<std::uint32_t>(((old >> 18u) ^ old) >> 27u)};
+            const auto rot{static_cast<std::uint32_t>(old >> 59u)};
+            return (xorShifted >> rot) | (xorShifted << ((~rot + 1u) & 31u));
+        }
+
+        // Uniform integer in [0, bound) using Lemire's multiply-shift, which
+        // avoids the division of the usual modulo reduction.
+        std::uint32_t nextBounded(std::uint32_t bound)
+        {
+            return static_cast<std::uint32_t>(
+                (static_cast<std::uint64_t>(next()) * bound) >> 32u);
+        }
+
+        // Uniform float in [0, 1).
+        float nextFloat()
+        {
+            return static_cast<float>(next() >> 8u) * 0x1.0p-24f;
+        }
+
+    private:
+        std::uint64_t mState;
+        std::uint64_t mInc;
+    };
+} // namespace common
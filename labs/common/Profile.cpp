@@ -0,0 +1,132 @@
+#include "Profile.hpp"
+
+#if COMMON_PROFILE
+#    include <chrono>
+#    include <cstdio>
+#    include <memory>
+#    include <mutex>
+#    include <vector>
+
+namespace common
+{
+    namespace profile
+    {
+        namespace
+        {
+            char const* getStageName(std::size_t stage)
+            {
+                switch (static_cast<Stage>(stage))
+                {
+                case Stage::SampleUnitSquare:
+                    return "sampleUnitSquare";
+                case Stage::RayDirection:
+                    return "rayDirection";
+                case Stage::Hit:
+                    return "hit";
+                case Stage::Occluded:
+                    return "occluded";
+                case Stage::Shade:
+                    return "shade";
+                case Stage::SaveToFile:
+                    return "saveToFile";
+                default:
+                    return "unknown";
+                }
+            }
+
+            // Owns the counters of every thread that has recorded anything.
+            // It is created by the first registration and destroyed after
+            // main returns, by which point the workers have been joined, so
+            // the summary can read their counters without locking them.
+            class Registry
+            {
+            public:
+                Registry() :
+                    mStartTime{std::chrono::steady_clock::now()},
+                    mStartCycles{readCycles()}
+                {}
+
+                ~Registry()
+                {
+                    printSummary();
+                }
+
+                Counters& add()
+                {
+                    std::lock_guard<std::mutex> lock{mMutex};
+                    mThreads.push_back(std::make_unique<Counters>());
+                    return *mThreads.back();
+                }
+
+            private:
+                void printSummary() const
+                {
+                    const double seconds{
+                        std::chrono::duration<double>(
+                            std::chrono::steady_clock::now() - mStartTime)
+                            .count()};
+                    const double wallCycles{
+                        static_cast<double>(readCycles() - mStartCycles)};
+                    const double threadCycles{wallCycles * mThreads.size()};
+
+                    std::fprintf(stderr,
+                                 "profile: %zu thread(s), %.3f s\n",
+                                 mThreads.size(),
+                                 seconds);
+                    std::fprintf(stderr,
+                                 "%-18s %12s %14s %12s %8s\n",
+                                 "stage",
+                                 "calls",
+                                 "Mcycles",
+                                 "cycles/call",
+                                 "share");
+
+                    for (std::size_t i{0}; i < numStages; ++i)
+                    {
+                        std::uint64_t calls{0}, cycles{0};
+                        for (auto const& counters : mThreads)
+                        {
+                            calls += counters->calls[i];
+                            cycles += counters->cycles[i];
+                        }
+
+                        if (calls == 0)
+                        {
+                            continue;
+                        }
+
+                        // share of the time all recording threads were alive
+                        std::fprintf(
+                            stderr,
+                            "%-18s %12llu %14.2f %12.1f %7.1f%%\n",
+                            getStageName(i),
+                            static_cast<unsigned long long>(calls),
+                            cycles * 1.0e-6,
+                            static_cast<double>(cycles) / calls,
+                            threadCycles > 0.0
+                                ? 100.0 * cycles / threadCycles
+                                : 0.0);
+                    }
+                }
+
+                std::mutex mMutex;
+                std::vector<std::unique_ptr<Counters>> mThreads;
+                std::chrono::steady_clock::time_point mStartTime;
+                std::uint64_t mStartCycles;
+            };
+
+            Registry& getRegistry()
+            {
+                static Registry registry;
+                return registry;
+            }
+        } // namespace
+
+        Counters& getThreadCounters()
+        {
+            thread_local Counters& counters{getRegistry().add()};
+            return counters;
+        }
+    } // namespace profile
+} // namespace common
+#endif
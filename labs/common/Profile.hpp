@@ -0,0 +1,104 @@
+#pragma once
+
+// Optional per-stage instrumentation of the ray tracers' hot paths. When
+// COMMON_PROFILE is 1 (see the CSC305_PROFILE CMake option), every
+// COMMON_PROFILE_SCOPE counts one call and the cycles spent until the end of
+// the enclosing scope into counters owned by the calling thread, and a
+// summary of all threads is printed when the program exits. Otherwise the
+// macro expands to nothing and there is no cost at all.
+
+#ifndef COMMON_PROFILE
+#    define COMMON_PROFILE 0
+#endif
+
+#if COMMON_PROFILE
+#    include <cstddef>
+#    include <cstdint>
+
+#    if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || \
+        defined(_M_IX86)
+#        if defined(_MSC_VER)
+#            include <intrin.h>
+#        else
+#            include <x86intrin.h>
+#        endif
+#        define COMMON_PROFILE_RDTSC 1
+#    else
+#        include <chrono>
+#        define COMMON_PROFILE_RDTSC 0
+#    endif
+#endif
+
+namespace common
+{
+    enum class Stage
+    {
+        SampleUnitSquare,
+        RayDirection,
+        Hit,
+        Occluded,
+        Shade,
+        SaveToFile,
+        Count
+    };
+
+#if COMMON_PROFILE
+    namespace profile
+    {
+        constexpr std::size_t numStages{static_cast<std::size_t>(Stage::Count)};
+
+        struct Counters
+        {
+            std::uint64_t calls[numStages];
+            std::uint64_t cycles[numStages];
+        };
+
+        // The calling thread's counters, registered for the exit summary the
+        // first time a thread asks for them.
+        Counters& getThreadCounters();
+
+        // Time stamp counter on x86, nanoseconds elsewhere.
+        inline std::uint64_t readCycles()
+        {
+#    if COMMON_PROFILE_RDTSC
+            return __rdtsc();
+#    else
+            return static_cast<std::uint64_t>(
+                std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    std::chrono::steady_clock::now().time_since_epoch())
+                    .count());
+#    endif
+        }
+    } // namespace profile
+
+    class ScopedStage
+    {
+    public:
+        explicit ScopedStage(Stage stage) :
+            mIndex{static_cast<std::size_t>(stage)},
+            mStart{profile::readCycles()}
+        {}
+
+        ~ScopedStage()
+        {
+            auto& counters{profile::getThreadCounters()};
+            counters.cycles[mIndex] += profile::readCycles() - mStart;
+            ++counters.calls[mIndex];
+        }
+
+        ScopedStage(ScopedStage const&) = delete;
+        ScopedStage& operator=(ScopedStage const&) = delete;
+
+    private:
+        std::size_t mIndex;
+        std::uint64_t mStart;
+    };
+#endif
+} // namespace common
+
+#if COMMON_PROFILE
+#    define COMMON_PROFILE_SCOPE(stage) \
+        ::common::ScopedStage commonProfileScope{::common::Stage::stage}
+#else
+#    define COMMON_PROFILE_SCOPE(stage)
+#endif
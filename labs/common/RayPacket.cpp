@@ -0,0 +1,109 @@
+#include "RayPacket.hpp"
+#include "Cpu.hpp"
+
+#include <algorithm>
+
+#if COMMON_X86
+#    include <immintrin.h>
+#endif
+
+namespace common
+{
+    namespace
+    {
+        bool intersectsPacketScalar(BBox const& box, RayPacket const& packet)
+        {
+            for (std::size_t i{0}; i < packet.size; ++i)
+            {
+                const atlas::math::Ray<atlas::math::Vector> ray{
+                    {packet.ox[i], packet.oy[i], packet.oz[i]},
+                    {packet.dx[i], packet.dy[i], packet.dz[i]}};
+                const atlas::math::Vector invDir{
+                    packet.invDx[i], packet.invDy[i], packet.invDz[i]};
+                const int dirIsNeg[3]{
+                    invDir.x < 0.0f, invDir.y < 0.0f, invDir.z < 0.0f};
+
+                if (box.intersect(ray, invDir, dirIsNeg, packet.tMax[i]))
+                {
+                    return true;
+                }
+            }
+
+            return false;
+        }
+
+#if COMMON_X86
+        // Slab test for 8 rays at once. min/max return their second operand
+        // when the first is NaN, so an axis that yields NaN (origin on a slab
+        // of an axis the ray is parallel to) is ignored, which keeps the test
+        // conservative like BBox::intersect.
+        COMMON_TARGET_AVX2 bool intersectsPacketAvx2(BBox const& box,
+                                                     RayPacket const& packet)
+        {
+            const __m256 lowerX{_mm256_set1_ps(box.lower.x)};
+            const __m256 lowerY{_mm256_set1_ps(box.lower.y)};
+            const __m256 lowerZ{_mm256_set1_ps(box.lower.z)};
+            const __m256 upperX{_mm256_set1_ps(box.upper.x)};
+            const __m256 upperY{_mm256_set1_ps(box.upper.y)};
+            const __m256 upperZ{_mm256_set1_ps(box.upper.z)};
+            const __m256 zero{_mm256_setzero_ps()};
+
+            for (std::size_t i{0}; i < packet.paddedSize();
+                 i += RayPacket::laneWidth)
+            {
+                const __m256 ox{_mm256_load_ps(packet.ox + i)};
+                const __m256 oy{_mm256_load_ps(packet.oy + i)};
+                const __m256 oz{_mm256_load_ps(packet.oz + i)};
+                const __m256 invDx{_mm256_load_ps(packet.invDx + i)};
+                const __m256 invDy{_mm256_load_ps(packet.invDy + i)};
+                const __m256 invDz{_mm256_load_ps(packet.invDz + i)};
+
+                const __m256 x0{
+                    _mm256_mul_ps(_mm256_sub_ps(lowerX, ox), invDx)};
+                const __m256 x1{
+                    _mm256_mul_ps(_mm256_sub_ps(upperX, ox), invDx)};
+                const __m256 y0{
+                    _mm256_mul_ps(_mm256_sub_ps(lowerY, oy), invDy)};
+                const __m256 y1{
+                    _mm256_mul_ps(_mm256_sub_ps(upperY, oy), invDy)};
+                const __m256 z0{
+                    _mm256_mul_ps(_mm256_sub_ps(lowerZ, oz), invDz)};
+                const __m256 z1{
+                    _mm256_mul_ps(_mm256_sub_ps(upperZ, oz), invDz)};
+
+                const __m256 enter{_mm256_max_ps(
+                    _mm256_max_ps(_mm256_min_ps(x0, x1), _mm256_min_ps(y0, y1)),
+                    _mm256_min_ps(z0, z1))};
+                const __m256 exit{_mm256_min_ps(
+                    _mm256_min_ps(_mm256_max_ps(x0, x1), _mm256_max_ps(y0, y1)),
+                    _mm256_max_ps(z0, z1))};
+
+                const __m256 hit{_mm256_and_ps(
+                    _mm256_and_ps(_mm256_cmp_ps(enter, exit, _CMP_LE_OQ),
+                                  _mm256_cmp_ps(exit, zero, _CMP_GT_OQ)),
+                    _mm256_cmp_ps(
+                        enter, _mm256_load_ps(packet.tMax + i), _CMP_LT_OQ))};
+
+                if (_mm256_movemask_ps(hit) != 0)
+                {
+                    return true;
+                }
+            }
+
+            return false;
+        }
+#endif
+    } // namespace
+
+    bool intersectsPacket(BBox const& box, RayPacket const& packet)
+    {
+#if COMMON_X86
+        static const bool useAvx2{getSimdLevel() == SimdLevel::Avx2};
+        if (useAvx2)
+        {
+            return intersectsPacketAvx2(box, packet);
+        }
+#endif
+        return intersectsPacketScalar(box, packet);
+    }
+} // namespace common
@@ -0,0 +1,91 @@
+#pragma once
+
+#include "BBox.hpp"
+
+#include <atlas/math/Ray.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+
+namespace common
+{
+    // A group of up to 64 rays stored as a structure of arrays, so that the
+    // packet kernels can process 8 rays per AVX2 instruction. Packets are
+    // meant for coherent rays (e.g. the primary rays of a pixel block), which
+    // visit mostly the same nodes and leaves.
+    struct RayPacket
+    {
+        static constexpr std::size_t maxSize{64};
+        static constexpr std::size_t laneWidth{8};
+
+        std::size_t size;
+
+        alignas(32) float ox[maxSize];
+        alignas(32) float oy[maxSize];
+        alignas(32) float oz[maxSize];
+        alignas(32) float dx[maxSize];
+        alignas(32) float dy[maxSize];
+        alignas(32) float dz[maxSize];
+        alignas(32) float invDx[maxSize];
+        alignas(32) float invDy[maxSize];
+        alignas(32) float invDz[maxSize];
+
+        // closest hit so far, written by the traversal
+        alignas(32) float tMax[maxSize];
+        alignas(32) std::int32_t hit[maxSize];
+
+        void clear()
+        {
+            size = 0;
+        }
+
+        void add(atlas::math::Ray<atlas::math::Vector> const& ray)
+        {
+            set(size++, ray, std::numeric_limits<float>::max());
+        }
+
+        // Number of rays rounded up to whole SIMD groups.
+        std::size_t paddedSize() const
+        {
+            return (size + laneWidth - 1) / laneWidth * laneWidth;
+        }
+
+        // Fills the lanes between size and paddedSize() so the kernels can
+        // always work on whole groups. The extra lanes repeat the first ray
+        // with an empty interval, so they never hit anything.
+        void padLanes()
+        {
+            const atlas::math::Ray<atlas::math::Vector> first{
+                {ox[0], oy[0], oz[0]}, {dx[0], dy[0], dz[0]}};
+
+            for (std::size_t i{size}; i < paddedSize(); ++i)
+            {
+                set(i, first, -std::numeric_limits<float>::infinity());
+            }
+        }
+
+    private:
+        void set(std::size_t i,
+                 atlas::math::Ray<atlas::math::Vector> const& ray,
+                 float t)
+        {
+            ox[i]    = ray.o.x;
+            oy[i]    = ray.o.y;
+            oz[i]    = ray.o.z;
+            dx[i]    = ray.d.x;
+            dy[i]    = ray.d.y;
+            dz[i]    = ray.d.z;
+            invDx[i] = 1.0f / ray.d.x;
+            invDy[i] = 1.0f / ray.d.y;
+            invDz[i] = 1.0f / ray.d.z;
+            tMax[i]  = t;
+            hit[i]   = -1;
+        }
+    };
+
+    // True if any ray of the packet enters the box before its tMax. This is
+    // the shared culling test: a node is skipped only when no ray needs it.
+    // The packet must have been padded with padLanes.
+    bool intersectsPacket(BBox const& box, RayPacket const& packet);
+} // namespace common
@@ -0,0 +1,45 @@
+#include "SampleSets.hpp"
+
+namespace common
+{
+    namespace
+    {
+        constexpr std::size_t cacheLine{64};
+        constexpr std::size_t samplesPerLine{cacheLine / sizeof(Sample2D)};
+    } // namespace
+
+    SampleSets::SampleSets() : mStride{0}, mNumSamples{0}, mNumSets{0}
+    {}
+
+    void SampleSets::pack(std::vector<Sample2D> const& samples,
+                          std::vector<std::uint16_t> const& shuffle,
+                          std::size_t numSamples,
+                          std::size_t numSets)
+    {
+        mNumSamples = numSamples;
+        mNumSets    = numSets;
+        mStride =
+            (numSamples + samplesPerLine - 1) / samplesPerLine * samplesPerLine;
+
+        mSamples.assign(mStride * numSets, Sample2D{0.0f, 0.0f});
+        for (std::size_t set{0}; set < numSets; ++set)
+        {
+            const std::size_t first{set * numSamples};
+            for (std::size_t i{0}; i < numSamples; ++i)
+            {
+                mSamples[set * mStride + i] =
+                    samples[first + shuffle[first + i]];
+            }
+        }
+    }
+
+    std::size_t SampleSets::getNumSamples() const
+    {
+        return mNumSamples;
+    }
+
+    std::size_t SampleSets::getNumSets() const
+    {
+        return mNumSets;
+    }
+} // namespace common
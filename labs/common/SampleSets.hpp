@@ -0,0 +1,77 @@
+#pragma once
+
+#include "AlignedAllocator.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace common
+{
+    // A point in the unit square. Samplers only ever hand out 2D points, so
+    // this is 8 bytes where an atlas::math::Point would be 12.
+    struct Sample2D
+    {
+        float x, y;
+    };
+
+    static_assert(sizeof(Sample2D) == 8, "Sample2D must be two packed floats");
+
+    // A contiguous run of samples, e.g. all the samples of one pixel.
+    struct SampleSpan
+    {
+        Sample2D const* begin() const
+        {
+            return first;
+        }
+
+        Sample2D const* end() const
+        {
+            return first + size;
+        }
+
+        Sample2D const& operator[](std::size_t i) const
+        {
+            return first[i];
+        }
+
+        Sample2D const* first;
+        std::size_t size;
+    };
+
+    // The sample sets of a sampler, laid out for rendering. Every set is
+    // stored already shuffled, in the order its samples are handed out, and
+    // starts on a cache line, so drawing a set reads one contiguous block
+    // instead of gathering through an index table.
+    class SampleSets
+    {
+    public:
+        SampleSets();
+
+        // Packs numSets sets of numSamples samples, stored one set after the
+        // other in samples. Sample i of packed set s is
+        // samples[s * numSamples + shuffle[s * numSamples + i]].
+        void pack(std::vector<Sample2D> const& samples,
+                  std::vector<std::uint16_t> const& shuffle,
+                  std::size_t numSamples,
+                  std::size_t numSets);
+
+        std::size_t getNumSamples() const;
+
+        std::size_t getNumSets() const;
+
+        SampleSpan getSet(std::size_t set) const
+        {
+            return {mSamples.data() + set * mStride, mNumSamples};
+        }
+
+    private:
+        AlignedVector<Sample2D> mSamples;
+
+        // samples from the start of one set to the next, a whole number of
+        // cache lines
+        std::size_t mStride;
+        std::size_t mNumSamples;
+        std::size_t mNumSets;
+    };
+} // namespace common
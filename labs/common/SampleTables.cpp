@@ -0,0 +1,274 @@
+#include "SampleTables.hpp"
+
+#include "Pcg32.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <mutex>
+#include <tuple>
+
+namespace common
+{
+    namespace
+    {
+        // largest float below 1, the tables live in [0, 1)
+        constexpr float oneMinusEpsilon{0x1.fffffep-1f};
+
+        float toUnit(std::uint32_t bits)
+        {
+            return static_cast<float>(bits >> 8u) * 0x1.0p-24f;
+        }
+
+        float clampUnit(float x)
+        {
+            return std::min(x, oneMinusEpsilon);
+        }
+
+        // Splits numSamples into an m x n grid that is as square as possible.
+        void factor(int numSamples, int& m, int& n)
+        {
+            m = static_cast<int>(std::sqrt(static_cast<float>(numSamples)));
+            while (m > 1 && numSamples % m != 0)
+            {
+                --m;
+            }
+            m = std::max(m, 1);
+            n = numSamples / m;
+        }
+
+        std::uint32_t reverseBits(std::uint32_t x)
+        {
+            x = (x << 16u) | (x >> 16u);
+            x = ((x & 0x00ff00ffu) << 8u) | ((x & 0xff00ff00u) >> 8u);
+            x = ((x & 0x0f0f0f0fu) << 4u) | ((x & 0xf0f0f0f0u) >> 4u);
+            x = ((x & 0x33333333u) << 2u) | ((x & 0xccccccccu) >> 2u);
+            x = ((x & 0x55555555u) << 1u) | ((x & 0xaaaaaaaau) >> 1u);
+            return x;
+        }
+
+        // second Sobol dimension, direction numbers from x + 1
+        std::uint32_t sobol2(std::uint32_t i)
+        {
+            std::uint32_t r{0};
+            for (std::uint32_t v{1u << 31u}; i != 0; i >>= 1u, v ^= v >> 1u)
+            {
+                if (i & 1u)
+                {
+                    r ^= v;
+                }
+            }
+            return r;
+        }
+
+        // Kensler, "Correlated Multi-Jittered Sampling", 2013: a hashed
+        // permutation of [0, l) and a hashed float in [0, 1), both keyed on p
+        std::uint32_t permute(std::uint32_t i, std::uint32_t l, std::uint32_t p)
+        {
+            std::uint32_t w{l - 1};
+            w |= w >> 1u;
+            w |= w >> 2u;
+            w |= w >> 4u;
+            w |= w >> 8u;
+            w |= w >> 16u;
+
+            do
+            {
+                i ^= p;
+                i *= 0xe170893du;
+                i ^= p >> 16u;
+                i ^= (i & w) >> 4u;
+                i ^= p >> 8u;
+                i *= 0x0929eb3fu;
+                i ^= p >> 23u;
+                i ^= (i & w) >> 1u;
+                i *= 1u | p >> 27u;
+                i *= 0x6935fa69u;
+                i ^= (i & w) >> 11u;
+                i *= 0x74dcb303u;
+                i ^= (i & w) >> 2u;
+                i *= 0x9e501cc3u;
+                i ^= (i & w) >> 2u;
+                i *= 0xc860a3dfu;
+                i &= w;
+                i ^= i >> 5u;
+            } while (i >= l);
+
+            return (i + p) % l;
+        }
+
+        float randomFloat(std::uint32_t i, std::uint32_t p)
+        {
+            i ^= p;
+            i ^= i >> 17u;
+            i ^= i >> 10u;
+            i *= 0xb36534e5u;
+            i ^= i >> 12u;
+            i ^= i >> 21u;
+            i *= 0x93fc4795u;
+            i ^= 0xdf6e307fu;
+            i ^= i >> 17u;
+            i *= 1u | p >> 18u;
+            return toUnit(i);
+        }
+
+        void addJittered(SampleTable& table, int numSamples, Pcg32& rng)
+        {
+            int m, n;
+            factor(numSamples, m, n);
+
+            for (int j{0}; j < n; ++j)
+            {
+                for (int i{0}; i < m; ++i)
+                {
+                    const float x{(i + rng.nextFloat()) / m};
+                    const float y{(j + rng.nextFloat()) / n};
+                    table.push_back({clampUnit(x), clampUnit(y)});
+                }
+            }
+        }
+
+        void addMultiJittered(SampleTable& table, int numSamples, Pcg32& rng)
+        {
+            int m, n;
+            factor(numSamples, m, n);
+
+            const auto um{static_cast<std::uint32_t>(m)};
+            const auto un{static_cast<std::uint32_t>(n)};
+            const std::uint32_t p{rng.next()};
+            for (std::uint32_t s{0}; s < um * un; ++s)
+            {
+                const std::uint32_t sx{permute(s % um, um, p * 0xa511e9b3u)};
+                const std::uint32_t sy{permute(s / um, un, p * 0x63d83595u)};
+                const float jx{randomFloat(s, p * 0xa399d265u)};
+                const float jy{randomFloat(s, p * 0x711ad6a5u)};
+
+                const float x{(s % um + (sy + jx) / n) / m};
+                const float y{(s / um + (sx + jy) / m) / n};
+                table.push_back({clampUnit(x), clampUnit(y)});
+            }
+        }
+
+        void addHammersley(SampleTable& table, int numSamples, Pcg32& rng)
+        {
+            const float shift{rng.nextFloat()};
+            const std::uint32_t scramble{rng.next()};
+
+            for (int i{0}; i < numSamples; ++i)
+            {
+                float x{static_cast<float>(i) / numSamples + shift};
+                x -= std::floor(x);
+                const float y{toUnit(
+                    reverseBits(static_cast<std::uint32_t>(i)) ^ scramble)};
+                table.push_back({clampUnit(x), y});
+            }
+        }
+
+        void addSobol(SampleTable& table, int numSamples, Pcg32& rng)
+        {
+            const std::uint32_t scrambleX{rng.next()};
+            const std::uint32_t scrambleY{rng.next()};
+
+            for (int i{0}; i < numSamples; ++i)
+            {
+                const auto index{static_cast<std::uint32_t>(i)};
+                table.push_back({toUnit(reverseBits(index) ^ scrambleX),
+                                 toUnit(sobol2(index) ^ scrambleY)});
+            }
+        }
+
+        void addR2(SampleTable& table, int numSamples, Pcg32& rng)
+        {
+            // the plastic number is the real root of x^3 = x + 1
+            constexpr double g{1.32471795724474602596};
+            constexpr double a1{1.0 / g};
+            constexpr double a2{1.0 / (g * g)};
+
+            const double ox{rng.nextFloat()};
+            const double oy{rng.nextFloat()};
+            for (int i{0}; i < numSamples; ++i)
+            {
+                double x{0.5 + a1 * i + ox};
+                double y{0.5 + a2 * i + oy};
+                x -= std::floor(x);
+                y -= std::floor(y);
+                table.push_back({clampUnit(static_cast<float>(x)),
+                                 clampUnit(static_cast<float>(y))});
+            }
+        }
+
+        SampleTable buildTable(SampleSequence sequence,
+                               int numSamples,
+                               int numSets,
+                               std::uint64_t seed)
+        {
+            SampleTable table;
+            table.reserve(static_cast<std::size_t>(numSamples) * numSets);
+
+            Pcg32 rng{seed, static_cast<std::uint64_t>(sequence) + 1};
+            for (int set{0}; set < numSets; ++set)
+            {
+                switch (sequence)
+                {
+                case SampleSequence::Jittered:
+                    addJittered(table, numSamples, rng);
+                    break;
+                case SampleSequence::MultiJittered:
+                    addMultiJittered(table, numSamples, rng);
+                    break;
+                case SampleSequence::Hammersley:
+                    addHammersley(table, numSamples, rng);
+                    break;
+                case SampleSequence::Sobol:
+                    addSobol(table, numSamples, rng);
+                    break;
+                case SampleSequence::R2:
+                    addR2(table, numSamples, rng);
+                    break;
+                }
+            }
+
+            return table;
+        }
+    } // namespace
+
+    std::shared_ptr<SampleTable const> getSampleTable(SampleSequence sequence,
+                                                      int numSamples,
+                                                      int numSets,
+                                                      std::uint64_t seed)
+    {
+        using Key = std::tuple<SampleSequence, int, int, std::uint64_t>;
+
+        static std::mutex mutex;
+        static std::map<Key, std::shared_ptr<SampleTable const>> tables;
+
+        std::lock_guard<std::mutex> lock{mutex};
+        auto& table{tables[Key{sequence, numSamples, numSets, seed}]};
+        if (!table)
+        {
+            table = std::make_shared<SampleTable const>(
+                buildTable(sequence, numSamples, numSets, seed));
+        }
+
+        return table;
+    }
+
+    char const* getSampleSequenceName(SampleSequence sequence)
+    {
+        switch (sequence)
+        {
+        case SampleSequence::Jittered:
+            return "jittered";
+        case SampleSequence::MultiJittered:
+            return "multi-jittered";
+        case SampleSequence::Hammersley:
+            return "hammersley";
+        case SampleSequence::Sobol:
+            return "sobol";
+        case SampleSequence::R2:
+            return "r2";
+        default:
+            return "unknown";
+        }
+    }
+} // namespace common
@@ -0,0 +1,51 @@
+#pragma once
+
+#include "SampleSets.hpp"
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace common
+{
+    enum class SampleSequence
+    {
+        // one random point in each cell of an m x n grid
+        Jittered,
+
+        // jittered, and also stratified in x and y on their own (Kensler's
+        // correlated multi-jittered pattern)
+        MultiJittered,
+
+        // (i / N, base 2 radical inverse of i)
+        Hammersley,
+
+        // the first two dimensions of the Sobol sequence
+        Sobol,
+
+        // Roberts' additive recurrence based on the plastic number
+        R2
+    };
+
+    // numSets sets of numSamples points in [0, 1)^2, stored one set after
+    // the other.
+    using SampleTable = std::vector<Sample2D>;
+
+    // Every set is the same pattern randomised differently: a fresh jitter
+    // or permutation for the stratified patterns, a random digital shift for
+    // Hammersley and Sobol, and a random toroidal shift for R2. A table is a
+    // pure function of its arguments, so it is built the first time it is
+    // asked for and the same table is handed to every later caller, from
+    // any thread.
+    //
+    // Tables are never evicted: every distinct set of arguments keeps its
+    // table in memory until the program exits, which is fine for the few
+    // sampler settings a program uses but not for an unbounded stream of
+    // seeds.
+    std::shared_ptr<SampleTable const> getSampleTable(SampleSequence sequence,
+                                                      int numSamples,
+                                                      int numSets,
+                                                      std::uint64_t seed);
+
+    char const* getSampleSequenceName(SampleSequence sequence);
+} // namespace common
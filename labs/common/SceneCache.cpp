@@ -0,0 +1,199 @@
+#include "SceneCache.hpp"
+
+#include <cstring>
+#include <fstream>
+
+namespace common
+{
+    namespace
+    {
+        constexpr char magic[8]{'C', 'S', 'C', '3', '0', '5', 'S', 'C'};
+        constexpr std::size_t alignment{64};
+
+        std::size_t alignUp(std::size_t offset)
+        {
+            return (offset + alignment - 1) / alignment * alignment;
+        }
+
+        std::size_t getTableEnd(std::size_t numSections)
+        {
+            return alignUp(sizeof(cache::Header) +
+                           numSections * sizeof(cache::Section));
+        }
+
+        std::uint64_t getHeaderChecksum(cache::Header header,
+                                        cache::Section const* sections)
+        {
+            header.headerChecksum = 0;
+            const std::uint64_t h{cache::checksum(
+                reinterpret_cast<unsigned char const*>(&header),
+                sizeof(header))};
+            return h ^ cache::checksum(
+                           reinterpret_cast<unsigned char const*>(sections),
+                           header.numSections * sizeof(cache::Section));
+        }
+
+        // MappedFile reports its errors as plain runtime errors
+        MappedFile mapFile(std::string const& filename)
+        {
+            try
+            {
+                return MappedFile{filename};
+            }
+            catch (std::runtime_error const& error)
+            {
+                throw SceneError{error.what()};
+            }
+        }
+    } // namespace
+
+    namespace cache
+    {
+        std::uint64_t checksum(unsigned char const* data, std::size_t size)
+        {
+            constexpr std::uint64_t multiplier{0x9e3779b97f4a7c15ull};
+
+            std::uint64_t h{size * multiplier};
+            std::size_t i{0};
+            for (; i + 8 <= size; i += 8)
+            {
+                std::uint64_t word;
+                std::memcpy(&word, data + i, 8);
+                h = (h ^ word) * multiplier;
+                h ^= h >> 29u;
+            }
+
+            if (i < size)
+            {
+                std::uint64_t tail{0};
+                std::memcpy(&tail, data + i, size - i);
+                h = (h ^ tail) * multiplier;
+            }
+            return h ^ (h >> 32u);
+        }
+    } // namespace cache
+
+    void SceneCacheWriter::write(std::string const& filename,
+                                 std::uint32_t version) const
+    {
+        cache::Header header{};
+        std::memcpy(header.magic, magic, sizeof(magic));
+        header.version     = version;
+        header.numSections = static_cast<std::uint32_t>(mSections.size());
+
+        std::vector<cache::Section> table(mSections.size());
+        std::size_t offset{getTableEnd(mSections.size())};
+        for (std::size_t i{0}; i < mSections.size(); ++i)
+        {
+            table[i] = {offset, mSections[i].size};
+            offset   = alignUp(offset + mSections[i].size);
+        }
+        header.fileSize = offset;
+
+        // the whole payload is assembled first so the checksum can go in
+        // the header, ahead of it
+        const std::size_t payloadStart{getTableEnd(mSections.size())};
+        std::vector<unsigned char> payload(offset - payloadStart, 0);
+        for (std::size_t i{0}; i < mSections.size(); ++i)
+        {
+            if (mSections[i].size > 0)
+            {
+                std::memcpy(payload.data() + table[i].offset - payloadStart,
+                            mSections[i].first,
+                            mSections[i].size);
+            }
+        }
+
+        header.payloadChecksum =
+            cache::checksum(payload.data(), payload.size());
+        header.headerChecksum  = getHeaderChecksum(header, table.data());
+
+        std::vector<unsigned char> start(payloadStart, 0);
+        std::memcpy(start.data(), &header, sizeof(header));
+        std::memcpy(start.data() + sizeof(header),
+                    table.data(),
+                    table.size() * sizeof(cache::Section));
+
+        std::ofstream file{filename, std::ios::binary};
+        file.write(reinterpret_cast<char const*>(start.data()),
+                   static_cast<std::streamsize>(start.size()));
+        file.write(reinterpret_cast<char const*>(payload.data()),
+                   static_cast<std::streamsize>(payload.size()));
+        if (!file)
+        {
+            throw SceneError{filename + ": cannot write file"};
+        }
+    }
+
+    SceneCache::SceneCache(std::string const& filename,
+                           std::uint32_t version) :
+        mFilename{filename},
+        mFile{mapFile(filename)},
+        mHeader{nullptr},
+        mSections{nullptr}
+    {
+        if (mFile.getSize() < sizeof(cache::Header) ||
+            std::memcmp(mFile.getData(), magic, sizeof(magic)) != 0)
+        {
+            fail("not a scene cache");
+        }
+
+        mHeader = reinterpret_cast<cache::Header const*>(mFile.getData());
+        if (mHeader->version != version)
+        {
+            fail("written with version " + std::to_string(mHeader->version) +
+                 ", expected " + std::to_string(version));
+        }
+
+        if (mFile.getSize() < getTableEnd(mHeader->numSections) ||
+            mHeader->fileSize != mFile.getSize())
+        {
+            fail("truncated file");
+        }
+
+        mSections = reinterpret_cast<cache::Section const*>(
+            mFile.getData() + sizeof(cache::Header));
+        if (getHeaderChecksum(*mHeader, mSections) != mHeader->headerChecksum)
+        {
+            fail("damaged header");
+        }
+
+        for (std::size_t i{0}; i < mHeader->numSections; ++i)
+        {
+            if (mSections[i].offset % alignment != 0 ||
+                mSections[i].offset > mHeader->fileSize ||
+                mSections[i].size > mHeader->fileSize - mSections[i].offset)
+            {
+                fail("section " + std::to_string(i) + " is out of bounds");
+            }
+        }
+    }
+
+    bool SceneCache::verify() const
+    {
+        const std::size_t payloadStart{getTableEnd(mHeader->numSections)};
+        return cache::checksum(mFile.getData() + payloadStart,
+                               mFile.getSize() - payloadStart) ==
+               mHeader->payloadChecksum;
+    }
+
+    std::size_t SceneCache::getNumSections() const
+    {
+        return mHeader->numSections;
+    }
+
+    Span<unsigned char> SceneCache::getBytes(std::size_t i) const
+    {
+        if (i >= mHeader->numSections)
+        {
+            fail("no section " + std::to_string(i));
+        }
+        return {mFile.getData() + mSections[i].offset,
+                static_cast<std::size_t>(mSections[i].size)};
+    }
+
+    void SceneCache::fail(std::string const& message) const
+    {
+        throw SceneError{mFilename + ": " + message};
+    }
+} // namespace common
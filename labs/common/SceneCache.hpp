@@ -0,0 +1,116 @@
+#pragma once
+
+#include "MappedFile.hpp"
+#include "SceneReader.hpp"
+#include "Span.hpp"
+
+#include <cstdint>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+namespace common
+{
+    // Binary scene caches: a header followed by a list of flat arrays
+    // ("sections"), each starting on a cache line. What the sections hold
+    // is up to the caller, which refers to them by their position in the
+    // list. A cache is memory-mapped and its arrays are used in place, so
+    // opening one costs the same whatever the size of the scene and
+    // nothing is parsed or allocated per object.
+    //
+    // The arrays are stored in the native byte order and struct layout, so
+    // a cache is only meant to be read back on the kind of machine that
+    // wrote it, by a program built from the same sources. The version
+    // passed to the writer and the reader guards against the latter.
+    namespace cache
+    {
+        struct Header
+        {
+            char magic[8];
+            std::uint32_t version;
+            std::uint32_t numSections;
+            std::uint64_t fileSize;
+
+            // over everything after the section table
+            std::uint64_t payloadChecksum;
+
+            // over the header, with this field set to 0, and the section
+            // table
+            std::uint64_t headerChecksum;
+        };
+
+        struct Section
+        {
+            std::uint64_t offset;
+            std::uint64_t size;
+        };
+
+        // 64-bit multiply-xorshift hash. Not cryptographic, only meant to
+        // catch truncated or damaged files.
+        std::uint64_t checksum(unsigned char const* data, std::size_t size);
+    } // namespace cache
+
+    class SceneCacheWriter
+    {
+    public:
+        // Appends count elements as the next section. The data is only
+        // copied when write is called, so it has to stay alive until then.
+        template<typename T>
+        void addSection(T const* data, std::size_t count)
+        {
+            static_assert(std::is_trivially_copyable_v<T>,
+                          "sections are copied as raw bytes");
+            mSections.push_back(
+                {reinterpret_cast<unsigned char const*>(data),
+                 count * sizeof(T)});
+        }
+
+        // Throws SceneError if the file can't be written.
+        void write(std::string const& filename, std::uint32_t version) const;
+
+    private:
+        std::vector<Span<unsigned char>> mSections;
+    };
+
+    class SceneCache
+    {
+    public:
+        // Maps the file and checks its header and section table, which takes
+        // the same time whatever the size of the file. Throws SceneError if
+        // the file isn't a scene cache, was written with another version or
+        // is truncated.
+        SceneCache(std::string const& filename, std::uint32_t version);
+
+        // Checks the checksum of the sections. This reads the whole file,
+        // so it is left to the caller to decide when it is worth it.
+        bool verify() const;
+
+        std::size_t getNumSections() const;
+
+        // Throws SceneError if there is no such section or its size isn't a
+        // whole number of Ts.
+        template<typename T>
+        Span<T> getSection(std::size_t i) const
+        {
+            static_assert(std::is_trivially_copyable_v<T>,
+                          "sections are copied as raw bytes");
+            const Span<unsigned char> bytes{getBytes(i)};
+            if (bytes.size % sizeof(T) != 0)
+            {
+                fail("section " + std::to_string(i) + " has the wrong size");
+            }
+            return {reinterpret_cast<T const*>(bytes.first),
+                    bytes.size / sizeof(T)};
+        }
+
+    private:
+        Span<unsigned char> getBytes(std::size_t i) const;
+
+        [[noreturn]] void fail(std::string const& message) const;
+
+        std::string mFilename;
+        MappedFile mFile;
+        cache::Header const* mHeader;
+        cache::Section const* mSections;
+    };
+} // namespace common
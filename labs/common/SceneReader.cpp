@@ -0,0 +1,207 @@
+#include "SceneReader.hpp"
+
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <cstring>
+
+namespace common
+{
+    namespace
+    {
+        constexpr std::size_t bufferSize{1 << 20};
+        constexpr std::size_t maxTokenSize{256};
+
+        enum CharClass : unsigned char
+        {
+            Token,
+            Blank,
+            Newline,
+            Comment
+        };
+
+        constexpr std::array<CharClass, 256> makeCharClasses()
+        {
+            std::array<CharClass, 256> classes{};
+            classes[' ']  = Blank;
+            classes['\t'] = Blank;
+            classes['\r'] = Blank;
+            classes['\n'] = Newline;
+            classes['#']  = Comment;
+            return classes;
+        }
+
+        // one lookup per character rather than a chain of comparisons
+        constexpr std::array<CharClass, 256> charClasses{makeCharClasses()};
+
+        CharClass classOf(char c)
+        {
+            return charClasses[static_cast<unsigned char>(c)];
+        }
+    } // namespace
+
+    SceneReader::SceneReader(std::string const& filename) :
+        mFilename{filename},
+        mFile{std::fopen(filename.c_str(), "rb")},
+        mBuffer(bufferSize),
+        mPos{0},
+        mEnd{0},
+        mLine{1},
+        mInStatement{false}
+    {
+        if (mFile == nullptr)
+        {
+            throw SceneError{filename + ": cannot open file"};
+        }
+    }
+
+    SceneReader::~SceneReader()
+    {
+        std::fclose(mFile);
+    }
+
+    bool SceneReader::nextStatement()
+    {
+        if (mInStatement && !isEndOfStatement())
+        {
+            fail("unexpected '" + std::string{readWord()} + "'");
+        }
+
+        while (true)
+        {
+            skipBlanks();
+            if (mPos == mEnd)
+            {
+                mInStatement = false;
+                return false;
+            }
+
+            if (mBuffer[mPos] != '\n')
+            {
+                mInStatement = true;
+                return true;
+            }
+
+            ++mPos;
+            ++mLine;
+        }
+    }
+
+    bool SceneReader::isEndOfStatement()
+    {
+        skipBlanks();
+        return mPos == mEnd || mBuffer[mPos] == '\n';
+    }
+
+    std::string_view SceneReader::readWord()
+    {
+        return readToken("a name");
+    }
+
+    float SceneReader::readFloat()
+    {
+        const std::string_view token{readToken("a number")};
+
+        float value{};
+        auto [end, error]{
+            std::from_chars(token.data(), token.data() + token.size(), value)};
+        if (error != std::errc{} || end != token.data() + token.size())
+        {
+            fail("expected a number, got '" + std::string{token} + "'");
+        }
+        return value;
+    }
+
+    std::uint32_t SceneReader::readUnsigned()
+    {
+        const std::string_view token{readToken("an integer")};
+
+        std::uint32_t value{};
+        auto [end, error]{
+            std::from_chars(token.data(), token.data() + token.size(), value)};
+        if (error != std::errc{} || end != token.data() + token.size())
+        {
+            fail("expected an integer, got '" + std::string{token} + "'");
+        }
+        return value;
+    }
+
+    void SceneReader::fail(std::string const& message) const
+    {
+        throw SceneError{mFilename + ":" + std::to_string(mLine) + ": " +
+                         message};
+    }
+
+    std::size_t SceneReader::getLine() const
+    {
+        return mLine;
+    }
+
+    void SceneReader::fill()
+    {
+        if (mEnd - mPos >= maxTokenSize || std::feof(mFile))
+        {
+            return;
+        }
+
+        std::memmove(mBuffer.data(), mBuffer.data() + mPos, mEnd - mPos);
+        mEnd -= mPos;
+        mPos = 0;
+        mEnd += std::fread(
+            mBuffer.data() + mEnd, 1, mBuffer.size() - mEnd, mFile);
+    }
+
+    void SceneReader::skipBlanks()
+    {
+        // a run of blanks or a comment can cross the end of the buffer
+        bool comment{false};
+        while (true)
+        {
+            fill();
+            char const* data{mBuffer.data()};
+            std::size_t pos{mPos};
+            for (; pos < mEnd; ++pos)
+            {
+                const CharClass c{classOf(data[pos])};
+                if (c == Newline || (c == Token && !comment))
+                {
+                    mPos = pos;
+                    return;
+                }
+                comment = comment || c == Comment;
+            }
+            mPos = pos;
+
+            if (std::feof(mFile))
+            {
+                return;
+            }
+        }
+    }
+
+    std::string_view SceneReader::readToken(char const* expected)
+    {
+        if (isEndOfStatement())
+        {
+            fail(std::string{"expected "} + expected);
+        }
+
+        fill();
+        char const* data{mBuffer.data()};
+        const std::size_t first{mPos};
+        const std::size_t last{std::min(mEnd, first + maxTokenSize)};
+        std::size_t pos{first};
+        while (pos < last && classOf(data[pos]) == Token)
+        {
+            ++pos;
+        }
+
+        if (pos == first + maxTokenSize)
+        {
+            fail("token too long");
+        }
+        mPos = pos;
+
+        return {data + first, pos - first};
+    }
+} // namespace common
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace common
+{
+    class SceneError : public std::runtime_error
+    {
+    public:
+        SceneError(std::string const& message) :
+            std::runtime_error{message}
+        {}
+    };
+
+    // Reads the statements of a text scene file. A statement is a keyword
+    // followed by its arguments on one line, separated by spaces or tabs;
+    // '#' starts a comment that runs to the end of the line. What the
+    // statements mean is up to the caller, which reads the arguments in
+    // order as they are needed.
+    //
+    // The file is streamed through a fixed size buffer in a single pass and
+    // numbers are converted in place with std::from_chars, so nothing is
+    // allocated per token and large files load at close to disk speed. The
+    // views returned by readWord point into the buffer and are only valid
+    // until the next read.
+    //
+    // Every error throws a SceneError naming the file and line.
+    class SceneReader
+    {
+    public:
+        SceneReader(std::string const& filename);
+        ~SceneReader();
+
+        SceneReader(SceneReader const&) = delete;
+        SceneReader& operator=(SceneReader const&) = delete;
+
+        // Moves to the start of the next statement, returning false at the
+        // end of the file. Fails if the current statement still has
+        // arguments left.
+        bool nextStatement();
+
+        // Whether the current statement has no arguments left, for the ones
+        // with optional trailing arguments.
+        bool isEndOfStatement();
+
+        std::string_view readWord();
+
+        float readFloat();
+
+        std::uint32_t readUnsigned();
+
+        [[noreturn]] void fail(std::string const& message) const;
+
+        std::size_t getLine() const;
+
+    private:
+        // makes sure the buffer holds at least the next maxTokenSize bytes,
+        // or the rest of the file
+        void fill();
+
+        // skips spaces and the comment, if any, up to the end of the line
+        void skipBlanks();
+
+        std::string_view readToken(char const* expected);
+
+        std::string mFilename;
+        std::FILE* mFile;
+        std::vector<char> mBuffer;
+        std::size_t mPos;
+        std::size_t mEnd;
+        std::size_t mLine;
+        bool mInStatement;
+    };
+} // namespace common
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <cstddef>
+
+namespace common
+{
+    // A read-only view of a contiguous array owned by something else, e.g.
+    // a vector or a memory-mapped file.
+    template<typename T>
+    struct Span
+    {
+        T const* begin() const
+        {
+            return first;
+        }
+
+        T const* end() const
+        {
+            return first + size;
+        }
+
+        T const& operator[](std::size_t i) const
+        {
+            return first[i];
+        }
+
+        bool empty() const
+        {
+            return size == 0;
+        }
+
+        T const* first;
+        std::size_t size;
+    };
+} // namespace common
@@ -0,0 +1,600 @@
+#include "SphereSet.hpp"
+
+#include <atlas/core/Float.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#if COMMON_X86
+#    include <immintrin.h>
+#endif
+
+#if defined(_MSC_VER)
+#    include <intrin.h>
+#endif
+
+namespace common
+{
+    namespace
+    {
+        // same as Sphere::intersectRay
+        constexpr float kEpsilon{0.01f};
+
+        using Ray = atlas::math::Ray<atlas::math::Vector>;
+
+        int lowestSetBit(int mask)
+        {
+#if defined(_MSC_VER)
+            unsigned long index;
+            _BitScanForward(&index, static_cast<unsigned long>(mask));
+            return static_cast<int>(index);
+#else
+            return __builtin_ctz(static_cast<unsigned int>(mask));
+#endif
+        }
+
+        // The kernels find the closest sphere the ray hits before tMax. With
+        // AnyHit they return the first such sphere they come across instead,
+        // which is all an occlusion test needs.
+        template<bool AnyHit>
+        int findHitScalar(SphereArrays const& s,
+                          Ray const& ray,
+                          std::uint32_t first,
+                          std::uint32_t count,
+                          float tMax,
+                          float& tHit)
+        {
+            using atlas::core::geq;
+
+            int best{-1};
+            const float a{glm::dot(ray.d, ray.d)};
+
+            for (std::uint32_t i{first}; i < first + count; ++i)
+            {
+                const atlas::math::Vector tmp{
+                    ray.o.x - s.x[i], ray.o.y - s.y[i], ray.o.z - s.z[i]};
+                const float b{2.0f * glm::dot(ray.d, tmp)};
+                const float c{glm::dot(tmp, tmp) - s.radiusSqr[i]};
+                const float disc{(b * b) - (4.0f * a * c)};
+
+                if (!geq(disc, 0.0f))
+                {
+                    continue;
+                }
+
+                const float e{std::sqrt(disc)};
+                const float denom{2.0f * a};
+
+                float t{(-b - e) / denom};
+                if (!geq(t, kEpsilon))
+                {
+                    t = (-b + e);
+                    if (!geq(t, kEpsilon))
+                    {
+                        continue;
+                    }
+                }
+
+                if (t < tMax)
+                {
+                    tMax = t;
+                    best = static_cast<int>(i);
+
+                    if constexpr (AnyHit)
+                    {
+                        break;
+                    }
+                }
+            }
+
+            if (best >= 0)
+            {
+                tHit = tMax;
+            }
+            return best;
+        }
+
+#if COMMON_X86
+        // atlas::core::geq(x, y): x > y or |x - y| within float epsilon
+        __m128 geqSse2(__m128 x, __m128 y, __m128 absMask, __m128 tolerance)
+        {
+            const __m128 diff{_mm_and_ps(_mm_sub_ps(x, y), absMask)};
+            return _mm_or_ps(_mm_cmpgt_ps(x, y), _mm_cmple_ps(diff, tolerance));
+        }
+
+        __m128 selectSse2(__m128 mask, __m128 a, __m128 b)
+        {
+            return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+        }
+
+        template<bool AnyHit>
+        int findHitSse2(SphereArrays const& s,
+                        Ray const& ray,
+                        std::uint32_t first,
+                        std::uint32_t count,
+                        float tMax,
+                        float& tHit)
+        {
+            const float a{glm::dot(ray.d, ray.d)};
+
+            const __m128 ox{_mm_set1_ps(ray.o.x)};
+            const __m128 oy{_mm_set1_ps(ray.o.y)};
+            const __m128 oz{_mm_set1_ps(ray.o.z)};
+            const __m128 dx{_mm_set1_ps(ray.d.x)};
+            const __m128 dy{_mm_set1_ps(ray.d.y)};
+            const __m128 dz{_mm_set1_ps(ray.d.z)};
+            const __m128 fourA{_mm_set1_ps(4.0f * a)};
+            const __m128 denom{_mm_set1_ps(2.0f * a)};
+            const __m128 two{_mm_set1_ps(2.0f)};
+            const __m128 zero{_mm_setzero_ps()};
+            const __m128 epsilon{_mm_set1_ps(kEpsilon)};
+            const __m128 infinity{
+                _mm_set1_ps(std::numeric_limits<float>::infinity())};
+            const __m128 tolerance{
+                _mm_set1_ps(std::numeric_limits<float>::epsilon())};
+            const __m128 absMask{_mm_castsi128_ps(_mm_set1_epi32(0x7fffffff))};
+            const __m128 signMask{_mm_castsi128_ps(
+                _mm_set1_epi32(static_cast<int>(0x80000000u)))};
+            const __m128i lanes{_mm_setr_epi32(0, 1, 2, 3)};
+
+            int best{-1};
+            for (std::uint32_t base{0}; base < count; base += 4)
+            {
+                const std::uint32_t i{first + base};
+
+                const __m128 tx{_mm_sub_ps(ox, _mm_loadu_ps(s.x + i))};
+                const __m128 ty{_mm_sub_ps(oy, _mm_loadu_ps(s.y + i))};
+                const __m128 tz{_mm_sub_ps(oz, _mm_loadu_ps(s.z + i))};
+
+                const __m128 b{_mm_mul_ps(
+                    two,
+                    _mm_add_ps(
+                        _mm_add_ps(_mm_mul_ps(dx, tx), _mm_mul_ps(dy, ty)),
+                        _mm_mul_ps(dz, tz)))};
+                const __m128 c{_mm_sub_ps(
+                    _mm_add_ps(
+                        _mm_add_ps(_mm_mul_ps(tx, tx), _mm_mul_ps(ty, ty)),
+                        _mm_mul_ps(tz, tz)),
+                    _mm_loadu_ps(s.radiusSqr + i))};
+                const __m128 disc{
+                    _mm_sub_ps(_mm_mul_ps(b, b), _mm_mul_ps(fourA, c))};
+
+                const __m128 e{_mm_sqrt_ps(disc)};
+                const __m128 negB{_mm_xor_ps(b, signMask)};
+                const __m128 t0{_mm_div_ps(_mm_sub_ps(negB, e), denom)};
+                const __m128 t1{_mm_add_ps(negB, e)};
+
+                const __m128 hit0{geqSse2(t0, epsilon, absMask, tolerance)};
+                const __m128 hit1{geqSse2(t1, epsilon, absMask, tolerance)};
+                const __m128 t{selectSse2(hit0, t0, t1)};
+
+                const __m128 inRange{_mm_castsi128_ps(_mm_cmpgt_epi32(
+                    _mm_set1_epi32(static_cast<int>(count - base)), lanes))};
+                const __m128 valid{_mm_and_ps(
+                    _mm_and_ps(geqSse2(disc, zero, absMask, tolerance),
+                               _mm_or_ps(hit0, hit1)),
+                    _mm_and_ps(inRange, _mm_cmplt_ps(t, _mm_set1_ps(tMax))))};
+
+                if (_mm_movemask_ps(valid) == 0)
+                {
+                    continue;
+                }
+
+                if constexpr (AnyHit)
+                {
+                    alignas(16) float ts[4];
+                    _mm_store_ps(ts, t);
+                    const int lane{lowestSetBit(_mm_movemask_ps(valid))};
+                    tHit = ts[lane];
+                    return static_cast<int>(i) + lane;
+                }
+
+                // broadcast the smallest valid t, then take the first lane
+                // holding it so ties go to the earlier sphere like in the
+                // scalar loop
+                const __m128 tv{selectSse2(valid, t, infinity)};
+                __m128 m{_mm_min_ps(
+                    tv, _mm_shuffle_ps(tv, tv, _MM_SHUFFLE(1, 0, 3, 2)))};
+                m = _mm_min_ps(m,
+                               _mm_shuffle_ps(m, m, _MM_SHUFFLE(2, 3, 0, 1)));
+
+                const int lane{lowestSetBit(
+                    _mm_movemask_ps(_mm_and_ps(valid, _mm_cmpeq_ps(tv, m))))};
+                tMax = _mm_cvtss_f32(m);
+                best = static_cast<int>(i) + lane;
+            }
+
+            if (best >= 0)
+            {
+                tHit = tMax;
+            }
+            return best;
+        }
+
+        void closestHitPacketScalar(SphereArrays const& s,
+                                    RayPacket& packet,
+                                    std::uint32_t first,
+                                    std::uint32_t count)
+        {
+            for (std::size_t r{0}; r < packet.size; ++r)
+            {
+                const Ray ray{{packet.ox[r], packet.oy[r], packet.oz[r]},
+                              {packet.dx[r], packet.dy[r], packet.dz[r]}};
+
+                float t{};
+                const int i{findHitScalar<false>(
+                    s, ray, first, count, packet.tMax[r], t)};
+                if (i >= 0)
+                {
+                    packet.tMax[r] = t;
+                    packet.hit[r]  = i;
+                }
+            }
+        }
+
+        COMMON_TARGET_AVX2 __m256 geqAvx2(__m256 x,
+                                          __m256 y,
+                                          __m256 absMask,
+                                          __m256 tolerance)
+        {
+            const __m256 diff{_mm256_and_ps(_mm256_sub_ps(x, y), absMask)};
+            return _mm256_or_ps(_mm256_cmp_ps(x, y, _CMP_GT_OQ),
+                                _mm256_cmp_ps(diff, tolerance, _CMP_LE_OQ));
+        }
+
+        template<bool AnyHit>
+        COMMON_TARGET_AVX2 int findHitAvx2(SphereArrays const& s,
+                                           Ray const& ray,
+                                           std::uint32_t first,
+                                           std::uint32_t count,
+                                           float tMax,
+                                           float& tHit)
+        {
+            const float a{glm::dot(ray.d, ray.d)};
+
+            const __m256 ox{_mm256_set1_ps(ray.o.x)};
+            const __m256 oy{_mm256_set1_ps(ray.o.y)};
+            const __m256 oz{_mm256_set1_ps(ray.o.z)};
+            const __m256 dx{_mm256_set1_ps(ray.d.x)};
+            const __m256 dy{_mm256_set1_ps(ray.d.y)};
+            const __m256 dz{_mm256_set1_ps(ray.d.z)};
+            const __m256 fourA{_mm256_set1_ps(4.0f * a)};
+            const __m256 denom{_mm256_set1_ps(2.0f * a)};
+            const __m256 two{_mm256_set1_ps(2.0f)};
+            const __m256 zero{_mm256_setzero_ps()};
+            const __m256 epsilon{_mm256_set1_ps(kEpsilon)};
+            const __m256 infinity{
+                _mm256_set1_ps(std::numeric_limits<float>::infinity())};
+            const __m256 tolerance{
+                _mm256_set1_ps(std::numeric_limits<float>::epsilon())};
+            const __m256 absMask{
+                _mm256_castsi256_ps(_mm256_set1_epi32(0x7fffffff))};
+            const __m256 signMask{_mm256_castsi256_ps(
+                _mm256_set1_epi32(static_cast<int>(0x80000000u)))};
+            const __m256i lanes{_mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7)};
+
+            int best{-1};
+            for (std::uint32_t base{0}; base < count; base += 8)
+            {
+                const std::uint32_t i{first + base};
+
+                const __m256 tx{_mm256_sub_ps(ox, _mm256_loadu_ps(s.x + i))};
+                const __m256 ty{_mm256_sub_ps(oy, _mm256_loadu_ps(s.y + i))};
+                const __m256 tz{_mm256_sub_ps(oz, _mm256_loadu_ps(s.z + i))};
+
+                const __m256 b{_mm256_mul_ps(
+                    two,
+                    _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dx, tx),
+                                                _mm256_mul_ps(dy, ty)),
+                                  _mm256_mul_ps(dz, tz)))};
+                const __m256 c{_mm256_sub_ps(
+                    _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(tx, tx),
+                                                _mm256_mul_ps(ty, ty)),
+                                  _mm256_mul_ps(tz, tz)),
+                    _mm256_loadu_ps(s.radiusSqr + i))};
+                const __m256 disc{_mm256_sub_ps(_mm256_mul_ps(b, b),
+                                                _mm256_mul_ps(fourA, c))};
+
+                const __m256 e{_mm256_sqrt_ps(disc)};
+                const __m256 negB{_mm256_xor_ps(b, signMask)};
+                const __m256 t0{
+                    _mm256_div_ps(_mm256_sub_ps(negB, e), denom)};
+                const __m256 t1{_mm256_add_ps(negB, e)};
+
+                const __m256 hit0{geqAvx2(t0, epsilon, absMask, tolerance)};
+                const __m256 hit1{geqAvx2(t1, epsilon, absMask, tolerance)};
+                const __m256 t{_mm256_blendv_ps(t1, t0, hit0)};
+
+                const __m256 inRange{_mm256_castsi256_ps(_mm256_cmpgt_epi32(
+                    _mm256_set1_epi32(static_cast<int>(count - base)),
+                    lanes))};
+                const __m256 valid{_mm256_and_ps(
+                    _mm256_and_ps(geqAvx2(disc, zero, absMask, tolerance),
+                                  _mm256_or_ps(hit0, hit1)),
+                    _mm256_and_ps(
+                        inRange,
+                        _mm256_cmp_ps(t, _mm256_set1_ps(tMax), _CMP_LT_OQ)))};
+
+                if (_mm256_movemask_ps(valid) == 0)
+                {
+                    continue;
+                }
+
+                if constexpr (AnyHit)
+                {
+                    alignas(32) float ts[8];
+                    _mm256_store_ps(ts, t);
+                    const int lane{lowestSetBit(_mm256_movemask_ps(valid))};
+                    tHit = ts[lane];
+                    return static_cast<int>(i) + lane;
+                }
+
+                const __m256 tv{_mm256_blendv_ps(infinity, t, valid)};
+                __m256 m{_mm256_min_ps(tv, _mm256_permute2f128_ps(tv, tv, 1))};
+                m = _mm256_min_ps(
+                    m, _mm256_shuffle_ps(m, m, _MM_SHUFFLE(1, 0, 3, 2)));
+                m = _mm256_min_ps(
+                    m, _mm256_shuffle_ps(m, m, _MM_SHUFFLE(2, 3, 0, 1)));
+
+                const int lane{lowestSetBit(_mm256_movemask_ps(_mm256_and_ps(
+                    valid, _mm256_cmp_ps(tv, m, _CMP_EQ_OQ))))};
+                tMax = _mm256_cvtss_f32(m);
+                best = static_cast<int>(i) + lane;
+            }
+
+            if (best >= 0)
+            {
+                tHit = tMax;
+            }
+            return best;
+        }
+
+        // 8 rays against one sphere at a time. Same arithmetic as
+        // findHitScalar, with a, 4a and 2a computed per lane since every
+        // ray has its own direction.
+        COMMON_TARGET_AVX2 void closestHitPacketAvx2(SphereArrays const& s,
+                                                     RayPacket& packet,
+                                                     std::uint32_t first,
+                                                     std::uint32_t count)
+        {
+            const __m256 two{_mm256_set1_ps(2.0f)};
+            const __m256 four{_mm256_set1_ps(4.0f)};
+            const __m256 zero{_mm256_setzero_ps()};
+            const __m256 epsilon{_mm256_set1_ps(kEpsilon)};
+            const __m256 tolerance{
+                _mm256_set1_ps(std::numeric_limits<float>::epsilon())};
+            const __m256 absMask{
+                _mm256_castsi256_ps(_mm256_set1_epi32(0x7fffffff))};
+            const __m256 signMask{_mm256_castsi256_ps(
+                _mm256_set1_epi32(static_cast<int>(0x80000000u)))};
+
+            for (std::size_t r{0}; r < packet.paddedSize();
+                 r += RayPacket::laneWidth)
+            {
+                const __m256 ox{_mm256_load_ps(packet.ox + r)};
+                const __m256 oy{_mm256_load_ps(packet.oy + r)};
+                const __m256 oz{_mm256_load_ps(packet.oz + r)};
+                const __m256 dx{_mm256_load_ps(packet.dx + r)};
+                const __m256 dy{_mm256_load_ps(packet.dy + r)};
+                const __m256 dz{_mm256_load_ps(packet.dz + r)};
+
+                const __m256 a{_mm256_add_ps(
+                    _mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy)),
+                    _mm256_mul_ps(dz, dz))};
+                const __m256 fourA{_mm256_mul_ps(four, a)};
+                const __m256 denom{_mm256_mul_ps(two, a)};
+
+                __m256 tMax{_mm256_load_ps(packet.tMax + r)};
+                __m256i hit{_mm256_load_si256(
+                    reinterpret_cast<__m256i const*>(packet.hit + r))};
+
+                for (std::uint32_t i{first}; i < first + count; ++i)
+                {
+                    const __m256 tx{
+                        _mm256_sub_ps(ox, _mm256_broadcast_ss(s.x + i))};
+                    const __m256 ty{
+                        _mm256_sub_ps(oy, _mm256_broadcast_ss(s.y + i))};
+                    const __m256 tz{
+                        _mm256_sub_ps(oz, _mm256_broadcast_ss(s.z + i))};
+
+                    const __m256 b{_mm256_mul_ps(
+                        two,
+                        _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dx, tx),
+                                                    _mm256_mul_ps(dy, ty)),
+                                      _mm256_mul_ps(dz, tz)))};
+                    const __m256 c{_mm256_sub_ps(
+                        _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(tx, tx),
+                                                    _mm256_mul_ps(ty, ty)),
+                                      _mm256_mul_ps(tz, tz)),
+                        _mm256_broadcast_ss(s.radiusSqr + i))};
+                    const __m256 disc{_mm256_sub_ps(_mm256_mul_ps(b, b),
+                                                    _mm256_mul_ps(fourA, c))};
+
+                    const __m256 discOk{
+                        geqAvx2(disc, zero, absMask, tolerance)};
+                    if (_mm256_movemask_ps(discOk) == 0)
+                    {
+                        continue;
+                    }
+
+                    const __m256 e{_mm256_sqrt_ps(disc)};
+                    const __m256 negB{_mm256_xor_ps(b, signMask)};
+                    const __m256 t0{
+                        _mm256_div_ps(_mm256_sub_ps(negB, e), denom)};
+                    const __m256 t1{_mm256_add_ps(negB, e)};
+
+                    const __m256 hit0{geqAvx2(t0, epsilon, absMask, tolerance)};
+                    const __m256 hit1{geqAvx2(t1, epsilon, absMask, tolerance)};
+                    const __m256 t{_mm256_blendv_ps(t1, t0, hit0)};
+
+                    const __m256 closer{_mm256_and_ps(
+                        _mm256_and_ps(discOk, _mm256_or_ps(hit0, hit1)),
+                        _mm256_cmp_ps(t, tMax, _CMP_LT_OQ))};
+
+                    tMax = _mm256_blendv_ps(tMax, t, closer);
+                    hit  = _mm256_castps_si256(_mm256_blendv_ps(
+                        _mm256_castsi256_ps(hit),
+                        _mm256_castsi256_ps(
+                            _mm256_set1_epi32(static_cast<int>(i))),
+                        closer));
+                }
+
+                _mm256_store_ps(packet.tMax + r, tMax);
+                _mm256_store_si256(reinterpret_cast<__m256i*>(packet.hit + r),
+                                   hit);
+            }
+        }
+#endif
+    } // namespace
+
+    SphereSet::SphereSet() :
+        mAssigned{}, mSize{0}, mLevel{common::getSimdLevel()}
+    {
+        clear();
+    }
+
+    void SphereSet::clear()
+    {
+        mAssigned = {};
+        mSize     = 0;
+        mCentreX.assign(padding, 0.0f);
+        mCentreY.assign(padding, 0.0f);
+        mCentreZ.assign(padding, 0.0f);
+        mRadiusSqr.assign(padding, 0.0f);
+        mIds.assign(padding, 0);
+    }
+
+    void SphereSet::reserve(std::size_t size)
+    {
+        mCentreX.reserve(size + padding);
+        mCentreY.reserve(size + padding);
+        mCentreZ.reserve(size + padding);
+        mRadiusSqr.reserve(size + padding);
+        mIds.reserve(size + padding);
+    }
+
+    void SphereSet::add(atlas::math::Point const& centre,
+                        float radius,
+                        std::uint32_t id)
+    {
+        // the new sphere takes the first padding slot and the padding moves
+        // one along
+        mCentreX[mSize]   = centre.x;
+        mCentreY[mSize]   = centre.y;
+        mCentreZ[mSize]   = centre.z;
+        mRadiusSqr[mSize] = radius * radius;
+        mIds[mSize]       = id;
+        ++mSize;
+
+        mCentreX.push_back(0.0f);
+        mCentreY.push_back(0.0f);
+        mCentreZ.push_back(0.0f);
+        mRadiusSqr.push_back(0.0f);
+        mIds.push_back(0);
+    }
+
+    std::size_t SphereSet::size() const
+    {
+        return mSize;
+    }
+
+    std::uint32_t SphereSet::getId(std::size_t i) const
+    {
+        return mAssigned.x != nullptr ? mAssigned.ids[i] : mIds[i];
+    }
+
+    SphereArrays SphereSet::getArrays() const
+    {
+        if (mAssigned.x != nullptr)
+        {
+            return mAssigned;
+        }
+
+        return {mCentreX.data(),
+                mCentreY.data(),
+                mCentreZ.data(),
+                mRadiusSqr.data(),
+                mIds.data(),
+                mSize};
+    }
+
+    void SphereSet::assign(SphereArrays const& arrays)
+    {
+        mCentreX   = {};
+        mCentreY   = {};
+        mCentreZ   = {};
+        mRadiusSqr = {};
+        mIds       = {};
+        mAssigned  = arrays;
+        mSize      = arrays.size;
+    }
+
+    void SphereSet::setSimdLevel(SimdLevel level)
+    {
+        mLevel = std::min(level, common::getSimdLevel());
+    }
+
+    SimdLevel SphereSet::getSimdLevel() const
+    {
+        return mLevel;
+    }
+
+    int SphereSet::closestHit(atlas::math::Ray<atlas::math::Vector> const& ray,
+                              std::uint32_t first,
+                              std::uint32_t count,
+                              float tMax,
+                              float& t) const
+    {
+        const SphereArrays arrays{getArrays()};
+
+        switch (mLevel)
+        {
+#if COMMON_X86
+        case SimdLevel::Avx2:
+            return findHitAvx2<false>(arrays, ray, first, count, tMax, t);
+        case SimdLevel::Sse2:
+            return findHitSse2<false>(arrays, ray, first, count, tMax, t);
+#endif
+        default:
+            return findHitScalar<false>(arrays, ray, first, count, tMax, t);
+        }
+    }
+
+    bool SphereSet::anyHit(atlas::math::Ray<atlas::math::Vector> const& ray,
+                           std::uint32_t first,
+                           std::uint32_t count,
+                           float tMax) const
+    {
+        const SphereArrays arrays{getArrays()};
+
+        float t{};
+        switch (mLevel)
+        {
+#if COMMON_X86
+        case SimdLevel::Avx2:
+            return findHitAvx2<true>(arrays, ray, first, count, tMax, t) >= 0;
+        case SimdLevel::Sse2:
+            return findHitSse2<true>(arrays, ray, first, count, tMax, t) >= 0;
+#endif
+        default:
+            return findHitScalar<true>(arrays, ray, first, count, tMax, t) >= 0;
+        }
+    }
+
+    void SphereSet::closestHitPacket(RayPacket& packet,
+                                     std::uint32_t first,
+                                     std::uint32_t count) const
+    {
+        const SphereArrays arrays{getArrays()};
+
+#if COMMON_X86
+        if (mLevel == SimdLevel::Avx2)
+        {
+            closestHitPacketAvx2(arrays, packet, first, count);
+            return;
+        }
+#endif
+        closestHitPacketScalar(arrays, packet, first, count);
+    }
+} // namespace common
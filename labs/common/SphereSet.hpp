@@ -0,0 +1,108 @@
+#pragma once
+
+#include "AlignedAllocator.hpp"
+#include "Cpu.hpp"
+#include "RayPacket.hpp"
+
+#include <atlas/math/Math.hpp>
+#include <atlas/math/Ray.hpp>
+
+#include <cstddef>
+#include <cstdint>
+
+namespace common
+{
+    // The arrays behind a SphereSet, in the order the spheres were added.
+    // Each array holds size + SphereSet::padding entries, with the padding
+    // zeroed.
+    struct SphereArrays
+    {
+        float const* x;
+        float const* y;
+        float const* z;
+        float const* radiusSqr;
+        std::uint32_t const* ids;
+        std::size_t size;
+    };
+
+    // Spheres stored as a structure of arrays, so that one ray can be tested
+    // against 8 (AVX2) or 4 (SSE2) spheres per instruction. The arithmetic
+    // follows the labs' Sphere::intersectRay step by step, so every kernel
+    // reports the same sphere and the same t as the virtual Shape::hit path.
+    class SphereSet
+    {
+    public:
+        // Kernels load a full vector even for the last, partial group of a
+        // range, so the arrays are padded so those loads stay in bounds.
+        static constexpr std::size_t padding{8};
+
+        SphereSet();
+
+        void clear();
+
+        void reserve(std::size_t size);
+
+        // id is stored alongside the sphere, e.g. its index in World::scene
+        void add(atlas::math::Point const& centre,
+                 float radius,
+                 std::uint32_t id);
+
+        std::size_t size() const;
+
+        std::uint32_t getId(std::size_t i) const;
+
+        SphereArrays getArrays() const;
+
+        // Uses arrays stored elsewhere, e.g. in a memory-mapped file, in
+        // place of the set's own. Nothing is copied, so they have to outlive
+        // the set or the next call to clear, which has to come before any
+        // more spheres are added.
+        void assign(SphereArrays const& arrays);
+
+        // Kernels are picked at runtime from what the CPU supports. A lower
+        // level can be forced (e.g. to compare against the scalar kernel); a
+        // higher level than the CPU supports is ignored.
+        void setSimdLevel(SimdLevel level);
+
+        SimdLevel getSimdLevel() const;
+
+        // Finds the closest sphere in [first, first + count) that the ray
+        // hits at t < tMax. Returns its index in the set and writes its
+        // distance to t, or returns -1 when there is no such sphere.
+        int closestHit(atlas::math::Ray<atlas::math::Vector> const& ray,
+                       std::uint32_t first,
+                       std::uint32_t count,
+                       float tMax,
+                       float& t) const;
+
+        // Returns true if the ray hits any sphere in [first, first + count)
+        // at t < tMax. Stops at the first such sphere instead of looking for
+        // the closest, for shadow rays and other visibility tests.
+        bool anyHit(atlas::math::Ray<atlas::math::Vector> const& ray,
+                    std::uint32_t first,
+                    std::uint32_t count,
+                    float tMax) const;
+
+        // Packet version of closestHit: for every ray of the (padded)
+        // packet whose closest hit in the range is nearer than its tMax,
+        // sets tMax to that distance and hit to the sphere's index. Spheres
+        // are visited in order, so each ray ends up with the same answer the
+        // single ray kernels give.
+        void closestHitPacket(RayPacket& packet,
+                              std::uint32_t first,
+                              std::uint32_t count) const;
+
+    private:
+        AlignedVector<float> mCentreX;
+        AlignedVector<float> mCentreY;
+        AlignedVector<float> mCentreZ;
+        AlignedVector<float> mRadiusSqr;
+        AlignedVector<std::uint32_t> mIds;
+
+        // x is null unless assign was called
+        SphereArrays mAssigned;
+
+        std::size_t mSize;
+        SimdLevel mLevel;
+    };
+} // namespace common
@@ -0,0 +1,106 @@
+#include "ThreadPool.hpp"
+
+namespace common
+{
+    ThreadPool::ThreadPool(std::size_t numThreads) :
+        mJob{nullptr},
+        mCount{0},
+        mNext{0},
+        mBusy{0},
+        mGeneration{0},
+        mStop{false}
+    {
+        // hardware_concurrency is allowed to return 0 when it doesn't know.
+        numThreads = (numThreads == 0) ? 1 : numThreads;
+
+        for (std::size_t i{1}; i < numThreads; ++i)
+        {
+            mWorkers.emplace_back([this]() { workerLoop(); });
+        }
+    }
+
+    ThreadPool::~ThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock{mMutex};
+            mStop = true;
+        }
+
+        mWakeUp.notify_all();
+        for (auto& worker : mWorkers)
+        {
+            worker.join();
+        }
+    }
+
+    std::size_t ThreadPool::size() const
+    {
+        return mWorkers.size() + 1;
+    }
+
+    void ThreadPool::parallelFor(std::size_t count,
+                                 std::function<void(std::size_t)> const& fn)
+    {
+        if (mWorkers.empty())
+        {
+            for (std::size_t i{0}; i < count; ++i)
+            {
+                fn(i);
+            }
+            return;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock{mMutex};
+            mJob   = &fn;
+            mCount = count;
+            mNext  = 0;
+            mBusy  = mWorkers.size();
+            ++mGeneration;
+        }
+
+        mWakeUp.notify_all();
+        runItems();
+
+        std::unique_lock<std::mutex> lock{mMutex};
+        mFinished.wait(lock, [this]() { return mBusy == 0; });
+        mJob = nullptr;
+    }
+
+    void ThreadPool::workerLoop()
+    {
+        std::uint64_t seen{0};
+
+        for (;;)
+        {
+            {
+                std::unique_lock<std::mutex> lock{mMutex};
+                mWakeUp.wait(
+                    lock, [&]() { return mStop || mGeneration != seen; });
+
+                if (mStop)
+                {
+                    return;
+                }
+
+                seen = mGeneration;
+            }
+
+            runItems();
+
+            {
+                std::lock_guard<std::mutex> lock{mMutex};
+                --mBusy;
+            }
+            mFinished.notify_one();
+        }
+    }
+
+    void ThreadPool::runItems()
+    {
+        for (std::size_t i{mNext++}; i < mCount; i = mNext++)
+        {
+            (*mJob)(i);
+        }
+    }
+} // namespace common
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace common
+{
+    // A fixed set of worker threads that execute data-parallel loops. The
+    // thread that calls parallelFor also takes part in the work, so a pool
+    // of size 1 has no worker threads and runs everything in order on the
+    // calling thread.
+    class ThreadPool
+    {
+    public:
+        explicit ThreadPool(
+            std::size_t numThreads = std::thread::hardware_concurrency());
+        ~ThreadPool();
+
+        ThreadPool(ThreadPool const&) = delete;
+        ThreadPool& operator=(ThreadPool const&) = delete;
+
+        std::size_t size() const;
+
+        // Calls fn(i) for every i in [0, count) and blocks until all calls
+        // have returned. Items are handed out one at a time, so uneven work
+        // (such as image tiles) balances itself across the threads.
+        void parallelFor(std::size_t count,
+                         std::function<void(std::size_t)> const& fn);
+
+    private:
+        void workerLoop();
+        void runItems();
+
+        std::vector<std::thread> mWorkers;
+        std::mutex mMutex;
+        std::condition_variable mWakeUp;
+        std::condition_variable mFinished;
+
+        std::function<void(std::size_t)> const* mJob;
+        std::size_t mCount;
+        std::atomic<std::size_t> mNext;
+        std::size_t mBusy;
+        std::uint64_t mGeneration;
+        bool mStop;
+    };
+} // namespace common
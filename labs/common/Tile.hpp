@@ -0,0 +1,50 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <vector>
+
+namespace common
+{
+    // A rectangle of pixels [x0, x1) x [y0, y1) in image space.
+    struct Tile
+    {
+        std::size_t x0, y0;
+        std::size_t x1, y1;
+    };
+
+    // Splits a width x height image into square tiles of (at most) tileSize
+    // pixels per side. Tiles along the right and top edges are clipped to
+    // the image. Tiles are listed row by row, so rendering them in order
+    // visits the pixels in the same rows as a plain scanline loop would.
+    //
+    // This overload only covers rows [y0, y1), a band of the image, with
+    // the tiles lined up from y0.
+    inline std::vector<Tile> makeTiles(std::size_t width,
+                                       std::size_t y0,
+                                       std::size_t y1,
+                                       std::size_t tileSize)
+    {
+        std::vector<Tile> tiles;
+        tileSize = std::max<std::size_t>(tileSize, 1);
+
+        for (std::size_t y{y0}; y < y1; y += tileSize)
+        {
+            for (std::size_t x{0}; x < width; x += tileSize)
+            {
+                tiles.push_back({x,
+                                 y,
+                                 std::min(x + tileSize, width),
+                                 std::min(y + tileSize, y1)});
+            }
+        }
+
+        return tiles;
+    }
+
+    inline std::vector<Tile>
+    makeTiles(std::size_t width, std::size_t height, std::size_t tileSize)
+    {
+        return makeTiles(width, 0, height, tileSize);
+    }
+} // namespace common
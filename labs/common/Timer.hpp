@@ -0,0 +1,30 @@
+#pragma once
+
+#include <chrono>
+
+namespace common
+{
+    // Wall clock stopwatch used for the timing reports printed by the labs.
+    class Timer
+    {
+    public:
+        Timer() : mStart{Clock::now()}
+        {}
+
+        void reset()
+        {
+            mStart = Clock::now();
+        }
+
+        double elapsedSeconds() const
+        {
+            return std::chrono::duration<double>(Clock::now() - mStart)
+                .count();
+        }
+
+    private:
+        using Clock = std::chrono::steady_clock;
+
+        Clock::time_point mStart;
+    };
+} // namespace common
@@ -5,25 +5,3 @@ int main()
    // Your code here.
     return 0;
 }
-
-void saveToFile(std::string const& filename,
-                std::size_t width,
-                std::size_t height,
-                std::vector<Colour> const& image)
-{
-    std::vector<unsigned char> data(image.size() * 3);
-
-    for (std::size_t i{0}, k{0}; i < image.size(); ++i, k += 3)
-    {
-        Colour pixel = image[i];
-        data[k + 0]  = static_cast<unsigned char>(pixel.r * 255);
-        data[k + 1]  = static_cast<unsigned char>(pixel.g * 255);
-        data[k + 2]  = static_cast<unsigned char>(pixel.b * 255);
-    }
-
-    stbi_write_bmp(filename.c_str(),
-                   static_cast<int>(width),
-                   static_cast<int>(height),
-                   3,
-                   data.data());
-}
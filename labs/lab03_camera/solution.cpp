@@ -23,7 +23,8 @@ Camera::Camera() :
     mUp{0.0f, 1.0f, 0.0f},
     mU{1.0f, 0.0f, 0.0f},
     mV{0.0f, 1.0f, 0.0f},
-    mW{0.0f, 0.0f, 1.0f}
+    mW{0.0f, 0.0f, 1.0f},
+    mTileSize{32}
 {}
 
 void Camera::setEye(atlas::math::Point const& eye)
@@ -64,11 +65,110 @@ void Camera::computeUVW()
     }
 }
 
+void Camera::renderScene(World& world) const
+{
+    world.film.reset(world.width * world.height);
+    renderPass(world, 0);
+    world.film.resolve(world.image);
+}
+
+void Camera::renderScene(World& world, common::ImageSink& sink) const
+{
+    const std::size_t bandRows{std::max<std::size_t>(mTileSize, 1)};
+    std::vector<Colour> band;
+
+    for (std::size_t y0{0}; y0 < world.height; y0 += bandRows)
+    {
+        const std::size_t y1{std::min(y0 + bandRows, world.height)};
+        world.film.reset((y1 - y0) * world.width, y0 * world.width);
+        renderRows(world, 0, y0, y1);
+
+        world.film.resolve(band);
+        sink.writeRows(band.data(), y1 - y0);
+    }
+
+    sink.close();
+}
+
+void Camera::renderPass(World& world, std::uint32_t pass) const
+{
+    renderRows(world, pass, 0, world.height);
+}
+
+void Camera::renderProgressive(
+    World& world,
+    ProgressiveSettings const& settings,
+    std::function<void(World const&, std::uint32_t)> const& onImage) const
+{
+    const bool unlimited{settings.maxPasses == 0 && settings.timeBudget <= 0.0};
+    const std::uint32_t maxPasses{unlimited ? 1 : settings.maxPasses};
+
+    world.film.reset(world.width * world.height);
+
+    common::Timer timer;
+    double lastEmit{0.0};
+
+    for (std::uint32_t pass{0};; ++pass)
+    {
+        renderPass(world, pass);
+
+        const std::uint32_t numPasses{pass + 1};
+        const double seconds{timer.elapsedSeconds()};
+        const bool done{
+            (maxPasses > 0 && numPasses >= maxPasses) ||
+            (settings.timeBudget > 0.0 && seconds >= settings.timeBudget)};
+        const bool emit{
+            done ||
+            (settings.emitPasses > 0 && numPasses % settings.emitPasses == 0) ||
+            (settings.emitSeconds > 0.0 &&
+             seconds - lastEmit >= settings.emitSeconds)};
+
+        if (emit)
+        {
+            world.film.resolve(world.image);
+            onImage(world, numPasses);
+            lastEmit = seconds;
+        }
+
+        if (done)
+        {
+            break;
+        }
+    }
+}
+
+common::AdaptiveStats
+Camera::renderAdaptive(World& world,
+                       common::AdaptiveSettings const& settings) const
+{
+    const auto stats{common::renderAdaptive(
+        world.film,
+        world.width * world.height,
+        settings,
+        [&](std::uint32_t pass) { renderPass(world, pass); })};
+
+    world.film.resolve(world.image);
+    return stats;
+}
+
+void Camera::setTileSize(std::size_t tileSize)
+{
+    mTileSize = tileSize;
+}
+
 // ***** Sampler function members *****
 Sampler::Sampler(int numSamples, int numSets) :
-    mNumSamples{numSamples}, mNumSets{numSets}, mCount{0}, mJump{0}
+    mNumSamples{numSamples}, mNumSets{numSets}, mSeed{0}
 {
-    mSamples.reserve(mNumSets * mNumSamples);
+    if (numSamples < 1 || numSamples > maxSamples || numSets < 1 ||
+        static_cast<std::int64_t>(numSamples) * numSets >
+            std::numeric_limits<int>::max())
+    {
+        throw std::invalid_argument{
+            "sampler: " + std::to_string(numSamples) + " samples in " +
+            std::to_string(numSets) + " sets is out of range"};
+    }
+
     setupShuffledIndeces();
 }
 
@@ -80,36 +180,95 @@ int Sampler::getNumSamples() const
 void Sampler::setupShuffledIndeces()
 {
     mShuffledIndeces.reserve(mNumSamples * mNumSets);
-    std::vector<int> indices;
-
-    std::random_device d;
-    std::mt19937 generator(d());
-
-    for (int j = 0; j < mNumSamples; ++j)
-    {
-        indices.push_back(j);
-    }
+    std::vector<std::uint16_t> indices(mNumSamples);
 
+    // Fisher-Yates with counter-based numbers keyed on the set in place of a
+    // pixel, so every set's order is a pure function of the seed and the
+    // set. std::shuffle would give different orders with different standard
+    // libraries.
     for (int p = 0; p < mNumSets; ++p)
     {
-        std::shuffle(indices.begin(), indices.end(), generator);
-
         for (int j = 0; j < mNumSamples; ++j)
         {
-            mShuffledIndeces.push_back(indices[j]);
+            indices[j] = static_cast<std::uint16_t>(j);
         }
+
+        for (int j = mNumSamples - 1; j > 0; --j)
+        {
+            const std::uint32_t k{common::counterRandomBounded(
+                mSeed,
+                static_cast<std::uint64_t>(p),
+                static_cast<std::uint32_t>(j),
+                shuffleDimension,
+                static_cast<std::uint32_t>(j + 1))};
+            std::swap(indices[j], indices[k]);
+        }
+
+        mShuffledIndeces.insert(
+            mShuffledIndeces.end(), indices.begin(), indices.end());
     }
 }
 
-atlas::math::Point Sampler::sampleUnitSquare()
+void Sampler::setSeed(std::uint64_t seed)
 {
-    if (mCount % mNumSamples == 0)
+    mSeed = seed;
+
+    mShuffledIndeces.clear();
+    setupShuffledIndeces();
+    generateSamples();
+}
+
+void Sampler::startPixel(SampleCursor& cursor,
+                         std::size_t pixel,
+                         std::uint32_t pass) const
+{
+    cursor.pixel  = pixel;
+    cursor.sample = pass * static_cast<std::uint32_t>(mNumSamples);
+    cursor.count  = 0;
+}
+
+atlas::math::Point Sampler::sampleUnitSquare(SampleCursor& cursor) const
+{
+    COMMON_PROFILE_SCOPE(SampleUnitSquare);
+
+    // pick a new set every time a full set has been handed out
+    if (cursor.count == 0)
     {
-        atlas::math::Random<int> engine;
-        mJump = (engine.getRandomMax() % mNumSets) * mNumSamples;
+        cursor.set = pickSet(cursor).first;
     }
 
-    return mSamples[mJump + mShuffledIndeces[mJump + mCount++ % mNumSamples]];
+    const common::Sample2D sample{cursor.set[cursor.count]};
+    cursor.count = (cursor.count + 1 == mNumSamples) ? 0 : cursor.count + 1;
+    ++cursor.sample;
+
+    return atlas::math::Point{sample.x, sample.y, 0.0f};
+}
+
+common::SampleSpan Sampler::samplePixel(SampleCursor& cursor) const
+{
+    COMMON_PROFILE_SCOPE(SampleUnitSquare);
+
+    const common::SampleSpan set{pickSet(cursor)};
+    cursor.sample += static_cast<std::uint32_t>(mNumSamples);
+    return set;
+}
+
+common::SampleSpan Sampler::pickSet(SampleCursor const& cursor) const
+{
+    return mSets.getSet(
+        common::counterRandomBounded(mSeed,
+                                     cursor.pixel,
+                                     cursor.sample,
+                                     setDimension,
+                                     static_cast<std::uint32_t>(mNumSets)));
+}
+
+void Sampler::setSamples(std::vector<common::Sample2D> const& samples)
+{
+    mSets.pack(samples,
+               mShuffledIndeces,
+               static_cast<std::size_t>(mNumSamples),
+               static_cast<std::size_t>(mNumSets));
 }
 
 // ***** Sphere function members *****
@@ -133,6 +292,22 @@ bool Sphere::hit(atlas::math::Ray<atlas::math::Vector> const& ray,
     return intersect;
 }
 
+common::BBox Sphere::getBoundingBox() const
+{
+    const atlas::math::Vector extent{mRadius};
+    return {mCentre - extent, mCentre + extent};
+}
+
+atlas::math::Point Sphere::getCentre() const
+{
+    return mCentre;
+}
+
+float Sphere::getRadius() const
+{
+    return mRadius;
+}
+
 bool Sphere::intersectRay(atlas::math::Ray<atlas::math::Vector> const& ray,
                           float& tMin) const
 {
@@ -169,7 +344,8 @@ bool Sphere::intersectRay(atlas::math::Ray<atlas::math::Vector> const& ray,
 }
 
 // ***** Pinhole function members *****
-Pinhole::Pinhole() : Camera{}, mDistance{500.0f}, mZoom{1.0f}
+Pinhole::Pinhole() :
+    Camera{}, mDistance{500.0f}, mZoom{1.0f}, mPacketSize{0}
 {}
 
 void Pinhole::setDistance(float distance)
@@ -182,50 +358,210 @@ void Pinhole::setZoom(float zoom)
     mZoom = zoom;
 }
 
+void Pinhole::setPacketSize(std::size_t size)
+{
+    const std::size_t maxSize{static_cast<std::size_t>(
+        std::sqrt(static_cast<float>(common::RayPacket::maxSize)))};
+    mPacketSize = std::min(size, maxSize);
+}
+
 atlas::math::Vector Pinhole::rayDirection(atlas::math::Point const& p) const
 {
+    COMMON_PROFILE_SCOPE(RayDirection);
+
     const auto dir = p.x * mU + p.y * mV - mDistance * mW;
     return glm::normalize(dir);
 }
 
-void Pinhole::renderScene(World& world) const
+void Pinhole::renderRows(World& world,
+                         std::uint32_t pass,
+                         std::size_t y0,
+                         std::size_t y1) const
+{
+    // every tile adds straight into its own pixels, so the film has to be
+    // sized up front
+    if (!world.film.covers(y0 * world.width, y1 * world.width))
+    {
+        world.film.reset(world.width * world.height);
+    }
+
+    const auto tiles{common::makeTiles(world.width, y0, y1, mTileSize)};
+    const bool usePackets{mPacketSize > 0 &&
+                          world.spheres.size() == world.scene.size()};
+    const auto renderTileAt = [&](std::size_t i) {
+        if (usePackets)
+        {
+            renderTilePackets(world, tiles[i], pass);
+        }
+        else
+        {
+            renderTile(world, tiles[i], pass);
+        }
+    };
+
+    if (world.pool)
+    {
+        world.pool->parallelFor(tiles.size(), renderTileAt);
+    }
+    else
+    {
+        for (std::size_t i{0}; i < tiles.size(); ++i)
+        {
+            renderTileAt(i);
+        }
+    }
+}
+
+void Pinhole::renderTile(World& world,
+                         common::Tile const& tile,
+                         std::uint32_t pass) const
 {
     using atlas::math::Point;
     using atlas::math::Ray;
     using atlas::math::Vector;
 
-    Point samplePoint{}, pixelPoint{};
+    Point pixelPoint{};
     Ray<atlas::math::Vector> ray{};
 
     ray.o = mEye;
-    float avg{1.0f / world.sampler->getNumSamples()};
+    SampleCursor cursor{};
+    const int numSamples{world.sampler->getNumSamples()};
 
-    for (int r{0}; r < world.height; ++r)
+    for (std::size_t r{tile.y0}; r < tile.y1; ++r)
     {
-        for (int c{0}; c < world.width; ++c)
+        for (std::size_t c{tile.x0}; c < tile.x1; ++c)
         {
-            Colour pixelAverage{0, 0, 0};
+            const std::size_t pixel{r * world.width + c};
+            if (!world.film.isActive(pixel))
+            {
+                continue;
+            }
+
+            Colour pixelSum{0, 0, 0};
+            float sumSquare{0.0f};
+            world.sampler->startPixel(cursor, pixel, pass);
 
-            for (int j = 0; j < world.sampler->getNumSamples(); ++j)
+            for (auto const& sample : world.sampler->samplePixel(cursor))
             {
                 ShadeRec trace_data{};
                 trace_data.t = std::numeric_limits<float>::max();
-                samplePoint  = world.sampler->sampleUnitSquare();
-                pixelPoint.x = c - 0.5f * world.width + samplePoint.x;
-                pixelPoint.y = r - 0.5f * world.height + samplePoint.y;
+                pixelPoint.x = c - 0.5f * world.width + sample.x;
+                pixelPoint.y = r - 0.5f * world.height + sample.y;
                 ray.d        = rayDirection(pixelPoint);
 
-                for (auto const& obj : world.scene)
+                hitScene(world, ray, trace_data);
+
+                const float y{common::luminance(trace_data.color)};
+                pixelSum += trace_data.color;
+                sumSquare += y * y;
+            }
+
+            world.film.add(pixel, pixelSum, sumSquare, numSamples);
+        }
+    }
+}
+
+void Pinhole::renderTilePackets(World& world,
+                                common::Tile const& tile,
+                                std::uint32_t pass) const
+{
+    using atlas::math::Point;
+    using atlas::math::Ray;
+    using atlas::math::Vector;
+
+    // one sample set and running sum per active pixel of the block, so every
+    // pixel sees exactly the samples renderTile would give it
+    constexpr std::size_t maxSize{common::RayPacket::maxSize};
+    std::size_t rows[maxSize], cols[maxSize];
+    common::SampleSpan samples[maxSize];
+    Colour sums[maxSize];
+    float sumSquares[maxSize];
+    common::RayPacket packet{};
+
+    Point pixelPoint{};
+    SampleCursor cursor{};
+    const int numSamples{world.sampler->getNumSamples()};
+
+    for (std::size_t by{tile.y0}; by < tile.y1; by += mPacketSize)
+    {
+        for (std::size_t bx{tile.x0}; bx < tile.x1; bx += mPacketSize)
+        {
+            const std::size_t y1{std::min(by + mPacketSize, tile.y1)};
+            const std::size_t x1{std::min(bx + mPacketSize, tile.x1)};
+
+            std::size_t numPixels{0};
+            for (std::size_t r{by}; r < y1; ++r)
+            {
+                for (std::size_t c{bx}; c < x1; ++c)
                 {
-                    obj->hit(ray, trace_data);
+                    const std::size_t pixel{r * world.width + c};
+                    if (!world.film.isActive(pixel))
+                    {
+                        continue;
+                    }
+
+                    const std::size_t k{numPixels++};
+                    rows[k] = r;
+                    cols[k] = c;
+                    world.sampler->startPixel(cursor, pixel, pass);
+                    samples[k]    = world.sampler->samplePixel(cursor);
+                    sums[k]       = Colour{0, 0, 0};
+                    sumSquares[k] = 0.0f;
                 }
+            }
 
-                pixelAverage += trace_data.color;
+            if (numPixels == 0)
+            {
+                continue;
+            }
+
+            for (int j = 0; j < numSamples; ++j)
+            {
+                packet.clear();
+                for (std::size_t k{0}; k < numPixels; ++k)
+                {
+                    const float x{cols[k] - 0.5f * world.width};
+                    const float y{rows[k] - 0.5f * world.height};
+                    pixelPoint.x = x + samples[k][j].x;
+                    pixelPoint.y = y + samples[k][j].y;
+                    packet.add({mEye, rayDirection(pixelPoint)});
+                }
+
+                {
+                    COMMON_PROFILE_SCOPE(Hit);
+                    world.bvh.traversePacket(
+                        packet, [&](std::uint32_t first, std::uint32_t count) {
+                            world.spheres.closestHitPacket(
+                                packet, first, count);
+                        });
+                }
+
+                for (std::size_t k{0}; k < packet.size; ++k)
+                {
+                    ShadeRec trace_data{};
+                    trace_data.t = std::numeric_limits<float>::max();
+
+                    if (packet.hit[k] >= 0)
+                    {
+                        const Ray<Vector> ray{
+                            mEye, {packet.dx[k], packet.dy[k], packet.dz[k]}};
+                        world.scene[world.spheres.getId(packet.hit[k])]->hit(
+                            ray, trace_data);
+                    }
+
+                    const float y{common::luminance(trace_data.color)};
+                    sums[k] += trace_data.color;
+                    sumSquares[k] += y * y;
+                }
             }
 
-            world.image.push_back({pixelAverage.r * avg,
-                                   pixelAverage.g * avg,
-                                   pixelAverage.b * avg});
+            for (std::size_t k{0}; k < numPixels; ++k)
+            {
+                world.film.add(rows[k] * world.width + cols[k],
+                               sums[k],
+                               sumSquares[k],
+                               numSamples);
+            }
         }
     }
 }
@@ -238,19 +574,30 @@ Regular::Regular(int numSamples, int numSets) : Sampler{numSamples, numSets}
 
 void Regular::generateSamples()
 {
-    int n = static_cast<int>(glm::sqrt(static_cast<float>(mNumSamples)));
+    // an m x n grid, as square as mNumSamples allows, so that every set has
+    // exactly mNumSamples points even when it isn't a perfect square
+    int m = static_cast<int>(glm::sqrt(static_cast<float>(mNumSamples)));
+    while (m > 1 && mNumSamples % m != 0)
+    {
+        --m;
+    }
+    const int n = mNumSamples / m;
+
+    std::vector<common::Sample2D> samples;
+    samples.reserve(mNumSets * mNumSamples);
 
     for (int j = 0; j < mNumSets; ++j)
     {
-        for (int p = 0; p < n; ++p)
+        for (int p = 0; p < m; ++p)
         {
             for (int q = 0; q < n; ++q)
             {
-                mSamples.push_back(
-                    atlas::math::Point{(q + 0.5f) / n, (p + 0.5f) / n, 0.0f});
+                samples.push_back({(q + 0.5f) / n, (p + 0.5f) / m});
             }
         }
     }
+
+    setSamples(samples);
 }
 
 // ***** Regular function members *****
@@ -261,21 +608,175 @@ Random::Random(int numSamples, int numSets) : Sampler{numSamples, numSets}
 
 void Random::generateSamples()
 {
-    atlas::math::Random<float> engine;
+    common::Pcg32 engine{mSeed, 0};
+    std::vector<common::Sample2D> samples;
+    samples.reserve(mNumSets * mNumSamples);
+
     for (int p = 0; p < mNumSets; ++p)
     {
         for (int q = 0; q < mNumSamples; ++q)
         {
-            mSamples.push_back(atlas::math::Point{
-                engine.getRandomOne(), engine.getRandomOne(), 0.0f});
+            const float x{engine.nextFloat()};
+            const float y{engine.nextFloat()};
+            samples.push_back({x, y});
         }
     }
+
+    setSamples(samples);
+}
+
+// ***** Jittered function members *****
+Jittered::Jittered(int numSamples, int numSets) : Sampler{numSamples, numSets}
+{
+    generateSamples();
+}
+
+void Jittered::generateSamples()
+{
+    setSamples(*common::getSampleTable(
+        common::SampleSequence::Jittered, mNumSamples, mNumSets, mSeed));
+}
+
+// ***** MultiJittered function members *****
+MultiJittered::MultiJittered(int numSamples, int numSets) :
+    Sampler{numSamples, numSets}
+{
+    generateSamples();
+}
+
+void MultiJittered::generateSamples()
+{
+    setSamples(*common::getSampleTable(
+        common::SampleSequence::MultiJittered, mNumSamples, mNumSets, mSeed));
+}
+
+// ***** Hammersley function members *****
+Hammersley::Hammersley(int numSamples, int numSets) :
+    Sampler{numSamples, numSets}
+{
+    generateSamples();
+}
+
+void Hammersley::generateSamples()
+{
+    setSamples(*common::getSampleTable(
+        common::SampleSequence::Hammersley, mNumSamples, mNumSets, mSeed));
+}
+
+// ***** Sobol function members *****
+Sobol::Sobol(int numSamples, int numSets) : Sampler{numSamples, numSets}
+{
+    generateSamples();
+}
+
+void Sobol::generateSamples()
+{
+    setSamples(*common::getSampleTable(
+        common::SampleSequence::Sobol, mNumSamples, mNumSets, mSeed));
+}
+
+// ***** R2 function members *****
+R2::R2(int numSamples, int numSets) : Sampler{numSamples, numSets}
+{
+    generateSamples();
+}
+
+void R2::generateSamples()
+{
+    setSamples(*common::getSampleTable(
+        common::SampleSequence::R2, mNumSamples, mNumSets, mSeed));
 }
 
 // ******* Driver Code *******
 
-int main()
+// Renders the scene adaptively, then measures how many uniform passes it
+// takes to reach the same error against an independent reference. Leaves the
+// adaptive render in world.image and its samples in world.film, and returns
+// its time.
+double compareAdaptive(World& world, Camera const& camera)
 {
+    constexpr std::uint32_t referencePasses{64};
+
+    // reference from differently seeded samples, so that neither render
+    // shares samples with it
+    world.sampler->setSeed(1);
+    ProgressiveSettings reference{};
+    reference.maxPasses = referencePasses;
+    camera.renderProgressive(world, reference, [](World const&, std::uint32_t) {
+    });
+    const std::vector<Colour> referenceImage{world.image};
+    world.sampler->setSeed(0);
+
+    common::AdaptiveSettings settings{};
+    settings.minPasses = 2;
+    settings.threshold = 0.004f;
+    settings.maxPasses = 16;
+
+    common::Timer timer;
+    const auto stats{camera.renderAdaptive(world, settings)};
+    const double adaptiveSeconds{timer.elapsedSeconds()};
+    const float adaptiveError{common::getRmsError(world.image, referenceImage)};
+    const std::vector<Colour> adaptiveImage{world.image};
+
+    std::vector<Colour> counts;
+    world.film.resolveCounts(counts);
+    saveToFile("samples.bmp", world.width, world.height, counts);
+
+    // uniform passes until the error matches the adaptive render's, on a
+    // film of their own so that the adaptive one survives
+    common::Film adaptiveFilm{std::move(world.film)};
+    world.film = {};
+    world.film.reset(world.width * world.height);
+    double uniformSeconds{0.0};
+    float uniformError{0.0f};
+    std::uint32_t uniformPasses{0};
+    while (uniformPasses < referencePasses)
+    {
+        timer.reset();
+        camera.renderPass(world, uniformPasses++);
+        uniformSeconds += timer.elapsedSeconds();
+
+        world.film.resolve(world.image);
+        uniformError = common::getRmsError(world.image, referenceImage);
+        if (uniformError <= adaptiveError)
+        {
+            break;
+        }
+    }
+
+    const std::uint64_t uniformSamples{world.film.getNumSamples()};
+    world.film = std::move(adaptiveFilm);
+
+    fmt::print("adaptive: {} passes, {:.2f} Msamples, {:.3f} s, rms error "
+               "{:.5f}, {} pixels unconverged\n",
+               stats.numPasses,
+               stats.numSamples * 1.0e-6,
+               adaptiveSeconds,
+               adaptiveError,
+               stats.numActive);
+    fmt::print("uniform: {} passes, {:.2f} Msamples, {:.3f} s, rms error "
+               "{:.5f}\n",
+               uniformPasses,
+               uniformSamples * 1.0e-6,
+               uniformSeconds,
+               uniformError);
+    fmt::print("time saved at equal error: {:.3f} s ({:.1f}%)\n",
+               uniformSeconds - adaptiveSeconds,
+               100.0 * (1.0 - adaptiveSeconds / uniformSeconds));
+
+    world.image = adaptiveImage;
+    return adaptiveSeconds;
+}
+
+int main(int argc, char** argv)
+{
+    // "--progressive" renders passes for a few seconds instead, saving an
+    // image along the way. "--adaptive" renders adaptively, saving the
+    // per-pixel sample counts to samples.bmp, and compares against uniform
+    // sampling at equal error. "--stream" writes raytrace.bmp a band at a
+    // time while it renders, without ever holding the whole image.
+    const std::string mode{argc > 1 ? argv[1] : ""};
+
     World world{};
 
     // provide world data
@@ -283,6 +784,7 @@ int main()
     world.height     = 600;
     world.background = {0, 0, 0};
     world.sampler    = std::make_shared<Random>(16, 83);
+    world.pool       = std::make_shared<common::ThreadPool>();
 
     world.scene.push_back(
         std::make_shared<Sphere>(atlas::math::Point{64, 64, 0}, 128.0f));
@@ -299,32 +801,136 @@ int main()
     camera.setEye({150.0f, 150.0f, 500.0f});
 
     camera.computeUVW();
+    camera.setPacketSize(8);
 
-    camera.renderScene(world);
+    buildBvh(world);
+
+    common::Timer timer;
+    if (mode == "--stream")
+    {
+        common::ImageSink sink{"raytrace.bmp", world.width, world.height};
+        camera.renderScene(world, sink);
+        fmt::print("render: {:.3f} s, streamed to raytrace.bmp\n",
+                   timer.elapsedSeconds());
+        return 0;
+    }
+
+    if (mode == "--progressive")
+    {
+        ProgressiveSettings settings{};
+        settings.timeBudget  = 2.0;
+        settings.emitSeconds = 0.5;
+
+        // the images are written in the background while the next passes
+        // render
+        common::ImageWriter writer;
+        camera.renderProgressive(
+            world, settings, [&](World const& w, std::uint32_t passes) {
+                fmt::print(
+                    "pass {}: {:.3f} s\n", passes, timer.elapsedSeconds());
+                auto frame{writer.acquireBuffer(w.image.size())};
+                std::copy(w.image.begin(), w.image.end(), frame.begin());
+                writer.write(fmt::format("raytrace_{:04}.bmp", passes),
+                             w.width,
+                             w.height,
+                             std::move(frame));
+            });
+        writer.flush();
+
+        const auto output{writer.getStats()};
+        fmt::print("output: {} images, {:.3f} s writing, {:.3f} s waited "
+                   "for, {:.3f} s overlapped with rendering, {} buffers\n",
+                   output.numFrames,
+                   output.writeSeconds,
+                   output.waitSeconds,
+                   output.writeSeconds - output.waitSeconds,
+                   output.numBuffers);
+    }
+    else if (mode != "--adaptive")
+    {
+        camera.renderScene(world);
+    }
+    const double seconds{mode == "--adaptive" ? compareAdaptive(world, camera)
+                                              : timer.elapsedSeconds()};
+
+    auto const& stats{world.bvh.getStats()};
+    const double numRays{static_cast<double>(world.film.getNumSamples())};
+    fmt::print("bvh: {} objects, {} nodes, depth {}, built in {:.3f} ms, "
+               "{} kernel\n",
+               stats.numPrimitives,
+               stats.numNodes,
+               stats.maxDepth,
+               stats.buildSeconds * 1000.0,
+               common::getSimdName(world.spheres.getSimdLevel()));
+    fmt::print("render: {:.3f} s, {:.2f} Mrays/s\n",
+               seconds,
+               numRays / seconds * 1.0e-6);
 
     saveToFile("raytrace.bmp", world.width, world.height, world.image);
 
     return 0;
 }
 
-void saveToFile(std::string const& filename,
-                std::size_t width,
-                std::size_t height,
-                std::vector<Colour> const& image)
+void buildBvh(World& world)
+{
+    std::vector<common::BBox> bounds;
+    bounds.reserve(world.scene.size());
+
+    bool allSpheres{true};
+    for (auto const& obj : world.scene)
+    {
+        bounds.push_back(obj->getBoundingBox());
+        allSpheres = allSpheres && dynamic_cast<Sphere const*>(obj.get());
+    }
+
+    // size the leaves for the kernel that will test them
+    std::size_t leafWidth{1};
+    switch (world.spheres.getSimdLevel())
+    {
+    case common::SimdLevel::Avx2:
+        leafWidth = 8;
+        break;
+    case common::SimdLevel::Sse2:
+        leafWidth = 4;
+        break;
+    default:
+        break;
+    }
+
+    world.bvh.build(bounds, allSpheres ? leafWidth : 1);
+
+    world.spheres.clear();
+    if (allSpheres)
+    {
+        world.spheres.reserve(world.scene.size());
+        for (auto i : world.bvh.getIndices())
+        {
+            auto const& sphere{static_cast<Sphere const&>(*world.scene[i])};
+            world.spheres.add(sphere.getCentre(), sphere.getRadius(), i);
+        }
+    }
+}
+
+bool hitScene(World const& world,
+              atlas::math::Ray<atlas::math::Vector> const& ray,
+              ShadeRec& sr)
 {
-    std::vector<unsigned char> data(image.size() * 3);
+    COMMON_PROFILE_SCOPE(Hit);
 
-    for (std::size_t i{0}, k{0}; i < image.size(); ++i, k += 3)
+    if (world.spheres.size() != world.scene.size())
     {
-        Colour pixel = image[i];
-        data[k + 0]  = static_cast<unsigned char>(pixel.r * 255);
-        data[k + 1]  = static_cast<unsigned char>(pixel.g * 255);
-        data[k + 2]  = static_cast<unsigned char>(pixel.b * 255);
+        return world.bvh.closestHit(ray, sr.t, [&](std::uint32_t i) {
+            return world.scene[i]->hit(ray, sr);
+        });
     }
 
-    stbi_write_bmp(filename.c_str(),
-                   static_cast<int>(width),
-                   static_cast<int>(height),
-                   3,
-                   data.data());
+    return world.bvh.traverse(
+        ray, sr.t, [&](std::uint32_t first, std::uint32_t count) {
+            // the kernel only finds the closest sphere in the leaf, the
+            // sphere itself then fills in the rest of the record
+            float t{};
+            const int i{world.spheres.closestHit(ray, first, count, sr.t, t)};
+            return i >= 0 &&
+                   world.scene[world.spheres.getId(i)]->hit(ray, sr);
+        });
 }
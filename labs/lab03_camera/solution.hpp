@@ -5,21 +5,41 @@
 #include <atlas/math/Random.hpp>
 #include <atlas/math/Ray.hpp>
 
+#include <common/BBox.hpp>
+#include <common/Bvh.hpp>
+#include <common/CounterRng.hpp>
+#include <common/Film.hpp>
+#include <common/Image.hpp>
+#include <common/ImageSink.hpp>
+#include <common/ImageWriter.hpp>
+#include <common/Pcg32.hpp>
+#include <common/Profile.hpp>
+#include <common/SampleSets.hpp>
+#include <common/SampleTables.hpp>
+#include <common/RayPacket.hpp>
+#include <common/SphereSet.hpp>
+#include <common/ThreadPool.hpp>
+#include <common/Tile.hpp>
+#include <common/Timer.hpp>
+
 #include <fmt/printf.h>
 #include <stb_image.h>
 #include <stb_image_write.h>
 
+#include <cstdint>
+#include <functional>
 #include <limits>
+#include <memory>
+#include <stdexcept>
+#include <string>
 #include <vector>
 
 using atlas::core::areEqual;
 
 using Colour = atlas::math::Vector;
 
-void saveToFile(std::string const& filename,
-                std::size_t width,
-                std::size_t height,
-                std::vector<Colour> const& image);
+// See common::saveToFile in common/Image.hpp.
+using common::saveToFile;
 
 // Declarations
 class Camera;
@@ -39,6 +59,44 @@ struct World
     std::shared_ptr<Sampler> sampler;
     std::vector<std::shared_ptr<Shape>> scene;
     std::vector<Colour> image;
+
+    // samples accumulated by Camera::renderPass
+    common::Film film;
+
+    // acceleration structure over scene, see buildBvh
+    common::Bvh bvh;
+
+    // copy of the spheres in bvh leaf order for the SIMD kernels, empty if
+    // the scene holds other shapes
+    common::SphereSet spheres;
+
+    // if set, tiles are rendered in parallel on this pool
+    std::shared_ptr<common::ThreadPool> pool;
+};
+
+// Rebuilds world.bvh and world.spheres from world.scene. Rays are traced
+// against these, so this must be called whenever the scene changes.
+void buildBvh(World& world);
+
+// Finds the closest object along the ray and fills sr the same way the
+// object's Shape::hit would. Returns true if anything was hit.
+bool hitScene(World const& world,
+              atlas::math::Ray<atlas::math::Vector> const& ray,
+              ShadeRec& sr);
+
+struct ProgressiveSettings
+{
+    // Rendering stops after maxPasses passes or once timeBudget seconds have
+    // gone by, whichever comes first. 0 disables a limit; with both disabled
+    // a single pass is rendered.
+    std::uint32_t maxPasses;
+    double timeBudget;
+
+    // An intermediate image is emitted every emitPasses passes, and after any
+    // pass that ends emitSeconds or more after the last image. 0 disables
+    // either. The final image is always emitted.
+    std::uint32_t emitPasses;
+    double emitSeconds;
 };
 
 // Abstract classes defining the interfaces for concrete entities
@@ -50,7 +108,42 @@ public:
 
     virtual ~Camera() = default;
 
-    virtual void renderScene(World& world) const = 0;
+    // Renders the frame into world.image as a single pass of
+    // world.sampler->getNumSamples() samples per pixel.
+    virtual void renderScene(World& world) const;
+
+    // Renders a single pass like renderScene, but a band of rows at a time
+    // (one row of tiles), writing each band to sink as soon as it is done
+    // and then closing it. world.film only ever holds one band and
+    // world.image is left untouched, so no full frame is kept in memory.
+    void renderScene(World& world, common::ImageSink& sink) const;
+
+    // Adds one more set of world.sampler->getNumSamples() samples to every
+    // active pixel of world.film. Every pass draws different samples, so the
+    // film keeps converging as passes are added.
+    void renderPass(World& world, std::uint32_t pass) const;
+
+    // The same as renderPass for the pixels in rows [y0, y1) only, which
+    // world.film must hold. The tiles are lined up from y0.
+    virtual void renderRows(World& world,
+                            std::uint32_t pass,
+                            std::size_t y0,
+                            std::size_t y1) const = 0;
+
+    // Renders passes into a fresh film until a limit in settings is reached.
+    // Each time an image is due, world.image is resolved from the film and
+    // onImage is called with it and the number of passes rendered so far.
+    void renderProgressive(
+        World& world,
+        ProgressiveSettings const& settings,
+        std::function<void(World const&, std::uint32_t)> const& onImage) const;
+
+    // Renders passes, retiring pixels once their noise is under the
+    // threshold so that later passes only go to the noisy ones, then
+    // resolves world.image. The sample counts are left in world.film.
+    common::AdaptiveStats
+    renderAdaptive(World& world,
+                   common::AdaptiveSettings const& settings) const;
 
     void setEye(atlas::math::Point const& eye);
 
@@ -60,16 +153,38 @@ public:
 
     void computeUVW();
 
+    void setTileSize(std::size_t tileSize);
+
 protected:
     atlas::math::Point mEye;
     atlas::math::Point mLookAt;
     atlas::math::Point mUp;
     atlas::math::Vector mU, mV, mW;
+    std::size_t mTileSize;
+};
+
+// Position of one worker in a Sampler's tables. Every thread that samples
+// keeps its own cursor, so the Sampler itself is only read while rendering.
+struct SampleCursor
+{
+    std::size_t pixel;
+
+    // index of the next sample within the pixel, counted across passes
+    std::uint32_t sample;
+
+    common::Sample2D const* set;
+    int count;
 };
 
 class Sampler
 {
 public:
+    // the shuffled indices are 16 bits
+    static constexpr int maxSamples{65536};
+
+    // Throws std::invalid_argument unless numSamples is in [1, maxSamples],
+    // numSets is at least 1 and there are no more than INT_MAX samples in
+    // all.
     Sampler(int numSamples, int numSets);
     virtual ~Sampler() = default;
 
@@ -79,16 +194,45 @@ public:
 
     virtual void generateSamples() = 0;
 
-    atlas::math::Point sampleUnitSquare();
+    // rebuilds the sample tables, which are a pure function of the seed
+    void setSeed(std::uint64_t seed);
+
+    // Moves the cursor to the first sample of a pixel. Which set a pixel
+    // draws is a counter-based random number keyed on the seed, the pixel
+    // and the sample index (see common/CounterRng.hpp), so a pixel gets the
+    // same samples regardless of which thread renders it, or in which order,
+    // and different samples in every pass.
+    void startPixel(SampleCursor& cursor,
+                    std::size_t pixel,
+                    std::uint32_t pass = 0) const;
+
+    atlas::math::Point sampleUnitSquare(SampleCursor& cursor) const;
+
+    // Hands out a whole set at once: the samples the next getNumSamples()
+    // calls to sampleUnitSquare would return, in the same order. The cursor
+    // must be at the start of a set, as it is after startPixel.
+    common::SampleSpan samplePixel(SampleCursor& cursor) const;
 
 protected:
-    std::vector<atlas::math::Point> mSamples;
-    std::vector<int> mShuffledIndeces;
+    // the set the cursor's pixel draws for the sample it is at
+    common::SampleSpan pickSet(SampleCursor const& cursor) const;
+
+    // packs samples, mNumSets sets of mNumSamples points, into mSets in the
+    // order given by mShuffledIndeces
+    void setSamples(std::vector<common::Sample2D> const& samples);
+
+    common::SampleSets mSets;
+
+    // 16 bits, so at most maxSamples samples per set
+    std::vector<std::uint16_t> mShuffledIndeces;
+
+    // dimensions of the counter-based random numbers drawn by samplers
+    static constexpr std::uint32_t setDimension{0};
+    static constexpr std::uint32_t shuffleDimension{1};
 
     int mNumSamples;
     int mNumSets;
-    unsigned long mCount;
-    int mJump;
+    std::uint64_t mSeed;
 };
 
 class Shape
@@ -101,6 +245,8 @@ public:
     virtual bool hit(atlas::math::Ray<atlas::math::Vector> const& ray,
                      ShadeRec& sr) const = 0;
 
+    virtual common::BBox getBoundingBox() const = 0;
+
     void setColour(Colour const& col);
 
     Colour getColour() const;
@@ -122,6 +268,12 @@ public:
     bool hit(atlas::math::Ray<atlas::math::Vector> const& ray,
              ShadeRec& sr) const;
 
+    common::BBox getBoundingBox() const;
+
+    atlas::math::Point getCentre() const;
+
+    float getRadius() const;
+
 private:
     bool intersectRay(atlas::math::Ray<atlas::math::Vector> const& ray,
                       float& tMin) const;
@@ -139,12 +291,28 @@ public:
     void setDistance(float distance);
     void setZoom(float zoom);
 
+    // Traces primary rays as packets of size x size pixel blocks (at most
+    // 8 x 8) instead of one at a time; 0 turns packets off. Packets are only
+    // used when every object is a sphere, otherwise rays are traced singly.
+    void setPacketSize(std::size_t size);
+
     atlas::math::Vector rayDirection(atlas::math::Point const& p) const;
-    void renderScene(World& world) const;
+    void renderRows(World& world,
+                    std::uint32_t pass,
+                    std::size_t y0,
+                    std::size_t y1) const;
 
 private:
+    void renderTile(World& world,
+                    common::Tile const& tile,
+                    std::uint32_t pass) const;
+    void renderTilePackets(World& world,
+                           common::Tile const& tile,
+                           std::uint32_t pass) const;
+
     float mDistance;
     float mZoom;
+    std::size_t mPacketSize;
 };
 
 class Regular : public Sampler
@@ -162,3 +330,49 @@ public:
 
     void generateSamples();
 };
+
+// Samplers over the low-discrepancy tables in common/SampleTables.hpp. A table
+// is built once and shared by every sampler with the same settings, so
+// creating samplers again (for instance every frame) skips generating the
+// points. Each sampler still shuffles its own indices and packs its own copy
+// of the table, which is linear in numSamples * numSets.
+
+class Jittered : public Sampler
+{
+public:
+    Jittered(int numSamples, int numSets);
+
+    void generateSamples();
+};
+
+class MultiJittered : public Sampler
+{
+public:
+    MultiJittered(int numSamples, int numSets);
+
+    void generateSamples();
+};
+
+class Hammersley : public Sampler
+{
+public:
+    Hammersley(int numSamples, int numSets);
+
+    void generateSamples();
+};
+
+class Sobol : public Sampler
+{
+public:
+    Sobol(int numSamples, int numSets);
+
+    void generateSamples();
+};
+
+class R2 : public Sampler
+{
+public:
+    R2(int numSamples, int numSets);
+
+    void generateSamples();
+};
@@ -5,6 +5,8 @@
 #include <atlas/math/Random.hpp>
 #include <atlas/math/Ray.hpp>
 
+#include <common/Image.hpp>
+
 #include <fmt/printf.h>
 #include <stb_image.h>
 #include <stb_image_write.h>
@@ -17,10 +19,8 @@ using atlas::core::areEqual;
 
 using Colour = atlas::math::Vector;
 
-void saveToFile(std::string const& filename,
-                std::size_t width,
-                std::size_t height,
-                std::vector<Colour> const& image);
+// See common::saveToFile in common/Image.hpp.
+using common::saveToFile;
 
 // Declarations
 class BRDF;
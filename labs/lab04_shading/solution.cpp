@@ -26,11 +26,25 @@ std::shared_ptr<Material> Shape::getMaterial() const
     return mMaterial;
 }
 
+bool Shape::shadowHit(atlas::math::Ray<atlas::math::Vector> const& ray,
+                      float& tMin) const
+{
+    return intersectRay(ray, tMin);
+}
+
 // ***** Sampler function members *****
 Sampler::Sampler(int numSamples, int numSets) :
-    mNumSamples{numSamples}, mNumSets{numSets}, mCount{0}, mJump{0}
+    mNumSamples{numSamples}, mNumSets{numSets}, mSeed{0}
 {
-    mSamples.reserve(mNumSets * mNumSamples);
+    if (numSamples < 1 || numSamples > maxSamples || numSets < 1 ||
+        static_cast<std::int64_t>(numSamples) * numSets >
+            std::numeric_limits<int>::max())
+    {
+        throw std::invalid_argument{
+            "sampler: " + std::to_string(numSamples) + " samples in " +
+            std::to_string(numSets) + " sets is out of range"};
+    }
+
     setupShuffledIndeces();
 }
 
@@ -39,47 +53,126 @@ int Sampler::getNumSamples() const
     return mNumSamples;
 }
 
-void Sampler::setupShuffledIndeces()
+int Sampler::getNumSets() const
 {
-    mShuffledIndeces.reserve(mNumSamples * mNumSets);
-    std::vector<int> indices;
+    return mNumSets;
+}
 
-    std::random_device d;
-    std::mt19937 generator(d());
+std::uint64_t Sampler::getSeed() const
+{
+    return mSeed;
+}
 
-    for (int j = 0; j < mNumSamples; ++j)
-    {
-        indices.push_back(j);
-    }
+void Sampler::setupShuffledIndeces()
+{
+    mShuffledIndeces.reserve(mNumSamples * mNumSets);
+    std::vector<std::uint16_t> indices(mNumSamples);
 
+    // Fisher-Yates with counter-based numbers keyed on the set in place of a
+    // pixel, so every set's order is a pure function of the seed and the
+    // set. std::shuffle would give different orders with different standard
+    // libraries.
     for (int p = 0; p < mNumSets; ++p)
     {
-        std::shuffle(indices.begin(), indices.end(), generator);
-
         for (int j = 0; j < mNumSamples; ++j)
         {
-            mShuffledIndeces.push_back(indices[j]);
+            indices[j] = static_cast<std::uint16_t>(j);
+        }
+
+        for (int j = mNumSamples - 1; j > 0; --j)
+        {
+            const std::uint32_t k{common::counterRandomBounded(
+                mSeed,
+                static_cast<std::uint64_t>(p),
+                static_cast<std::uint32_t>(j),
+                shuffleDimension,
+                static_cast<std::uint32_t>(j + 1))};
+            std::swap(indices[j], indices[k]);
         }
+
+        mShuffledIndeces.insert(
+            mShuffledIndeces.end(), indices.begin(), indices.end());
     }
 }
 
-atlas::math::Point Sampler::sampleUnitSquare()
+void Sampler::setSeed(std::uint64_t seed)
+{
+    mSeed = seed;
+
+    mShuffledIndeces.clear();
+    setupShuffledIndeces();
+    generateSamples();
+}
+
+void Sampler::startPixel(SampleCursor& cursor,
+                         std::size_t pixel,
+                         std::uint32_t pass) const
+{
+    cursor.pixel  = pixel;
+    cursor.sample = pass * static_cast<std::uint32_t>(mNumSamples);
+    cursor.count  = 0;
+}
+
+atlas::math::Point Sampler::sampleUnitSquare(SampleCursor& cursor) const
 {
-    if (mCount % mNumSamples == 0)
+    COMMON_PROFILE_SCOPE(SampleUnitSquare);
+
+    // pick a new set every time a full set has been handed out
+    if (cursor.count == 0)
     {
-        atlas::math::Random<int> engine;
-        mJump = (engine.getRandomMax() % mNumSets) * mNumSamples;
+        cursor.set = pickSet(cursor).first;
     }
 
-    return mSamples[mJump + mShuffledIndeces[mJump + mCount++ % mNumSamples]];
+    const common::Sample2D sample{cursor.set[cursor.count]};
+    cursor.count = (cursor.count + 1 == mNumSamples) ? 0 : cursor.count + 1;
+    ++cursor.sample;
+
+    return atlas::math::Point{sample.x, sample.y, 0.0f};
+}
+
+common::SampleSpan Sampler::samplePixel(SampleCursor& cursor) const
+{
+    COMMON_PROFILE_SCOPE(SampleUnitSquare);
+
+    const common::SampleSpan set{pickSet(cursor)};
+    cursor.sample += static_cast<std::uint32_t>(mNumSamples);
+    return set;
+}
+
+common::SampleSpan Sampler::pickSet(SampleCursor const& cursor) const
+{
+    return mSets.getSet(
+        common::counterRandomBounded(mSeed,
+                                     cursor.pixel,
+                                     cursor.sample,
+                                     setDimension,
+                                     static_cast<std::uint32_t>(mNumSets)));
+}
+
+void Sampler::setSamples(std::vector<common::Sample2D> const& samples)
+{
+    mSets.pack(samples,
+               mShuffledIndeces,
+               static_cast<std::size_t>(mNumSamples),
+               static_cast<std::size_t>(mNumSets));
 }
 
 // ***** Light function members *****
-Colour Light::L([[maybe_unused]] ShadeRec& sr)
+Light::Light() : mColour{0, 0, 0}, mRadiance{0.0f}, mShadows{true}
+{}
+
+Colour Light::L([[maybe_unused]] ShadeRec& sr) const
 {
     return mRadiance * mColour;
 }
 
+bool Light::inShadow(
+    [[maybe_unused]] atlas::math::Ray<atlas::math::Vector> const& ray,
+    [[maybe_unused]] ShadeRec const& sr) const
+{
+    return false;
+}
+
 void Light::scaleRadiance(float b)
 {
     mRadiance = b;
@@ -90,6 +183,16 @@ void Light::setColour(Colour const& c)
     mColour = c;
 }
 
+void Light::setShadows(bool shadows)
+{
+    mShadows = shadows;
+}
+
+bool Light::castsShadows() const
+{
+    return mShadows;
+}
+
 // ***** Sphere function members *****
 Sphere::Sphere(atlas::math::Point center, float radius) :
     mCentre{center}, mRadius{radius}, mRadiusSqr{radius * radius}
@@ -109,12 +212,28 @@ bool Sphere::hit(atlas::math::Ray<atlas::math::Vector> const& ray,
         sr.ray      = ray;
         sr.color    = mColour;
         sr.t        = t;
-        sr.material = mMaterial;
+        sr.material = mMaterial.get();
     }
 
     return intersect;
 }
 
+common::BBox Sphere::getBoundingBox() const
+{
+    const atlas::math::Vector extent{mRadius};
+    return {mCentre - extent, mCentre + extent};
+}
+
+atlas::math::Point Sphere::getCentre() const
+{
+    return mCentre;
+}
+
+float Sphere::getRadius() const
+{
+    return mRadius;
+}
+
 bool Sphere::intersectRay(atlas::math::Ray<atlas::math::Vector> const& ray,
                           float& tMin) const
 {
@@ -158,19 +277,30 @@ Regular::Regular(int numSamples, int numSets) : Sampler{numSamples, numSets}
 
 void Regular::generateSamples()
 {
-    int n = static_cast<int>(glm::sqrt(static_cast<float>(mNumSamples)));
+    // an m x n grid, as square as mNumSamples allows, so that every set has
+    // exactly mNumSamples points even when it isn't a perfect square
+    int m = static_cast<int>(glm::sqrt(static_cast<float>(mNumSamples)));
+    while (m > 1 && mNumSamples % m != 0)
+    {
+        --m;
+    }
+    const int n = mNumSamples / m;
+
+    std::vector<common::Sample2D> samples;
+    samples.reserve(mNumSets * mNumSamples);
 
     for (int j = 0; j < mNumSets; ++j)
     {
-        for (int p = 0; p < n; ++p)
+        for (int p = 0; p < m; ++p)
         {
             for (int q = 0; q < n; ++q)
             {
-                mSamples.push_back(
-                    atlas::math::Point{(q + 0.5f) / n, (p + 0.5f) / n, 0.0f});
+                samples.push_back({(q + 0.5f) / n, (p + 0.5f) / m});
             }
         }
     }
+
+    setSamples(samples);
 }
 
 // ***** Regular function members *****
@@ -181,15 +311,83 @@ Random::Random(int numSamples, int numSets) : Sampler{numSamples, numSets}
 
 void Random::generateSamples()
 {
-    atlas::math::Random<float> engine;
+    common::Pcg32 engine{mSeed, 0};
+    std::vector<common::Sample2D> samples;
+    samples.reserve(mNumSets * mNumSamples);
+
     for (int p = 0; p < mNumSets; ++p)
     {
         for (int q = 0; q < mNumSamples; ++q)
         {
-            mSamples.push_back(atlas::math::Point{
-                engine.getRandomOne(), engine.getRandomOne(), 0.0f});
+            const float x{engine.nextFloat()};
+            const float y{engine.nextFloat()};
+            samples.push_back({x, y});
         }
     }
+
+    setSamples(samples);
+}
+
+// ***** Jittered function members *****
+Jittered::Jittered(int numSamples, int numSets) : Sampler{numSamples, numSets}
+{
+    generateSamples();
+}
+
+void Jittered::generateSamples()
+{
+    setSamples(*common::getSampleTable(
+        common::SampleSequence::Jittered, mNumSamples, mNumSets, mSeed));
+}
+
+// ***** MultiJittered function members *****
+MultiJittered::MultiJittered(int numSamples, int numSets) :
+    Sampler{numSamples, numSets}
+{
+    generateSamples();
+}
+
+void MultiJittered::generateSamples()
+{
+    setSamples(*common::getSampleTable(
+        common::SampleSequence::MultiJittered, mNumSamples, mNumSets, mSeed));
+}
+
+// ***** Hammersley function members *****
+Hammersley::Hammersley(int numSamples, int numSets) :
+    Sampler{numSamples, numSets}
+{
+    generateSamples();
+}
+
+void Hammersley::generateSamples()
+{
+    setSamples(*common::getSampleTable(
+        common::SampleSequence::Hammersley, mNumSamples, mNumSets, mSeed));
+}
+
+// ***** Sobol function members *****
+Sobol::Sobol(int numSamples, int numSets) : Sampler{numSamples, numSets}
+{
+    generateSamples();
+}
+
+void Sobol::generateSamples()
+{
+    setSamples(*common::getSampleTable(
+        common::SampleSequence::Sobol, mNumSamples, mNumSets, mSeed));
+}
+
+// ***** R2 function members *****
+R2::R2(int numSamples, int numSets) : Sampler{numSamples, numSets}
+{
+    generateSamples();
+}
+
+void R2::generateSamples()
+{
+    setSamples(*common::getSampleTable(
+        common::SampleSequence::R2, mNumSamples, mNumSets, mSeed));
 }
 
 // ***** Lambertian function members *****
@@ -226,10 +424,7 @@ void Lambertian::setDiffuseColour(Colour const& colour)
 }
 
 // ***** Matte function members *****
-Matte::Matte() :
-    Material{},
-    mDiffuseBRDF{std::make_shared<Lambertian>()},
-    mAmbientBRDF{std::make_shared<Lambertian>()}
+Matte::Matte() : Material{}, mDiffuseBRDF{}, mAmbientBRDF{}
 {}
 
 Matte::Matte(float kd, float ka, Colour color) : Matte{}
@@ -241,38 +436,57 @@ Matte::Matte(float kd, float ka, Colour color) : Matte{}
 
 void Matte::setDiffuseReflection(float k)
 {
-    mDiffuseBRDF->setDiffuseReflection(k);
+    mDiffuseBRDF.setDiffuseReflection(k);
 }
 
 void Matte::setAmbientReflection(float k)
 {
-    mAmbientBRDF->setDiffuseReflection(k);
+    mAmbientBRDF.setDiffuseReflection(k);
 }
 
 void Matte::setDiffuseColour(Colour colour)
 {
-    mDiffuseBRDF->setDiffuseColour(colour);
-    mAmbientBRDF->setDiffuseColour(colour);
+    mDiffuseBRDF.setDiffuseColour(colour);
+    mAmbientBRDF.setDiffuseColour(colour);
+}
+
+Lambertian const& Matte::getDiffuseBRDF() const
+{
+    return mDiffuseBRDF;
+}
+
+Lambertian const& Matte::getAmbientBRDF() const
+{
+    return mAmbientBRDF;
 }
 
-Colour Matte::shade(ShadeRec& sr)
+Colour Matte::shade(ShadeRec& sr) const
 {
+    COMMON_PROFILE_SCOPE(Shade);
+
     using atlas::math::Ray;
     using atlas::math::Vector;
 
     Vector wo        = -sr.ray.o;
-    Colour L         = mAmbientBRDF->rho(sr, wo) * sr.world->ambient->L(sr);
+    Colour L         = mAmbientBRDF.rho(sr, wo) * sr.world->ambient->L(sr);
     size_t numLights = sr.world->lights.size();
+    const atlas::math::Point hitPoint{sr.ray.o + sr.t * sr.ray.d};
 
     for (size_t i{0}; i < numLights; ++i)
     {
-        Vector wi    = sr.world->lights[i]->getDirection(sr);
+        Light const& light{*sr.world->lights[i]};
+        Vector wi    = light.getDirection(sr);
         float nDotWi = glm::dot(sr.normal, wi);
 
         if (nDotWi > 0.0f)
         {
-            L += mDiffuseBRDF->fn(sr, wo, wi) * sr.world->lights[i]->L(sr) *
-                 nDotWi;
+            if (light.castsShadows() &&
+                light.inShadow(Ray<Vector>{hitPoint, wi}, sr))
+            {
+                continue;
+            }
+
+            L += mDiffuseBRDF.fn(sr, wo, wi) * light.L(sr) * nDotWi;
         }
     }
 
@@ -293,27 +507,151 @@ void Directional::setDirection(atlas::math::Vector const& d)
     mDirection = glm::normalize(d);
 }
 
-atlas::math::Vector Directional::getDirection([[maybe_unused]] ShadeRec& sr)
+atlas::math::Vector
+Directional::getDirection([[maybe_unused]] ShadeRec& sr) const
 {
     return mDirection;
 }
 
+bool Directional::inShadow(atlas::math::Ray<atlas::math::Vector> const& ray,
+                           ShadeRec const& sr) const
+{
+    // the light is infinitely far away, so anything along the ray blocks it
+    return occludedScene(*sr.world, ray, std::numeric_limits<float>::max());
+}
+
 // ***** Ambient function members *****
 Ambient::Ambient() : Light{}
 {}
 
-atlas::math::Vector Ambient::getDirection([[maybe_unused]] ShadeRec& sr)
+atlas::math::Vector
+Ambient::getDirection([[maybe_unused]] ShadeRec& sr) const
 {
     return atlas::math::Vector{0.0f};
 }
 
 // ******* Driver Code *******
 
-int main()
+// Renders the scene adaptively, then measures how many uniform passes it
+// takes to reach the same error against an independent reference. Leaves the
+// adaptive render in world.image and its samples in world.film, and returns
+// its time.
+double compareAdaptive(World& world)
 {
-    using atlas::math::Point;
-    using atlas::math::Ray;
-    using atlas::math::Vector;
+    constexpr std::uint32_t referencePasses{64};
+
+    // reference from differently seeded samples, so that neither render
+    // shares samples with it
+    world.sampler->setSeed(1);
+    world.film.reset(world.width * world.height);
+    for (std::uint32_t pass{0}; pass < referencePasses; ++pass)
+    {
+        renderPass(world, pass);
+    }
+    std::vector<Colour> referenceImage;
+    world.film.resolve(referenceImage);
+    world.sampler->setSeed(0);
+
+    common::AdaptiveSettings settings{};
+    settings.minPasses = 2;
+    settings.threshold = 0.004f;
+    settings.maxPasses = 32;
+
+    common::Timer timer;
+    const auto stats{renderAdaptive(world, settings)};
+    const double adaptiveSeconds{timer.elapsedSeconds()};
+    const float adaptiveError{common::getRmsError(world.image, referenceImage)};
+    const std::vector<Colour> adaptiveImage{world.image};
+
+    std::vector<Colour> counts;
+    world.film.resolveCounts(counts);
+    saveToFile("samples.bmp", world.width, world.height, counts);
+
+    // uniform passes until the error matches the adaptive render's, on a
+    // film of their own so that the adaptive one survives
+    common::Film adaptiveFilm{std::move(world.film)};
+    world.film = {};
+    world.film.reset(world.width * world.height);
+    double uniformSeconds{0.0};
+    float uniformError{0.0f};
+    std::uint32_t uniformPasses{0};
+    while (uniformPasses < referencePasses)
+    {
+        timer.reset();
+        renderPass(world, uniformPasses++);
+        uniformSeconds += timer.elapsedSeconds();
+
+        world.film.resolve(world.image);
+        uniformError = common::getRmsError(world.image, referenceImage);
+        if (uniformError <= adaptiveError)
+        {
+            break;
+        }
+    }
+
+    const std::uint64_t uniformSamples{world.film.getNumSamples()};
+    world.film = std::move(adaptiveFilm);
+
+    fmt::print("adaptive: {} passes, {:.2f} Msamples, {:.3f} s, rms error "
+               "{:.5f}, {} pixels unconverged\n",
+               stats.numPasses,
+               stats.numSamples * 1.0e-6,
+               adaptiveSeconds,
+               adaptiveError,
+               stats.numActive);
+    fmt::print("uniform: {} passes, {:.2f} Msamples, {:.3f} s, rms error "
+               "{:.5f}\n",
+               uniformPasses,
+               uniformSamples * 1.0e-6,
+               uniformSeconds,
+               uniformError);
+    fmt::print("time saved at equal error: {:.3f} s ({:.1f}%)\n",
+               uniformSeconds - adaptiveSeconds,
+               100.0 * (1.0 - adaptiveSeconds / uniformSeconds));
+
+    world.image = adaptiveImage;
+    return adaptiveSeconds;
+}
+
+int main(int argc, char** argv)
+{
+    // "--adaptive" renders adaptively, saving the per-pixel sample counts to
+    // samples.bmp, and compares against uniform sampling at equal error.
+    // "--cache file" saves the compiled scene as a scene cache. "--hdr file"
+    // also saves the render as floats, unclamped, to a .pfm or .exr file.
+    // Any other argument names a scene file (or a scene cache, if it ends in
+    // .cache) to render instead of the one below.
+    bool adaptive{false};
+    std::string sceneFile;
+    std::string cacheFile;
+    std::string hdrFile;
+    for (int i{1}; i < argc; ++i)
+    {
+        const std::string arg{argv[i]};
+        if (arg == "--adaptive")
+        {
+            adaptive = true;
+        }
+        else if (arg == "--cache" && i + 1 < argc)
+        {
+            cacheFile = argv[++i];
+        }
+        else if (arg == "--hdr" && i + 1 < argc)
+        {
+            hdrFile = argv[++i];
+        }
+        else
+        {
+            sceneFile = arg;
+        }
+    }
+
+    const std::string cacheExtension{".cache"};
+    const bool loadCache{
+        sceneFile.size() > cacheExtension.size() &&
+        sceneFile.compare(sceneFile.size() - cacheExtension.size(),
+                          cacheExtension.size(),
+                          cacheExtension) == 0};
 
     std::shared_ptr<World> world{std::make_shared<World>()};
 
@@ -322,27 +660,27 @@ int main()
     world->background = {0, 0, 0};
     world->sampler    = std::make_shared<Random>(4, 83);
 
-    world->scene.push_back(
-        std::make_shared<Sphere>(atlas::math::Point{0, 0, -600}, 128.0f));
+    world->scene.push_back(makeSceneObject<Sphere>(
+        *world, atlas::math::Point{0, 0, -600}, 128.0f));
     world->scene[0]->setMaterial(
-        std::make_shared<Matte>(0.50f, 0.05f, Colour{1, 0, 0}));
+        makeSceneObject<Matte>(*world, 0.50f, 0.05f, Colour{1, 0, 0}));
     world->scene[0]->setColour({1, 0, 0});
 
-    world->scene.push_back(
-        std::make_shared<Sphere>(atlas::math::Point{128, 32, -700}, 64.0f));
+    world->scene.push_back(makeSceneObject<Sphere>(
+        *world, atlas::math::Point{128, 32, -700}, 64.0f));
     world->scene[1]->setMaterial(
-        std::make_shared<Matte>(0.50f, 0.05f, Colour{0, 0, 1}));
+        makeSceneObject<Matte>(*world, 0.50f, 0.05f, Colour{0, 0, 1}));
     world->scene[1]->setColour({0, 0, 1});
 
-    world->scene.push_back(
-        std::make_shared<Sphere>(atlas::math::Point{-128, 32, -700}, 64.0f));
+    world->scene.push_back(makeSceneObject<Sphere>(
+        *world, atlas::math::Point{-128, 32, -700}, 64.0f));
     world->scene[2]->setMaterial(
-        std::make_shared<Matte>(0.50f, 0.05f, Colour{0, 1, 0}));
+        makeSceneObject<Matte>(*world, 0.50f, 0.05f, Colour{0, 1, 0}));
     world->scene[2]->setColour({0, 1, 0});
 
-    world->ambient = std::make_shared<Ambient>();
-    world->lights.push_back(
-        std::make_shared<Directional>(Directional{{0, 0, 1024}}));
+    world->ambient = makeSceneObject<Ambient>(*world);
+    world->lights.push_back(makeSceneObject<Directional>(
+        *world, atlas::math::Vector{0, 0, 1024}));
 
     world->ambient->setColour({1, 1, 1});
     world->ambient->scaleRadiance(0.05f);
@@ -350,68 +688,1003 @@ int main()
     world->lights[0]->setColour({1, 1, 1});
     world->lights[0]->scaleRadiance(4.0f);
 
-    Point samplePoint{}, pixelPoint{};
-    Ray<atlas::math::Vector> ray{{0, 0, 0}, {0, 0, -1}};
+    try
+    {
+        if (!sceneFile.empty())
+        {
+            common::Timer loadTimer;
+            world = loadCache ? loadSceneCache(sceneFile)
+                              : loadScene(sceneFile);
+            fmt::print("load: {} objects in {:.3f} s\n",
+                       world->compiled ? world->compiled->shapeMaterials.size
+                                       : world->scene.size(),
+                       loadTimer.elapsedSeconds());
+        }
 
-    float avg{1.0f / world->sampler->getNumSamples()};
+        // a scene cache comes compiled
+        if (!loadCache)
+        {
+            compileScene(*world);
+        }
+
+        if (!cacheFile.empty())
+        {
+            saveSceneCache(*world, cacheFile);
+        }
+    }
+    catch (common::SceneError const& error)
+    {
+        fmt::print(stderr, "{}\n", error.what());
+        return 1;
+    }
 
-    for (int r{0}; r < world->height; ++r)
+    common::Timer timer;
+    if (!adaptive)
     {
-        for (int c{0}; c < world->width; ++c)
+        render(*world);
+    }
+
+    const double seconds{adaptive ? compareAdaptive(*world)
+                                  : timer.elapsedSeconds()};
+    auto const& stats{world->bvh.getStats()};
+    const double numRays{static_cast<double>(world->film.getNumSamples())};
+    fmt::print("bvh: {} objects, {} nodes, depth {}, built in {:.3f} ms, "
+               "{} kernel\n",
+               stats.numPrimitives,
+               stats.numNodes,
+               stats.maxDepth,
+               stats.buildSeconds * 1000.0,
+               common::getSimdName(world->spheres.getSimdLevel()));
+    fmt::print("render: {:.3f} s, {:.2f} Mrays/s\n",
+               seconds,
+               numRays / seconds * 1.0e-6);
+
+    saveToFile("raytrace.bmp", world->width, world->height, world->image);
+    if (!hdrFile.empty())
+    {
+        saveToFile(hdrFile, world->width, world->height, world->image);
+    }
+
+    return 0;
+}
+
+void renderPass(World& world, std::uint32_t pass)
+{
+    using atlas::math::Point;
+    using atlas::math::Ray;
+    using atlas::math::Vector;
+
+    Point pixelPoint{};
+    Ray<Vector> ray{{0, 0, 0}, {0, 0, -1}};
+    SampleCursor cursor{};
+
+    const int numSamples{world.sampler->getNumSamples()};
+
+    if (world.film.sums.size() != world.width * world.height)
+    {
+        world.film.reset(world.width * world.height);
+    }
+
+    for (std::size_t r{0}; r < world.height; ++r)
+    {
+        for (std::size_t c{0}; c < world.width; ++c)
         {
-            Colour pixelAverage{0, 0, 0};
+            const std::size_t pixel{r * world.width + c};
+            if (!world.film.active[pixel])
+            {
+                continue;
+            }
+
+            Colour pixelSum{0, 0, 0};
+            float sumSquare{0.0f};
+            world.sampler->startPixel(cursor, pixel, pass);
+            std::uint32_t sampleIndex{cursor.sample};
 
-            for (int j = 0; j < world->sampler->getNumSamples(); ++j)
+            for (auto const& sample : world.sampler->samplePixel(cursor))
             {
                 ShadeRec trace_data{};
-                trace_data.world = world;
-                trace_data.t     = std::numeric_limits<float>::max();
-                samplePoint      = world->sampler->sampleUnitSquare();
-                pixelPoint.x     = c - 0.5f * world->width + samplePoint.x;
-                pixelPoint.y     = r - 0.5f * world->height + samplePoint.y;
-                ray.o = atlas::math::Vector{pixelPoint.x, pixelPoint.y, 0};
-                bool hit{};
-
-                for (auto obj : world->scene)
+                trace_data.world  = &world;
+                trace_data.t      = std::numeric_limits<float>::max();
+                trace_data.pixel  = pixel;
+                trace_data.sample = sampleIndex++;
+                pixelPoint.x     = c - 0.5f * world.width + sample.x;
+                pixelPoint.y     = r - 0.5f * world.height + sample.y;
+                ray.o            = Vector{pixelPoint.x, pixelPoint.y, 0};
+                bool hit{hitScene(world, ray, trace_data)};
+
+                if (hit)
                 {
-                    hit |= obj->hit(ray, trace_data);
+                    const Colour L{shadeScene(world, trace_data)};
+                    const float y{common::luminance(L)};
+                    pixelSum += L;
+                    sumSquare += y * y;
                 }
+            }
 
-                if (hit)
+            world.film.add(pixel, pixelSum, sumSquare, numSamples);
+        }
+    }
+}
+
+void render(World& world)
+{
+    world.film.reset(world.width * world.height);
+    renderPass(world, 0);
+    world.film.resolve(world.image);
+}
+
+common::AdaptiveStats renderAdaptive(World& world,
+                                     common::AdaptiveSettings const& settings)
+{
+    const auto stats{common::renderAdaptive(
+        world.film,
+        world.width * world.height,
+        settings,
+        [&](std::uint32_t pass) { renderPass(world, pass); })};
+
+    world.film.resolve(world.image);
+    return stats;
+}
+
+void buildBvh(World& world)
+{
+    std::vector<common::BBox> bounds;
+    bounds.reserve(world.scene.size());
+
+    bool allSpheres{true};
+    for (auto const& obj : world.scene)
+    {
+        bounds.push_back(obj->getBoundingBox());
+        allSpheres = allSpheres && dynamic_cast<Sphere const*>(obj.get());
+    }
+
+    // size the leaves for the kernel that will test them
+    std::size_t leafWidth{1};
+    switch (world.spheres.getSimdLevel())
+    {
+    case common::SimdLevel::Avx2:
+        leafWidth = 8;
+        break;
+    case common::SimdLevel::Sse2:
+        leafWidth = 4;
+        break;
+    default:
+        break;
+    }
+
+    world.bvh.build(bounds, allSpheres ? leafWidth : 1);
+
+    world.spheres.clear();
+    if (allSpheres)
+    {
+        world.spheres.reserve(world.scene.size());
+        for (auto i : world.bvh.getIndices())
+        {
+            auto const& sphere{static_cast<Sphere const&>(*world.scene[i])};
+            world.spheres.add(sphere.getCentre(), sphere.getRadius(), i);
+        }
+    }
+}
+
+namespace
+{
+    // counter-based random number dimensions used while shading, after the
+    // ones Sampler uses
+    constexpr std::uint32_t lightDimension{2};
+
+    // Lets one generic lambda handle both the concrete alternatives of a
+    // compiled variant and the base pointer fallback.
+    template<typename T>
+    T const& deref(T const& object)
+    {
+        return object;
+    }
+
+    template<typename T>
+    T const& deref(T const* object)
+    {
+        return *object;
+    }
+
+    // None of the concrete BRDFs and lights look at the shading point, so
+    // any record will do when baking them.
+    CompiledLight compileLight(Light const& light)
+    {
+        ShadeRec sr{};
+
+        if (auto directional{dynamic_cast<Directional const*>(&light)})
+        {
+            return DirectionalRecord{directional->getDirection(sr),
+                                     directional->L(sr),
+                                     directional->castsShadows()};
+        }
+
+        if (auto ambient{dynamic_cast<Ambient const*>(&light)})
+        {
+            return AmbientRecord{ambient->L(sr)};
+        }
+
+        return &light;
+    }
+
+    CompiledMaterial compileMaterial(Material const& material)
+    {
+        if (auto matte{dynamic_cast<Matte const*>(&material)})
+        {
+            ShadeRec sr{};
+            const atlas::math::Vector w{0, 0, 1};
+            return MatteRecord{matte->getAmbientBRDF().rho(sr, w),
+                               matte->getDiffuseBRDF().fn(sr, w, w)};
+        }
+
+        return &material;
+    }
+
+    CompiledShape compileShape(Shape const& shape)
+    {
+        if (auto sphere{dynamic_cast<Sphere const*>(&shape)})
+        {
+            return *sphere;
+        }
+
+        return &shape;
+    }
+
+    // Light queries, one overload per alternative of CompiledLight.
+
+    atlas::math::Vector lightDirection(DirectionalRecord const& light,
+                                       [[maybe_unused]] ShadeRec& sr)
+    {
+        return light.direction;
+    }
+
+    atlas::math::Vector
+    lightDirection([[maybe_unused]] AmbientRecord const& light,
+                   [[maybe_unused]] ShadeRec& sr)
+    {
+        return atlas::math::Vector{0.0f};
+    }
+
+    atlas::math::Vector lightDirection(Light const* light, ShadeRec& sr)
+    {
+        return light->getDirection(sr);
+    }
+
+    template<typename LightRecord>
+    Colour lightRadiance(LightRecord const& light,
+                         [[maybe_unused]] ShadeRec& sr)
+    {
+        return light.radiance;
+    }
+
+    Colour lightRadiance(Light const* light, ShadeRec& sr)
+    {
+        return light->L(sr);
+    }
+
+    bool lightBlocked(DirectionalRecord const& light,
+                      atlas::math::Ray<atlas::math::Vector> const& ray,
+                      ShadeRec const& sr)
+    {
+        // same as Directional::inShadow
+        return light.shadows &&
+               occludedScene(
+                   *sr.world, ray, std::numeric_limits<float>::max());
+    }
+
+    bool lightBlocked(
+        [[maybe_unused]] AmbientRecord const& light,
+        [[maybe_unused]] atlas::math::Ray<atlas::math::Vector> const& ray,
+        [[maybe_unused]] ShadeRec const& sr)
+    {
+        return false;
+    }
+
+    bool lightBlocked(Light const* light,
+                      atlas::math::Ray<atlas::math::Vector> const& ray,
+                      ShadeRec const& sr)
+    {
+        return light->castsShadows() && light->inShadow(ray, sr);
+    }
+
+    atlas::math::Vector lightDirection(CompiledLight const& light,
+                                       ShadeRec& sr)
+    {
+        return std::visit(
+            [&sr](auto const& l) { return lightDirection(l, sr); }, light);
+    }
+
+    Colour lightRadiance(CompiledLight const& light, ShadeRec& sr)
+    {
+        return std::visit(
+            [&sr](auto const& l) { return lightRadiance(l, sr); }, light);
+    }
+
+    bool lightBlocked(CompiledLight const& light,
+                      atlas::math::Ray<atlas::math::Vector> const& ray,
+                      ShadeRec const& sr)
+    {
+        return std::visit(
+            [&](auto const& l) { return lightBlocked(l, ray, sr); }, light);
+    }
+
+    // Same as Matte::shade, but reading the baked records and optionally
+    // shading only a sample of the lights, see World::lightSamples.
+    Colour shadeMaterial(MatteRecord const& matte,
+                         CompiledScene const& scene,
+                         ShadeRec& sr)
+    {
+        using atlas::math::Vector;
+
+        Colour L = matte.ambient * lightRadiance(scene.ambient, sr);
+        const atlas::math::Point hitPoint{sr.ray.o + sr.t * sr.ray.d};
+
+        auto directLight = [&](CompiledLight const& light) {
+            Vector wi    = lightDirection(light, sr);
+            float nDotWi = glm::dot(sr.normal, wi);
+
+            if (nDotWi <= 0.0f || lightBlocked(light, {hitPoint, wi}, sr))
+            {
+                return Colour{0, 0, 0};
+            }
+
+            return matte.diffuse * lightRadiance(light, sr) * nDotWi;
+        };
+
+        const std::uint32_t numSamples{sr.world->lightSamples};
+        if (numSamples == 0 || numSamples >= scene.lights.size())
+        {
+            for (auto const& light : scene.lights)
+            {
+                L += directLight(light);
+            }
+            return L;
+        }
+
+        // Estimates the sum over every light from numSamples of them, each
+        // divided by the probability of picking it, so the result is right
+        // on average and the cost doesn't depend on the number of lights.
+        const std::uint64_t seed{sr.world->sampler->getSeed()};
+        Colour direct{0, 0, 0};
+        for (std::uint32_t k{0}; k < numSamples; ++k)
+        {
+            float pdf{};
+            const std::uint32_t i{scene.lightTable.sample(
+                common::counterRandom(
+                    seed, sr.pixel, sr.sample, lightDimension + k),
+                pdf)};
+            direct += directLight(scene.lights[i]) / pdf;
+        }
+
+        return L + direct / static_cast<float>(numSamples);
+    }
+
+    Colour shadeMaterial(Material const& material,
+                         [[maybe_unused]] CompiledScene const& scene,
+                         ShadeRec& sr)
+    {
+        return material.shade(sr);
+    }
+
+    void buildLightTable(CompiledScene& scene)
+    {
+        std::vector<float> powers;
+        powers.reserve(scene.lights.size());
+
+        // the lights' radiance doesn't depend on the point being shaded
+        ShadeRec sr{};
+        for (auto const& light : scene.lights)
+        {
+            powers.push_back(common::luminance(lightRadiance(light, sr)));
+        }
+        scene.lightTable.build(powers);
+    }
+} // namespace
+
+void compileScene(World& world)
+{
+    auto compiled{std::make_shared<CompiledScene>()};
+    compiled->shapes.reserve(world.scene.size());
+    compiled->shapeMaterialStorage.reserve(world.scene.size());
+
+    // each distinct material is compiled once, at the index it is first
+    // seen at
+    std::unordered_map<Material const*, std::uint32_t> materialIndices;
+    for (auto const& obj : world.scene)
+    {
+        compiled->shapes.push_back(compileShape(*obj));
+        if (auto sphere{std::get_if<Sphere>(&compiled->shapes.back())})
+        {
+            compiled->sphereStorage.push_back(
+                {sphere->getCentre(), sphere->getRadius(), obj->getColour()});
+        }
+
+        Material const* material{obj->getMaterial().get()};
+        auto [it, inserted]{materialIndices.emplace(
+            material,
+            static_cast<std::uint32_t>(compiled->materials.size()))};
+        if (inserted)
+        {
+            compiled->materials.push_back(compileMaterial(*material));
+        }
+        compiled->shapeMaterialStorage.push_back(it->second);
+    }
+
+    if (compiled->sphereStorage.size() != world.scene.size())
+    {
+        compiled->sphereStorage = {};
+    }
+    compiled->shapeMaterials = {compiled->shapeMaterialStorage.data(),
+                                compiled->shapeMaterialStorage.size()};
+
+    compiled->spheres = {compiled->sphereStorage.data(),
+                         compiled->sphereStorage.size()};
+
+    compiled->lights.reserve(world.lights.size());
+    for (auto const& light : world.lights)
+    {
+        compiled->lights.push_back(compileLight(*light));
+    }
+    compiled->ambient = compileLight(*world.ambient);
+    buildLightTable(*compiled);
+
+    world.compiled = compiled;
+    buildBvh(world);
+}
+
+bool hitScene(World const& world,
+              atlas::math::Ray<atlas::math::Vector> const& ray,
+              ShadeRec& sr)
+{
+    COMMON_PROFILE_SCOPE(Hit);
+
+    auto const& scene{*world.compiled};
+    if (scene.spheres.empty())
+    {
+        auto hitShape = [&](std::uint32_t i) {
+            const float t{sr.t};
+            const bool hit{std::visit(
+                [&](auto const& shape) { return deref(shape).hit(ray, sr); },
+                scene.shapes[i])};
+
+            if (sr.t < t)
+            {
+                sr.object = i;
+            }
+            return hit;
+        };
+
+        return world.bvh.closestHit(ray, sr.t, hitShape);
+    }
+
+    return world.bvh.traverse(
+        ray, sr.t, [&](std::uint32_t first, std::uint32_t count) {
+            float t{};
+            const int i{world.spheres.closestHit(ray, first, count, sr.t, t)};
+            if (i < 0)
+            {
+                return false;
+            }
+
+            // the kernel finds the same sphere and t as Sphere::hit, the
+            // rest of the record is filled in the same way
+            const std::uint32_t id{world.spheres.getId(i)};
+            SphereRecord const& sphere{scene.spheres[id]};
+            sr.normal   = (ray.o - sphere.centre + t * ray.d) / sphere.radius;
+            sr.ray      = ray;
+            sr.color    = sphere.colour;
+            sr.t        = t;
+            sr.material = nullptr;
+            sr.object   = id;
+            return true;
+        });
+}
+
+bool occludedScene(World const& world,
+                   atlas::math::Ray<atlas::math::Vector> const& ray,
+                   float tMax)
+{
+    COMMON_PROFILE_SCOPE(Occluded);
+
+    auto const& scene{*world.compiled};
+    if (scene.spheres.empty())
+    {
+        auto const& indices{world.bvh.getIndices()};
+        return world.bvh.anyHit(
+            ray, tMax, [&](std::uint32_t first, std::uint32_t count) {
+                for (std::uint32_t i{first}; i < first + count; ++i)
                 {
-                    pixelAverage += trace_data.material->shade(trace_data);
+                    float t{};
+                    const bool hit{std::visit(
+                        [&](auto const& shape) {
+                            return deref(shape).shadowHit(ray, t);
+                        },
+                        scene.shapes[indices[i]])};
+
+                    if (hit && t < tMax)
+                    {
+                        return true;
+                    }
                 }
+                return false;
+            });
+    }
+
+    return world.bvh.anyHit(
+        ray, tMax, [&](std::uint32_t first, std::uint32_t count) {
+            return world.spheres.anyHit(ray, first, count, tMax);
+        });
+}
+
+Colour shadeScene(World const& world, ShadeRec& sr)
+{
+    COMMON_PROFILE_SCOPE(Shade);
+
+    auto const& scene{*world.compiled};
+    return std::visit(
+        [&](auto const& material) {
+            return shadeMaterial(deref(material), scene, sr);
+        },
+        scene.materials[scene.shapeMaterials[sr.object]]);
+}
+
+namespace
+{
+    std::shared_ptr<Sampler>
+    makeSampler(std::string_view name, int numSamples, int numSets)
+    {
+        if (name == "regular")
+        {
+            return std::make_shared<Regular>(numSamples, numSets);
+        }
+        if (name == "random")
+        {
+            return std::make_shared<Random>(numSamples, numSets);
+        }
+        if (name == "jittered")
+        {
+            return std::make_shared<Jittered>(numSamples, numSets);
+        }
+        if (name == "multi_jittered")
+        {
+            return std::make_shared<MultiJittered>(numSamples, numSets);
+        }
+        if (name == "hammersley")
+        {
+            return std::make_shared<Hammersley>(numSamples, numSets);
+        }
+        if (name == "sobol")
+        {
+            return std::make_shared<Sobol>(numSamples, numSets);
+        }
+        if (name == "r2")
+        {
+            return std::make_shared<R2>(numSamples, numSets);
+        }
+        return nullptr;
+    }
+
+    Colour readColour(common::SceneReader& reader)
+    {
+        const float r{reader.readFloat()};
+        const float g{reader.readFloat()};
+        const float b{reader.readFloat()};
+        return {r, g, b};
+    }
+
+    atlas::math::Vector readVector(common::SceneReader& reader)
+    {
+        return readColour(reader);
+    }
+} // namespace
+
+std::shared_ptr<World> loadScene(std::string const& filename)
+{
+    common::SceneReader reader{filename};
+
+    auto world{std::make_shared<World>()};
+    world->width        = 600;
+    world->height       = 600;
+    world->background   = {0, 0, 0};
+    world->sampler      = std::make_shared<Random>(1, 83);
+    world->ambient      = makeSceneObject<Ambient>(*world);
+    world->lightSamples = 0;
+
+    // Materials are looked up by name for every shape, so the key is reused
+    // rather than allocated each time. Shapes take the colour of their
+    // material.
+    std::unordered_map<std::string, std::size_t> materialNames;
+    std::vector<std::pair<std::shared_ptr<Material>, Colour>> materials;
+    std::string key;
+
+    while (reader.nextStatement())
+    {
+        const std::string_view keyword{reader.readWord()};
+
+        // by far the most common statement, so it is checked first
+        if (keyword == "sphere")
+        {
+            const atlas::math::Point centre{readVector(reader)};
+            const float radius{reader.readFloat()};
+            key.assign(reader.readWord());
+
+            auto it{materialNames.find(key)};
+            if (it == materialNames.end())
+            {
+                reader.fail("unknown material '" + key + "'");
+            }
+
+            auto sphere{makeSceneObject<Sphere>(*world, centre, radius)};
+            sphere->setMaterial(materials[it->second].first);
+            sphere->setColour(materials[it->second].second);
+            world->scene.push_back(std::move(sphere));
+        }
+        else if (keyword == "material")
+        {
+            key.assign(reader.readWord());
+            if (reader.readWord() != "matte")
+            {
+                reader.fail("unknown material type, expected 'matte'");
             }
 
-            world->image.push_back({pixelAverage.r * avg,
-                                    pixelAverage.g * avg,
-                                    pixelAverage.b * avg});
+            const float kd{reader.readFloat()};
+            const float ka{reader.readFloat()};
+            const Colour colour{readColour(reader)};
+
+            if (!materialNames.emplace(key, materials.size()).second)
+            {
+                reader.fail("material '" + key + "' is already defined");
+            }
+            materials.emplace_back(
+                makeSceneObject<Matte>(*world, kd, ka, colour), colour);
+        }
+        else if (keyword == "directional")
+        {
+            const atlas::math::Vector direction{readVector(reader)};
+            const Colour colour{readColour(reader)};
+            const float radiance{reader.readFloat()};
+
+            auto light{makeSceneObject<Directional>(*world, direction)};
+            light->setColour(colour);
+            light->scaleRadiance(radiance);
+            if (!reader.isEndOfStatement())
+            {
+                if (reader.readWord() != "noshadows")
+                {
+                    reader.fail("expected 'noshadows'");
+                }
+                light->setShadows(false);
+            }
+            world->lights.push_back(std::move(light));
+        }
+        else if (keyword == "ambient")
+        {
+            world->ambient->setColour(readColour(reader));
+            world->ambient->scaleRadiance(reader.readFloat());
+        }
+        else if (keyword == "image")
+        {
+            world->width  = reader.readUnsigned();
+            world->height = reader.readUnsigned();
+        }
+        else if (keyword == "background")
+        {
+            world->background = readColour(reader);
+        }
+        else if (keyword == "sampler")
+        {
+            const std::string name{reader.readWord()};
+            const auto numSamples{static_cast<int>(reader.readUnsigned())};
+            const auto numSets{static_cast<int>(reader.readUnsigned())};
+            try
+            {
+                world->sampler = makeSampler(name, numSamples, numSets);
+            }
+            catch (std::invalid_argument const& error)
+            {
+                reader.fail(error.what());
+            }
+            if (!world->sampler)
+            {
+                reader.fail("unknown sampler '" + name + "'");
+            }
+            if (!reader.isEndOfStatement())
+            {
+                world->sampler->setSeed(reader.readUnsigned());
+            }
+        }
+        else if (keyword == "light_samples")
+        {
+            world->lightSamples = reader.readUnsigned();
+        }
+        else
+        {
+            reader.fail("unknown statement '" + std::string{keyword} + "'");
         }
     }
 
-    saveToFile("raytrace.bmp", world->width, world->height, world->image);
+    return world;
+}
 
-    return 0;
+namespace
+{
+    // Bump whenever the sections below or any of the records they hold
+    // change layout.
+    constexpr std::uint32_t sceneCacheVersion{1};
+
+    // largest width or height a cache may ask for
+    constexpr std::uint64_t maxCacheImageSize{1 << 16};
+
+    struct CacheSettings
+    {
+        std::uint64_t width;
+        std::uint64_t height;
+        Colour background;
+        std::uint32_t lightSamples;
+        std::uint32_t numSamples;
+        std::uint32_t numSets;
+        char sampler[16];
+        std::uint64_t seed;
+    };
+
+    // sections of a scene cache, in order
+    enum CacheSection : std::size_t
+    {
+        Settings,
+        ShapeMaterials,
+        Spheres,
+        Materials,
+        Lights,
+        AmbientLight,
+        BvhNodes,
+        BvhIndices,
+        BvhStatistics,
+        SphereX,
+        SphereY,
+        SphereZ,
+        SphereRadiusSqr,
+        SphereIds
+    };
+
+    std::string getSamplerName(Sampler const& sampler)
+    {
+        if (dynamic_cast<Regular const*>(&sampler))
+        {
+            return "regular";
+        }
+        if (dynamic_cast<Random const*>(&sampler))
+        {
+            return "random";
+        }
+        if (dynamic_cast<Jittered const*>(&sampler))
+        {
+            return "jittered";
+        }
+        if (dynamic_cast<MultiJittered const*>(&sampler))
+        {
+            return "multi_jittered";
+        }
+        if (dynamic_cast<Hammersley const*>(&sampler))
+        {
+            return "hammersley";
+        }
+        if (dynamic_cast<Sobol const*>(&sampler))
+        {
+            return "sobol";
+        }
+        if (dynamic_cast<R2 const*>(&sampler))
+        {
+            return "r2";
+        }
+        return {};
+    }
+
+    // Copies the records out of the compiled variants, failing on anything
+    // that only exists as a pointer.
+    template<typename Record, typename Variant>
+    std::vector<Record> getRecords(std::vector<Variant> const& variants,
+                                   std::string const& filename)
+    {
+        std::vector<Record> records;
+        records.reserve(variants.size());
+        for (auto const& variant : variants)
+        {
+            auto record{std::get_if<Record>(&variant)};
+            if (record == nullptr)
+            {
+                throw common::SceneError{
+                    filename + ": only spheres, matte materials and "
+                               "directional lights can be cached"};
+            }
+            records.push_back(*record);
+        }
+        return records;
+    }
+
+    template<typename T>
+    common::Span<T> getCacheSection(common::SceneCache const& cache,
+                                    CacheSection section,
+                                    std::size_t size,
+                                    std::string const& filename)
+    {
+        auto span{cache.getSection<T>(section)};
+        if (span.size != size)
+        {
+            throw common::SceneError{filename + ": section " +
+                                     std::to_string(section) +
+                                     " has the wrong size"};
+        }
+        return span;
+    }
+} // namespace
+
+void saveSceneCache(World const& world, std::string const& filename)
+{
+    auto const& scene{*world.compiled};
+    if (scene.spheres.size != scene.shapeMaterials.size)
+    {
+        throw common::SceneError{
+            filename + ": only spheres, matte materials and directional "
+                       "lights can be cached"};
+    }
+
+    const auto materials{getRecords<MatteRecord>(scene.materials, filename)};
+    const auto lights{getRecords<DirectionalRecord>(scene.lights, filename)};
+    const auto ambient{getRecords<AmbientRecord>(
+        std::vector<CompiledLight>{scene.ambient}, filename)};
+
+    CacheSettings settings{};
+    settings.width        = world.width;
+    settings.height       = world.height;
+    settings.background   = world.background;
+    settings.lightSamples = world.lightSamples;
+    settings.numSamples =
+        static_cast<std::uint32_t>(world.sampler->getNumSamples());
+    settings.numSets = static_cast<std::uint32_t>(world.sampler->getNumSets());
+    settings.seed    = world.sampler->getSeed();
+
+    const std::string samplerName{getSamplerName(*world.sampler)};
+    if (samplerName.empty())
+    {
+        throw common::SceneError{filename + ": unknown sampler"};
+    }
+    samplerName.copy(settings.sampler, sizeof(settings.sampler) - 1);
+
+    const common::SphereArrays sphereArrays{world.spheres.getArrays()};
+    const std::size_t paddedSize{sphereArrays.size +
+                                 common::SphereSet::padding};
+    const common::BvhStats stats{world.bvh.getStats()};
+
+    // the order has to match CacheSection
+    common::SceneCacheWriter writer;
+    writer.addSection(&settings, 1);
+    writer.addSection(scene.shapeMaterials.first, scene.shapeMaterials.size);
+    writer.addSection(scene.spheres.first, scene.spheres.size);
+    writer.addSection(materials.data(), materials.size());
+    writer.addSection(lights.data(), lights.size());
+    writer.addSection(ambient.data(), ambient.size());
+    writer.addSection(world.bvh.getNodes().first, world.bvh.getNodes().size);
+    writer.addSection(world.bvh.getIndices().first,
+                      world.bvh.getIndices().size);
+    writer.addSection(&stats, 1);
+    writer.addSection(sphereArrays.x, paddedSize);
+    writer.addSection(sphereArrays.y, paddedSize);
+    writer.addSection(sphereArrays.z, paddedSize);
+    writer.addSection(sphereArrays.radiusSqr, paddedSize);
+    writer.addSection(sphereArrays.ids, paddedSize);
+    writer.write(filename, sceneCacheVersion);
 }
 
-void saveToFile(std::string const& filename,
-                std::size_t width,
-                std::size_t height,
-                std::vector<Colour> const& image)
+std::shared_ptr<World> loadSceneCache(std::string const& filename,
+                                      bool verify)
 {
-    std::vector<unsigned char> data(image.size() * 3);
+    auto cache{
+        std::make_shared<common::SceneCache>(filename, sceneCacheVersion)};
+    if (verify && !cache->verify())
+    {
+        throw common::SceneError{filename + ": checksum mismatch"};
+    }
+
+    // only the handful of settings, materials and lights are copied, the
+    // per-object arrays are used in place
+    auto const& settings{
+        getCacheSection<CacheSettings>(*cache, Settings, 1, filename)[0]};
+    if (settings.width == 0 || settings.width > maxCacheImageSize ||
+        settings.height == 0 || settings.height > maxCacheImageSize)
+    {
+        throw common::SceneError{filename + ": image size out of range"};
+    }
+
+    auto world{std::make_shared<World>()};
+    world->width        = settings.width;
+    world->height       = settings.height;
+    world->background   = settings.background;
+    world->lightSamples = settings.lightSamples;
+    const std::string samplerName{
+        settings.sampler,
+        std::find(settings.sampler, std::end(settings.sampler), '\0')};
+    // counts too large for an int come out negative, which Sampler rejects
+    try
+    {
+        world->sampler = makeSampler(samplerName,
+                                     static_cast<int>(settings.numSamples),
+                                     static_cast<int>(settings.numSets));
+    }
+    catch (std::invalid_argument const& error)
+    {
+        throw common::SceneError{filename + ": " + error.what()};
+    }
+    if (!world->sampler)
+    {
+        throw common::SceneError{filename + ": unknown sampler"};
+    }
+    world->sampler->setSeed(settings.seed);
+
+    auto compiled{std::make_shared<CompiledScene>()};
+    compiled->shapeMaterials =
+        cache->getSection<std::uint32_t>(ShapeMaterials);
+    compiled->spheres = getCacheSection<SphereRecord>(
+        *cache, Spheres, compiled->shapeMaterials.size, filename);
+
+    for (auto const& material : cache->getSection<MatteRecord>(Materials))
+    {
+        compiled->materials.push_back(material);
+    }
+    for (auto const& light : cache->getSection<DirectionalRecord>(Lights))
+    {
+        compiled->lights.push_back(light);
+    }
+    compiled->ambient =
+        getCacheSection<AmbientRecord>(*cache, AmbientLight, 1, filename)[0];
+    buildLightTable(*compiled);
+
+    const std::size_t numSpheres{compiled->spheres.size};
+    const std::size_t paddedSize{numSpheres + common::SphereSet::padding};
+    auto const& stats{getCacheSection<common::BvhStats>(
+        *cache, BvhStatistics, 1, filename)[0]};
+    auto nodes{getCacheSection<common::BvhNode>(
+        *cache, BvhNodes, stats.numNodes, filename)};
+    auto indices{getCacheSection<std::uint32_t>(
+        *cache, BvhIndices, stats.numPrimitives, filename)};
+    auto ids{getCacheSection<std::uint32_t>(
+        *cache, SphereIds, paddedSize, filename)};
+
+    // The arrays are indexed without checks while rendering, so every index
+    // in them is checked here whether or not verify is set: this reads the
+    // per-object arrays once, which is far cheaper than the checksum.
+    auto isBelow = [](common::Span<std::uint32_t> span,
+                      std::size_t count,
+                      std::size_t limit) {
+        return std::all_of(span.first,
+                           span.first + count,
+                           [&](std::uint32_t i) { return i < limit; });
+    };
+    if (!isBelow(compiled->shapeMaterials,
+                 compiled->shapeMaterials.size,
+                 compiled->materials.size()) ||
+        !isBelow(ids, numSpheres, numSpheres) ||
+        stats.numPrimitives != numSpheres ||
+        !common::Bvh::isValid(nodes.first, indices.first, stats))
+    {
+        throw common::SceneError{filename + ": index out of range"};
+    }
+    world->bvh.assign(nodes.first, indices.first, stats);
 
-    for (std::size_t i{0}, k{0}; i < image.size(); ++i, k += 3)
+    auto floats = [&](CacheSection section) {
+        return getCacheSection<float>(*cache, section, paddedSize, filename)
+            .first;
+    };
+    if (numSpheres > 0)
     {
-        Colour pixel = image[i];
-        data[k + 0]  = static_cast<unsigned char>(pixel.r * 255);
-        data[k + 1]  = static_cast<unsigned char>(pixel.g * 255);
-        data[k + 2]  = static_cast<unsigned char>(pixel.b * 255);
+        world->spheres.assign({floats(SphereX),
+                               floats(SphereY),
+                               floats(SphereZ),
+                               floats(SphereRadiusSqr),
+                               ids.first,
+                               numSpheres});
     }
 
-    stbi_write_bmp(filename.c_str(),
-                   static_cast<int>(width),
-                   static_cast<int>(height),
-                   3,
-                   data.data());
+    compiled->cache = cache;
+    world->compiled = compiled;
+    return world;
 }
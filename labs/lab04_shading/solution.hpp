@@ -5,31 +5,63 @@
 #include <atlas/math/Random.hpp>
 #include <atlas/math/Ray.hpp>
 
+#include <common/AliasTable.hpp>
+#include <common/Arena.hpp>
+#include <common/BBox.hpp>
+#include <common/Bvh.hpp>
+#include <common/CounterRng.hpp>
+#include <common/Film.hpp>
+#include <common/Image.hpp>
+#include <common/Pcg32.hpp>
+#include <common/Profile.hpp>
+#include <common/SampleSets.hpp>
+#include <common/SampleTables.hpp>
+#include <common/SceneCache.hpp>
+#include <common/SceneReader.hpp>
+#include <common/SphereSet.hpp>
+#include <common/Timer.hpp>
+
 #include <fmt/printf.h>
 #include <stb_image.h>
 #include <stb_image_write.h>
 
+#include <cstdint>
 #include <limits>
 #include <memory>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <unordered_map>
+#include <variant>
 #include <vector>
 
 using atlas::core::areEqual;
 
 using Colour = atlas::math::Vector;
 
-void saveToFile(std::string const& filename,
-                std::size_t width,
-                std::size_t height,
-                std::vector<Colour> const& image);
+// See common::saveToFile in common/Image.hpp.
+using common::saveToFile;
 
 // Declarations
 class BRDF;
 class Camera;
+struct CompiledScene;
 class Material;
 class Light;
 class Shape;
 class Sampler;
 
+// Where makeSceneObject puts a world's shapes, materials and lights. Each
+// kind gets its own arena, so objects of one type sit next to each other
+// rather than wherever the heap put them, and building a scene costs a
+// handful of block allocations instead of one per object.
+struct SceneArenas
+{
+    std::shared_ptr<common::Arena> shapes;
+    std::shared_ptr<common::Arena> materials;
+    std::shared_ptr<common::Arena> lights;
+};
+
 struct World
 {
     std::size_t width, height;
@@ -39,6 +71,29 @@ struct World
     std::vector<Colour> image;
     std::vector<std::shared_ptr<Light>> lights;
     std::shared_ptr<Light> ambient;
+
+    // Number of lights sampled per shading point, picked in proportion to
+    // their power. 0 (or at least as many as there are lights) evaluates
+    // every light instead, which is exact but costs time linear in the
+    // number of lights.
+    std::uint32_t lightSamples;
+
+    // owns the memory of the objects above, see makeSceneObject
+    SceneArenas arenas;
+
+    // samples accumulated by renderPass
+    common::Film film;
+
+    // devirtualized copy of the objects above that rendering goes through,
+    // see compileScene
+    std::shared_ptr<CompiledScene> compiled;
+
+    // acceleration structure over scene, see buildBvh
+    common::Bvh bvh;
+
+    // copy of the spheres in bvh leaf order for the SIMD kernels, empty if
+    // the scene holds other shapes
+    common::SphereSet spheres;
 };
 
 struct ShadeRec
@@ -47,34 +102,163 @@ struct ShadeRec
     float t;
     atlas::math::Normal normal;
     atlas::math::Ray<atlas::math::Vector> ray;
-    std::shared_ptr<Material> material;
-    std::shared_ptr<World> world;
+
+    // Non-owning: a ShadeRec is created for every sample, so it must not
+    // touch reference counts. The World and the shapes own these.
+    Material* material;
+    World const* world;
+
+    // index into World::scene of the closest hit, set by hitScene
+    std::uint32_t object;
+
+    // the sample being shaded, which keys any random numbers drawn while
+    // shading it (see common/CounterRng.hpp)
+    std::size_t pixel;
+    std::uint32_t sample;
 };
 
+// Builds a world from a scene file in a single pass, see scene.txt next to
+// this file for the format. Throws common::SceneError if the file can't be
+// read or has a mistake in it. The world still has to be compiled with
+// compileScene before it is rendered.
+std::shared_ptr<World> loadScene(std::string const& filename);
+
+// Writes the compiled form of the world, its BVH and its render settings to
+// a binary scene cache (see common/SceneCache.hpp). Only worlds made of
+// spheres, Matte materials and directional lights can be cached; anything
+// else, or a file that can't be written, throws common::SceneError.
+void saveSceneCache(World const& world, std::string const& filename);
+
+// Maps a scene cache written by saveSceneCache and renders straight from it:
+// the arrays are used in place, so loading takes the same time whatever the
+// size of the scene. The world comes back compiled, but only in that form,
+// with scene and lights left empty, so it must not be compiled again.
+//
+// Every load checks the header, the section sizes, the settings and every
+// index the renderer follows (materials, BVH nodes and primitives, sphere
+// ids), so a damaged file can't send rendering out of bounds. Only verify
+// also checks the checksum of the arrays, which reads the whole file;
+// without it, corrupted colours, positions or bounds load without complaint.
+// Throws common::SceneError if the file isn't a cache from this version of
+// the code or fails any of the checks.
+std::shared_ptr<World> loadSceneCache(std::string const& filename,
+                                      bool verify = false);
+
+// Rebuilds world.bvh and world.spheres from world.scene. Rays are traced
+// against these, so this must be called whenever the scene changes.
+void buildBvh(World& world);
+
+// Rebuilds world.compiled from the scene, materials and lights, then calls
+// buildBvh. Must be called whenever any of them change.
+void compileScene(World& world);
+
+// Finds the closest object along the ray through the compiled scene and
+// fills sr the same way the object's Shape::hit would. Returns true if
+// anything was hit.
+bool hitScene(World const& world,
+              atlas::math::Ray<atlas::math::Vector> const& ray,
+              ShadeRec& sr);
+
+// Returns true if anything in the compiled scene blocks the ray before tMax.
+// The search stops at the first blocker found rather than the closest, so
+// this is the query every light visibility test goes through.
+bool occludedScene(World const& world,
+                   atlas::math::Ray<atlas::math::Vector> const& ray,
+                   float tMax);
+
+// Shades the hit found by hitScene with the compiled material and lights.
+Colour shadeScene(World const& world, ShadeRec& sr);
+
+// Adds one more set of world.sampler->getNumSamples() samples to every
+// active pixel of world.film. Every pass draws different samples, so the
+// film keeps converging as passes are added.
+void renderPass(World& world, std::uint32_t pass);
+
+// Renders the frame into world.image as a single pass.
+void render(World& world);
+
+// Renders passes, retiring pixels once their noise is under the threshold so
+// that later passes only go to the noisy ones, then resolves world.image. The
+// sample counts are left in world.film.
+common::AdaptiveStats renderAdaptive(World& world,
+                                     common::AdaptiveSettings const& settings);
+
 // Abstract classes defining the interfaces for concrete entities
 
+// Position of one worker in a Sampler's tables. Every thread that samples
+// keeps its own cursor, so the Sampler itself is only read while rendering.
+struct SampleCursor
+{
+    std::size_t pixel;
+
+    // index of the next sample within the pixel, counted across passes
+    std::uint32_t sample;
+
+    common::Sample2D const* set;
+    int count;
+};
+
 class Sampler
 {
 public:
+    // the shuffled indices are 16 bits
+    static constexpr int maxSamples{65536};
+
+    // Throws std::invalid_argument unless numSamples is in [1, maxSamples],
+    // numSets is at least 1 and there are no more than INT_MAX samples in
+    // all.
     Sampler(int numSamples, int numSets);
     virtual ~Sampler() = default;
 
     int getNumSamples() const;
 
+    int getNumSets() const;
+
+    std::uint64_t getSeed() const;
+
     void setupShuffledIndeces();
 
     virtual void generateSamples() = 0;
 
-    atlas::math::Point sampleUnitSquare();
+    // rebuilds the sample tables, which are a pure function of the seed
+    void setSeed(std::uint64_t seed);
+
+    // Moves the cursor to the first sample of a pixel. Which set a pixel
+    // draws is a counter-based random number keyed on the seed, the pixel
+    // and the sample index (see common/CounterRng.hpp), so a pixel gets the
+    // same samples regardless of which thread renders it, or in which order,
+    // and different samples in every pass.
+    void startPixel(SampleCursor& cursor,
+                    std::size_t pixel,
+                    std::uint32_t pass = 0) const;
+
+    atlas::math::Point sampleUnitSquare(SampleCursor& cursor) const;
+
+    // Hands out a whole set at once: the samples the next getNumSamples()
+    // calls to sampleUnitSquare would return, in the same order. The cursor
+    // must be at the start of a set, as it is after startPixel.
+    common::SampleSpan samplePixel(SampleCursor& cursor) const;
 
 protected:
-    std::vector<atlas::math::Point> mSamples;
-    std::vector<int> mShuffledIndeces;
+    // the set the cursor's pixel draws for the sample it is at
+    common::SampleSpan pickSet(SampleCursor const& cursor) const;
+
+    // packs samples, mNumSets sets of mNumSamples points, into mSets in the
+    // order given by mShuffledIndeces
+    void setSamples(std::vector<common::Sample2D> const& samples);
+
+    common::SampleSets mSets;
+
+    // 16 bits, so at most maxSamples samples per set
+    std::vector<std::uint16_t> mShuffledIndeces;
+
+    // dimensions of the counter-based random numbers drawn by samplers
+    static constexpr std::uint32_t setDimension{0};
+    static constexpr std::uint32_t shuffleDimension{1};
 
     int mNumSamples;
     int mNumSets;
-    unsigned long mCount;
-    int mJump;
+    std::uint64_t mSeed;
 };
 
 class Shape
@@ -88,6 +272,14 @@ public:
     virtual bool hit(atlas::math::Ray<atlas::math::Vector> const& ray,
                      ShadeRec& sr) const = 0;
 
+    virtual common::BBox getBoundingBox() const = 0;
+
+    // Occlusion test for shadow rays: true if the ray hits the shape, with
+    // the distance in tMin. Unlike hit, nothing else about the hit is
+    // worked out.
+    bool shadowHit(atlas::math::Ray<atlas::math::Vector> const& ray,
+                   float& tMin) const;
+
     void setColour(Colour const& col);
 
     Colour getColour() const;
@@ -121,28 +313,42 @@ class Material
 public:
     virtual ~Material() = default;
 
-    virtual Colour shade(ShadeRec& sr) = 0;
+    virtual Colour shade(ShadeRec& sr) const = 0;
 };
 
 class Light
 {
 public:
-    virtual atlas::math::Vector getDirection(ShadeRec& sr) = 0;
+    Light();
+
+    virtual atlas::math::Vector getDirection(ShadeRec& sr) const = 0;
 
-    virtual Colour L(ShadeRec& sr);
+    virtual Colour L(ShadeRec& sr) const;
+
+    // Whether anything blocks the shadow ray, which starts at the point
+    // being shaded and heads towards the light. Lights without a position
+    // or direction are never blocked.
+    virtual bool inShadow(atlas::math::Ray<atlas::math::Vector> const& ray,
+                          ShadeRec const& sr) const;
 
     void scaleRadiance(float b);
 
     void setColour(Colour const& c);
 
+    // on by default; a light that doesn't cast shadows skips the shadow ray
+    void setShadows(bool shadows);
+
+    bool castsShadows() const;
+
 protected:
     Colour mColour;
     float mRadiance;
+    bool mShadows;
 };
 
 // Concrete classes which we can construct and use in our ray tracer
 
-class Sphere : public Shape
+class Sphere final : public Shape
 {
 public:
     Sphere(atlas::math::Point center, float radius);
@@ -150,6 +356,12 @@ public:
     bool hit(atlas::math::Ray<atlas::math::Vector> const& ray,
              ShadeRec& sr) const;
 
+    common::BBox getBoundingBox() const;
+
+    atlas::math::Point getCentre() const;
+
+    float getRadius() const;
+
 private:
     bool intersectRay(atlas::math::Ray<atlas::math::Vector> const& ray,
                       float& tMin) const;
@@ -175,7 +387,53 @@ public:
     void generateSamples();
 };
 
-class Lambertian : public BRDF
+// Samplers over the low-discrepancy tables in common/SampleTables.hpp. A table
+// is built once and shared by every sampler with the same settings, so
+// creating samplers again (for instance every frame) skips generating the
+// points. Each sampler still shuffles its own indices and packs its own copy
+// of the table, which is linear in numSamples * numSets.
+
+class Jittered : public Sampler
+{
+public:
+    Jittered(int numSamples, int numSets);
+
+    void generateSamples();
+};
+
+class MultiJittered : public Sampler
+{
+public:
+    MultiJittered(int numSamples, int numSets);
+
+    void generateSamples();
+};
+
+class Hammersley : public Sampler
+{
+public:
+    Hammersley(int numSamples, int numSets);
+
+    void generateSamples();
+};
+
+class Sobol : public Sampler
+{
+public:
+    Sobol(int numSamples, int numSets);
+
+    void generateSamples();
+};
+
+class R2 : public Sampler
+{
+public:
+    R2(int numSamples, int numSets);
+
+    void generateSamples();
+};
+
+class Lambertian final : public BRDF
 {
 public:
     Lambertian();
@@ -197,7 +455,7 @@ private:
     float mDiffuseReflection;
 };
 
-class Matte : public Material
+class Matte final : public Material
 {
 public:
     Matte();
@@ -209,14 +467,18 @@ public:
 
     void setDiffuseColour(Colour colour);
 
-    Colour shade(ShadeRec& sr) override;
+    Lambertian const& getDiffuseBRDF() const;
+
+    Lambertian const& getAmbientBRDF() const;
+
+    Colour shade(ShadeRec& sr) const override;
 
 private:
-    std::shared_ptr<Lambertian> mDiffuseBRDF;
-    std::shared_ptr<Lambertian> mAmbientBRDF;
+    Lambertian mDiffuseBRDF;
+    Lambertian mAmbientBRDF;
 };
 
-class Directional : public Light
+class Directional final : public Light
 {
 public:
     Directional();
@@ -224,19 +486,130 @@ public:
 
     void setDirection(atlas::math::Vector const& d);
 
-    atlas::math::Vector getDirection(ShadeRec& sr) override;
+    atlas::math::Vector getDirection(ShadeRec& sr) const override;
+
+    bool inShadow(atlas::math::Ray<atlas::math::Vector> const& ray,
+                  ShadeRec const& sr) const override;
 
 private:
     atlas::math::Vector mDirection;
 };
 
-class Ambient : public Light
+class Ambient final : public Light
 {
 public:
     Ambient();
 
-    atlas::math::Vector getDirection(ShadeRec& sr) override;
+    atlas::math::Vector getDirection(ShadeRec& sr) const override;
 
 private:
     atlas::math::Vector mDirection;
 };
+
+// Compiled form of the scene
+
+// The classes above are the authoring interface. Before rendering, the scene
+// is compiled into copies of the concrete shapes and flat records for the
+// concrete materials and lights, so that hits and shading are dispatched with
+// a switch on the variant index and can be inlined. Objects of any other type
+// are kept behind their base pointer and still go through the virtual
+// interface.
+
+// Everything about a sphere that filling in a hit needs.
+struct SphereRecord
+{
+    atlas::math::Point centre;
+    float radius;
+    Colour colour;
+};
+
+// The records hold what the BRDFs and lights would return, with their
+// constants already multiplied out, since none of it depends on the point
+// being shaded.
+struct MatteRecord
+{
+    // ka * cd, the ambient BRDF's rho
+    Colour ambient;
+
+    // kd * cd / pi, the diffuse BRDF's fn
+    Colour diffuse;
+};
+
+struct DirectionalRecord
+{
+    atlas::math::Vector direction;
+
+    // ls * cl, what Light::L returns
+    Colour radiance;
+    bool shadows;
+};
+
+struct AmbientRecord
+{
+    Colour radiance;
+};
+
+using CompiledShape    = std::variant<Sphere, Shape const*>;
+using CompiledMaterial = std::variant<MatteRecord, Material const*>;
+using CompiledLight =
+    std::variant<DirectionalRecord, AmbientRecord, Light const*>;
+
+struct CompiledScene
+{
+    // indexed like World::scene, empty for a world loaded from a scene cache
+    std::vector<CompiledShape> shapes;
+
+    // indexed like World::scene
+    common::Span<std::uint32_t> shapeMaterials;
+
+    // Indexed like World::scene when every shape is a sphere, empty
+    // otherwise. Hits in such scenes are filled in from these instead of
+    // going through the shapes.
+    common::Span<SphereRecord> spheres;
+
+    // each material shared by several shapes is stored once
+    std::vector<CompiledMaterial> materials;
+
+    std::vector<CompiledLight> lights;
+    CompiledLight ambient;
+
+    // over lights, weighted by power, see World::lightSamples
+    common::AliasTable lightTable;
+
+    // what the spans above point into: either arrays of the compiled scene's
+    // own or a scene cache mapped from disk
+    std::vector<std::uint32_t> shapeMaterialStorage;
+    std::vector<SphereRecord> sphereStorage;
+    std::shared_ptr<common::SceneCache> cache;
+};
+
+// Creates a shape, material or light for the world in the matching arena of
+// world.arenas, which are set up on first use. The result is an ordinary
+// shared_ptr that can go in World::scene and the rest; it keeps its arena
+// alive, so it may outlive the world it was made for.
+template<typename T, typename... Args>
+std::shared_ptr<T> makeSceneObject(World& world, Args&&... args)
+{
+    std::shared_ptr<common::Arena>* arena{nullptr};
+    if constexpr (std::is_base_of_v<Shape, T>)
+    {
+        arena = &world.arenas.shapes;
+    }
+    else if constexpr (std::is_base_of_v<Material, T>)
+    {
+        arena = &world.arenas.materials;
+    }
+    else
+    {
+        static_assert(std::is_base_of_v<Light, T>,
+                      "only shapes, materials and lights live in the arenas");
+        arena = &world.arenas.lights;
+    }
+
+    if (!*arena)
+    {
+        *arena = std::make_shared<common::Arena>();
+    }
+    return std::allocate_shared<T>(common::ArenaAllocator<T>{*arena},
+                                   std::forward<Args>(args)...);
+}